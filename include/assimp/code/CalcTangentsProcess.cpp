@@ -46,6 +46,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 // internal headers
 #include "CalcTangentsProcess.h"
 #include "ProcessHelper.h"
+#include "ParallelFor.h"
 #include "TinyFormatter.h"
 #include "qnan.h"
 
@@ -55,7 +56,8 @@ using namespace Assimp;
 // Constructor to be privately used by Importer
 CalcTangentsProcess::CalcTangentsProcess()
 : configMaxAngle( AI_DEG_TO_RAD(45.f) )
-, configSourceUV( 0 ) {
+, configSourceUV( 0 )
+, configNumThreads( 1 ) {
     // nothing to do here
 }
 
@@ -85,6 +87,8 @@ void CalcTangentsProcess::SetupProperties(const Importer* pImp)
     configMaxAngle = AI_DEG_TO_RAD(configMaxAngle);
 
     configSourceUV = pImp->GetPropertyInteger(AI_CONFIG_PP_CT_TEXTURE_CHANNEL_INDEX,0);
+
+    configNumThreads = GetNumThreads(pImp->GetPropertyInteger(AI_CONFIG_PP_NUM_THREADS,0));
 }
 
 // ------------------------------------------------------------------------------------------------
@@ -95,10 +99,12 @@ void CalcTangentsProcess::Execute( aiScene* pScene)
 
     DefaultLogger::get()->debug("CalcTangentsProcess begin");
 
-    bool bHas = false;
-    for ( unsigned int a = 0; a < pScene->mNumMeshes; a++ ) {
-        if(ProcessMesh( pScene->mMeshes[a],a))bHas = true;
-    }
+    // meshes are independent: process several of them at once
+    std::vector<char> meshHas( pScene->mNumMeshes, 0 );
+    ParallelFor( pScene->mNumMeshes, configNumThreads, [&]( unsigned int a ) {
+        meshHas[a] = ProcessMesh( pScene->mMeshes[a],a);
+    });
+    const bool bHas = std::find( meshHas.begin(), meshHas.end(), 1 ) != meshHas.end();
 
     if ( bHas ) {
         DefaultLogger::get()->info("CalcTangentsProcess finished. Tangents have been calculated");
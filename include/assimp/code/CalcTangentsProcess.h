@@ -108,6 +108,8 @@ private:
     /** Configuration option: maximum smoothing angle, in radians*/
     float configMaxAngle;
     unsigned int configSourceUV;
+    /** Configuration option: number of threads processing the meshes */
+    unsigned int configNumThreads;
 };
 
 } // end of namespace Assimp
@@ -58,6 +58,7 @@ namespace Assimp    {
 class DefaultIOStream : public IOStream
 {
     friend class DefaultIOSystem;
+    friend class FileMapping;
 #if __ANDROID__
 #if __ANDROID_API__ > 9
 #if defined(AI_CONFIG_ANDROID_JNI_ASSIMP_MANAGER_SUPPORT)
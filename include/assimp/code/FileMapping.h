@@ -0,0 +1,184 @@
+/*
+Open Asset Import Library (assimp)
+----------------------------------------------------------------------
+
+Copyright (c) 2006-2016, assimp team
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the
+following conditions are met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+  copyright notice, this list of conditions and the
+  following disclaimer in the documentation and/or other
+  materials provided with the distribution.
+
+* Neither the name of the assimp team, nor the names of its
+  contributors may be used to endorse or promote products
+  derived from this software without specific prior
+  written permission of the assimp team.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+----------------------------------------------------------------------
+*/
+
+/** @file FileMapping.h
+ *  @brief Read-only memory mapping of a file opened by the default IO system
+ */
+#ifndef INCLUDED_AI_FILE_MAPPING_H
+#define INCLUDED_AI_FILE_MAPPING_H
+
+#include "DefaultIOStream.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#   ifndef WIN32_LEAN_AND_MEAN
+#       define WIN32_LEAN_AND_MEAN
+#   endif
+#   ifndef NOMINMAX
+#       define NOMINMAX
+#   endif
+#   include <windows.h>
+#   include <io.h>
+#else
+#   include <sys/mman.h>
+#   include <unistd.h>
+#endif
+
+namespace Assimp {
+
+// ----------------------------------------------------------------------------------
+/** @brief  Maps the whole contents of a stream in memory, read-only.
+ *
+ *  Large text files can be parsed straight from the page cache instead of
+ *  being copied into a buffer first. Only files opened by the default IO
+ *  system can be mapped: Map() fails for any other stream (memory buffers,
+ *  archives, custom IO systems) and the caller reads the stream as usual.
+ *  The mapping is released when the object is destroyed.
+ */
+class FileMapping
+{
+public:
+    FileMapping()
+        : mData(NULL)
+        , mSize(0)
+    {}
+
+    ~FileMapping() {
+        Unmap();
+    }
+
+    // -------------------------------------------------------------------
+    /** @brief  Maps the file behind a stream.
+     *  @param  stream  Stream to map, the file position is not changed.
+     *  @return true if the file has been mapped. */
+    bool Map(IOStream* stream) {
+        Unmap();
+        DefaultIOStream* file = dynamic_cast<DefaultIOStream*>(stream);
+        if (NULL == file || NULL == file->mFile) {
+            return false;
+        }
+        const size_t size = file->FileSize();
+        if (0 == size) {
+            return false;
+        }
+#ifdef _WIN32
+        HANDLE handle = (HANDLE)::_get_osfhandle(::_fileno(file->mFile));
+        if (INVALID_HANDLE_VALUE == handle) {
+            return false;
+        }
+        HANDLE mapping = ::CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (NULL == mapping) {
+            return false;
+        }
+        // the view keeps the mapping object alive
+        mData = static_cast<const char*>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, size));
+        ::CloseHandle(mapping);
+        if (NULL == mData) {
+            return false;
+        }
+#else
+        void* view = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, ::fileno(file->mFile), 0);
+        if (MAP_FAILED == view) {
+            return false;
+        }
+        ::madvise(view, size, MADV_SEQUENTIAL);
+        mData = static_cast<const char*>(view);
+#endif
+        mSize = size;
+        return true;
+    }
+
+    // -------------------------------------------------------------------
+    /** @brief  Releases the mapping, the pointers into it become invalid. */
+    void Unmap() {
+        if (NULL == mData) {
+            return;
+        }
+#ifdef _WIN32
+        ::UnmapViewOfFile(mData);
+#else
+        ::munmap(const_cast<char*>(mData), mSize);
+#endif
+        mData = NULL;
+        mSize = 0;
+    }
+
+    const char* Data() const {
+        return mData;
+    }
+
+    // -------------------------------------------------------------------
+    /** @brief  Returns true if the byte after the contents can be read,
+     *  and is a zero.
+     *
+     *  The last page of the mapping is filled with zeros past the end of
+     *  the file, so unless the size is a multiple of the page size the
+     *  mapped contents end with a binary zero, like the buffers filled by
+     *  BaseImporter::TextFileToBuffer(). */
+    bool IsZeroTerminated() const {
+        if (NULL == mData) {
+            return false;
+        }
+#ifdef _WIN32
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        const size_t pageSize = info.dwPageSize;
+#else
+        const size_t pageSize = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+#endif
+        return 0 != mSize % pageSize;
+    }
+
+    size_t Size() const {
+        return mSize;
+    }
+
+private:
+    FileMapping(const FileMapping&);
+    FileMapping& operator=(const FileMapping&);
+
+    const char* mData;
+    size_t mSize;
+};
+
+} // ns Assimp
+
+#endif // INCLUDED_AI_FILE_MAPPING_H
@@ -105,6 +105,8 @@ private:
 
     /** Configuration option: maximum smoothing angle, in radians*/
     float configMaxAngle;
+    /** Configuration option: number of threads processing the meshes */
+    unsigned int configNumThreads;
 };
 
 } // end of namespace Assimp
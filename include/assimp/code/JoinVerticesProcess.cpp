@@ -48,6 +48,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "JoinVerticesProcess.h"
 #include "ProcessHelper.h"
+#include "ParallelFor.h"
 #include "Vertex.h"
 #include "TinyFormatter.h"
 #include <stdio.h>
@@ -56,6 +57,7 @@ using namespace Assimp;
 // ------------------------------------------------------------------------------------------------
 // Constructor to be privately used by Importer
 JoinVerticesProcess::JoinVerticesProcess()
+: configNumThreads( 1 )
 {
     // nothing to do here
 }
@@ -73,6 +75,13 @@ bool JoinVerticesProcess::IsActive( unsigned int pFlags) const
 {
     return (pFlags & aiProcess_JoinIdenticalVertices) != 0;
 }
+// ------------------------------------------------------------------------------------------------
+// Setup configuration properties for the step
+void JoinVerticesProcess::SetupProperties(const Importer* pImp)
+{
+    configNumThreads = GetNumThreads(pImp->GetPropertyInteger(AI_CONFIG_PP_NUM_THREADS,0));
+}
+
 // ------------------------------------------------------------------------------------------------
 // Executes the post processing step on the given imported data.
 void JoinVerticesProcess::Execute( aiScene* pScene)
@@ -87,10 +96,14 @@ void JoinVerticesProcess::Execute( aiScene* pScene)
         }
     }
 
-    // execute the step
+    // execute the step, on several meshes at once
+    std::vector<int> meshVertices( pScene->mNumMeshes );
+    ParallelFor( pScene->mNumMeshes, configNumThreads, [&]( unsigned int a ) {
+        meshVertices[a] = ProcessMesh( pScene->mMeshes[a],a);
+    });
     int iNumVertices = 0;
     for( unsigned int a = 0; a < pScene->mNumMeshes; a++)
-        iNumVertices += ProcessMesh( pScene->mMeshes[a],a);
+        iNumVertices += meshVertices[a];
 
     // if logging is active, print detailed statistics
     if (!DefaultLogger::isNullLogger())
@@ -75,6 +75,13 @@ public:
     */
     bool IsActive( unsigned int pFlags) const;
 
+    // -------------------------------------------------------------------
+    /** Called prior to ExecuteOnScene().
+    * The function is a request to the process to update its configuration
+    * basing on the Importer's configuration property list.
+    */
+    void SetupProperties(const Importer* pImp);
+
     // -------------------------------------------------------------------
     /** Executes the post processing step on the given imported data.
     * At the moment a process is not supposed to fail.
@@ -91,6 +98,8 @@ public:
     int ProcessMesh( aiMesh* pMesh, unsigned int meshIndex);
 
 private:
+    /** Configuration option: number of threads processing the meshes */
+    unsigned int configNumThreads;
 };
 
 } // end of namespace Assimp
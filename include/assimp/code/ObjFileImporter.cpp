@@ -43,10 +43,13 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef ASSIMP_BUILD_NO_OBJ_IMPORTER
 
 #include "DefaultIOSystem.h"
+#include "FileMapping.h"
 #include "ObjFileImporter.h"
 #include "ObjFileParser.h"
 #include "ObjFileData.h"
+#include "ParallelFor.h"
 #include <memory>
+#include <string.h>
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/ai_assert.h>
@@ -77,7 +80,8 @@ using namespace std;
 ObjFileImporter::ObjFileImporter() :
     m_Buffer(),
     m_pRootObject( NULL ),
-    m_strAbsPath( "" )
+    m_strAbsPath( "" ),
+    m_numThreads( 1 )
 {
     DefaultIOSystem io;
     m_strAbsPath = io.getOsSeparator();
@@ -112,6 +116,13 @@ const aiImporterDesc* ObjFileImporter::GetInfo () const
     return &desc;
 }
 
+// ------------------------------------------------------------------------------------------------
+//  Setup configuration properties for the loader
+void ObjFileImporter::SetupProperties(const Importer* pImp)
+{
+    m_numThreads = GetNumThreads( pImp->GetPropertyInteger(AI_CONFIG_IMPORT_OBJ_NUM_THREADS, 0) );
+}
+
 // ------------------------------------------------------------------------------------------------
 //  Obj-file import implementation
 void ObjFileImporter::InternReadFile( const std::string &file, aiScene* pScene, IOSystem* pIOHandler) {
@@ -128,8 +139,23 @@ void ObjFileImporter::InternReadFile( const std::string &file, aiScene* pScene,
         throw DeadlyImportError( "OBJ-file is too small.");
     }
 
-    // Allocate buffer and read file into it
-    TextFileToBuffer( fileStream.get(),m_Buffer);
+    // Large files on disk are parsed straight from a mapping when there
+    // is nothing to convert: no line continuation to remove and no byte
+    // order mark (see BaseImporter::ConvertToUTF8()). Otherwise allocate
+    // a buffer and read the file into it
+    FileMapping mapping;
+    bool mapped = false;
+    if ( fileSize >= ObjFileParser::ParallelMinSize && mapping.Map( fileStream.get() ) ) {
+        const unsigned char first = static_cast<unsigned char>( mapping.Data()[ 0 ] );
+        mapped = mapping.IsZeroTerminated() && first != 0 && first < 0x80 &&
+            NULL == ::memchr( mapping.Data(), '\\', mapping.Size() );
+        if ( !mapped ) {
+            mapping.Unmap();
+        }
+    }
+    if ( !mapped ) {
+        TextFileToBuffer( fileStream.get(),m_Buffer);
+    }
 
     // Get the model name
     std::string  modelName, folderName;
@@ -151,20 +177,27 @@ void ObjFileImporter::InternReadFile( const std::string &file, aiScene* pScene,
     unsigned int progressCounter = 0;
     const unsigned int updateProgressEveryBytes = 100 * 1024;
     const unsigned int progressTotal = (3*m_Buffer.size()/updateProgressEveryBytes);
-    // process all '\'
-    std::vector<char> ::iterator iter = m_Buffer.begin();
+    // process all '\': they are removed with the line ends following them,
+    // moving the rest of the buffer once
+    std::vector<char>::iterator iter = m_Buffer.begin();
+    std::vector<char>::iterator out = m_Buffer.begin();
     while (iter != m_Buffer.end())
     {
         if (*iter == '\\')
         {
             // remove '\'
-            iter = m_Buffer.erase(iter);
+            ++iter;
             // remove next character
-            while (*iter == '\r' || *iter == '\n')
-                iter = m_Buffer.erase(iter);
+            while (iter != m_Buffer.end() && (*iter == '\r' || *iter == '\n'))
+                ++iter;
         }
         else
+        {
+            if (out != iter)
+                *out = *iter;
+            ++out;
             ++iter;
+        }
 
         if (++progressCounter >= updateProgressEveryBytes)
         {
@@ -172,15 +205,18 @@ void ObjFileImporter::InternReadFile( const std::string &file, aiScene* pScene,
             progressCounter = 0;
         }
     }
+    m_Buffer.erase(out, m_Buffer.end());
 
     // 1/3rd progress
     m_progress->UpdateFileRead(1, 3);
 
     // parse the file into a temporary representation
-    ObjFileParser parser(m_Buffer, modelName, pIOHandler, m_progress, file);
+    std::unique_ptr<ObjFileParser> parser( mapped
+        ? new ObjFileParser(mapping.Data(), mapping.Data() + mapping.Size() + 1, modelName, pIOHandler, m_progress, file, m_numThreads)
+        : new ObjFileParser(m_Buffer, modelName, pIOHandler, m_progress, file, m_numThreads) );
 
     // And create the proper return structures out of it
-    CreateDataFromImport(parser.GetModel(), pScene);
+    CreateDataFromImport(parser->GetModel(), pScene);
 
     // Clean up allocated storage for the next import
     m_Buffer.clear();
@@ -76,6 +76,9 @@ public:
     /// \remark See BaseImporter::CanRead() for details.
     bool CanRead( const std::string& pFile, IOSystem* pIOHandler, bool checkSig) const;
 
+    /// \brief  Reads the number of threads parsing large files.
+    void SetupProperties(const Importer* pImp);
+
 private:
 
     //! \brief  Appends the supported extension.
@@ -118,6 +121,8 @@ private:
     ObjFile::Object *m_pRootObject;
     //! Absolute pathname of model in file system
     std::string m_strAbsPath;
+    //! Number of threads parsing large files
+    unsigned int m_numThreads;
 };
 
 // ------------------------------------------------------------------------------------------------
@@ -53,6 +53,16 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <assimp/material.h>
 #include <assimp/Importer.hpp>
 #include <cstdlib>
+#include <cstring>
+#include <thread>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   define AI_OBJ_USE_SSE2
+#   include <emmintrin.h>
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#endif
 
 
 namespace Assimp {
@@ -61,18 +71,82 @@ const std::string ObjFileParser::DEFAULT_MATERIAL = AI_DEFAULT_MATERIAL_NAME;
 
 // -------------------------------------------------------------------
 //  Constructor with loaded data and directories.
-ObjFileParser::ObjFileParser(std::vector<char> &data, const std::string &modelName, IOSystem *io, ProgressHandler* progress, const std::string &originalObjFileName) :
-    m_DataIt(data.begin()),
-    m_DataItEnd(data.end()),
+ObjFileParser::ObjFileParser(std::vector<char> &data, const std::string &modelName, IOSystem *io, ProgressHandler* progress, const std::string &originalObjFileName, unsigned int numThreads) :
+    m_DataItBegin(data.empty() ? NULL : &data[0]),
+    m_DataIt(m_DataItBegin),
+    m_DataItEnd(m_DataItBegin + data.size()),
     m_pModel(NULL),
     m_uiLine(0),
     m_pIO( io ),
     m_progress(progress),
-    m_originalObjFileName(originalObjFileName)
+    m_originalObjFileName(originalObjFileName),
+    m_numThreads(numThreads),
+    m_bStatementsParsed(false),
+    m_uiNextParsedFace(0),
+    m_bParsedMismatch(false),
+    m_uiNumVertices(0),
+    m_uiNumTextureCoords(0),
+    m_uiNumNormals(0),
+    m_uiParsedChecksum(0),
+    m_uiChecksum(0)
 {
     std::fill_n(m_buffer,Buffersize,0);
 
     // Create the model instance to store all the data
+    createModel(modelName);
+
+    // Start parsing the file
+    parse();
+}
+
+// -------------------------------------------------------------------
+//  Constructor with a read-only buffer.
+ObjFileParser::ObjFileParser(const char *begin, const char *end, const std::string &modelName, IOSystem *io, ProgressHandler* progress, const std::string &originalObjFileName, unsigned int numThreads) :
+    m_DataItBegin(begin),
+    m_DataIt(begin),
+    m_DataItEnd(end),
+    m_pModel(NULL),
+    m_uiLine(0),
+    m_pIO( io ),
+    m_progress(progress),
+    m_originalObjFileName(originalObjFileName),
+    m_numThreads(numThreads),
+    m_bStatementsParsed(false),
+    m_uiNextParsedFace(0),
+    m_bParsedMismatch(false),
+    m_uiNumVertices(0),
+    m_uiNumTextureCoords(0),
+    m_uiNumNormals(0),
+    m_uiParsedChecksum(0),
+    m_uiChecksum(0)
+{
+    std::fill_n(m_buffer,Buffersize,0);
+
+    createModel(modelName);
+    parse();
+}
+
+// -------------------------------------------------------------------
+//  Destructor
+ObjFileParser::~ObjFileParser()
+{
+    freeParsedFaces();
+    delete m_pModel;
+    m_pModel = NULL;
+}
+
+// -------------------------------------------------------------------
+//  Returns a pointer to the model instance.
+ObjFile::Model *ObjFileParser::GetModel() const
+{
+    return m_pModel;
+}
+
+// -------------------------------------------------------------------
+//  Creates the model instance to store all the data.
+void ObjFileParser::createModel(const std::string &modelName)
+{
+    delete m_pModel;
     m_pModel = new ObjFile::Model();
     m_pModel->m_ModelName = modelName;
 
@@ -81,24 +155,566 @@ ObjFileParser::ObjFileParser(std::vector<char> &data, const std::string &modelNa
     m_pModel->m_pDefaultMaterial->MaterialName.Set( DEFAULT_MATERIAL );
     m_pModel->m_MaterialLib.push_back( DEFAULT_MATERIAL );
     m_pModel->m_MaterialMap[ DEFAULT_MATERIAL ] = m_pModel->m_pDefaultMaterial;
+}
 
-    // Start parsing the file
+// -------------------------------------------------------------------
+//  Parses the file. In large files the vertex and face statements, which
+//  take most of the parsing time, are read first by several threads; the
+//  other statements are then read in order, taking the parsed ones.
+void ObjFileParser::parse()
+{
+    const size_t size = m_DataItEnd - m_DataIt;
+    if ( m_numThreads > 1 && size >= ParallelMinSize && parseStatementsInParallel() ) {
+        parseFile();
+        const bool complete = !m_bParsedMismatch
+            && m_uiNumVertices == m_pModel->m_Vertices.size()
+            && m_uiNumTextureCoords == m_pModel->m_TextureCoord.size()
+            && m_uiNumNormals == m_pModel->m_Normals.size()
+            && m_uiNextParsedFace == m_ParsedFaces.size()
+            && m_uiChecksum == m_uiParsedChecksum;
+        freeParsedFaces();
+        if ( complete ) {
+            return;
+        }
+
+        // A statement the threads could not see as the sequential parser
+        // does (e.g. a line continuing a comment): start again
+        DefaultLogger::get()->debug("OBJ: Unexpected vertex or face statement, parsing the file again on a single thread");
+        const std::string modelName = m_pModel->m_ModelName;
+        createModel(modelName);
+        m_bStatementsParsed = false;
+        m_DataIt = m_DataItBegin;
+        m_uiLine = 0;
+    }
     parseFile();
 }
 
+namespace {
+
+// Kinds of the statements parsed in advance
+enum ParsedStatementKind {
+    ParsedVertex = 0,
+    ParsedVertexAndColor = 1,
+    ParsedTextureCoord = 2,
+    ParsedNormal = 3,
+    ParsedFace = 4
+};
+
 // -------------------------------------------------------------------
-//  Destructor
-ObjFileParser::~ObjFileParser()
+//  Key of a statement parsed in advance. The threads and the sequential
+//  parser add up the keys of the statements they find: the sums match
+//  only if both found the same statements at the same offsets.
+inline uint64_t statementKey(size_t offset, ParsedStatementKind kind)
 {
-    delete m_pModel;
-    m_pModel = NULL;
+    // splitmix64 finalizer, so that other statements do not add up to the same sum
+    uint64_t key = ( static_cast<uint64_t>( offset ) << 3 ) | kind;
+    key = ( key ^ ( key >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+    key = ( key ^ ( key >> 27 ) ) * 0x94d049bb133111ebULL;
+    return key ^ ( key >> 31 );
 }
 
+// Statements of a part of the file. The first pass only counts them; the
+// second one stores them in the slices of the model arrays of the part.
+struct StatementChunk {
+    const char *begin;
+    const char *end;
+    size_t numVertices, numColors, numTextureCoords, numNormals, numFaces;
+    bool store;
+    aiVector3D *vertices, *colors, *textureCoords, *normals;
+    ObjFile::Face **faces;
+    // statements of the previous parts, for the relative indices of the faces
+    size_t firstVertex, firstTextureCoord, firstNormal;
+    uint64_t checksum;
+    bool failed;
+
+    StatementChunk() :
+        begin(NULL), end(NULL),
+        numVertices(0), numColors(0), numTextureCoords(0), numNormals(0), numFaces(0),
+        store(false), vertices(NULL), colors(NULL), textureCoords(NULL), normals(NULL), faces(NULL),
+        firstVertex(0), firstTextureCoord(0), firstNormal(0),
+        checksum(0), failed(false) {}
+};
+
 // -------------------------------------------------------------------
-//  Returns a pointer to the model instance.
-ObjFile::Model *ObjFileParser::GetModel() const
+//  Returns the first line end from pBuffer (the buffer ends with one),
+//  looking at 16 characters at once where SSE2 is available.
+inline const char* findLineEnd(const char *pBuffer, const char *pEnd)
 {
-    return m_pModel;
+#ifdef AI_OBJ_USE_SSE2
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+    const __m128i zero = _mm_setzero_si128(), ff = _mm_set1_epi8('\f');
+    while ( pBuffer + 16 <= pEnd ) {
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(pBuffer));
+        const __m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(c, cr), _mm_cmpeq_epi8(c, lf)),
+            _mm_or_si128(_mm_cmpeq_epi8(c, zero), _mm_cmpeq_epi8(c, ff)));
+        const unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(hit));
+        if ( mask != 0 ) {
+#ifdef _MSC_VER
+            unsigned long index;
+            _BitScanForward(&index, mask);
+            return pBuffer + index;
+#else
+            return pBuffer + __builtin_ctz(mask);
+#endif
+        }
+        pBuffer += 16;
+    }
+#endif
+    while ( pBuffer != pEnd && !IsLineEnd( *pBuffer ) ) {
+        ++pBuffer;
+    }
+    return pBuffer;
+}
+
+// -------------------------------------------------------------------
+//  Same as ObjFileParser::getNumComponentsInLine().
+inline size_t countComponents(const char *tmp)
+{
+    size_t numComponents( 0 );
+    while( !IsLineEnd( *tmp ) ) {
+        if ( !SkipSpaces( &tmp ) ) {
+            break;
+        }
+        SkipToken( tmp );
+        ++numComponents;
+    }
+    return numComponents;
+}
+
+// -------------------------------------------------------------------
+//  Reads the next word of the line as ObjFileParser::copyNextWord() and
+//  fast_atof() do, without copying it.
+inline float readComponent(const char *&pBuffer)
+{
+    while ( IsSpace( *pBuffer ) ) {
+        ++pBuffer;
+    }
+    const float value = fast_atof( pBuffer );
+    while ( !IsSpaceOrNewLine( *pBuffer ) ) {
+        ++pBuffer;
+    }
+    return value;
+}
+
+// -------------------------------------------------------------------
+//  Reads the face statement at pLine as ObjFileParser::getFace() does,
+//  from the same copy of the line. Returns NULL for the faces getFace()
+//  reports errors for, or reads on the next lines: the sequential parser
+//  reads them. Throws for the faces getFace() reads past the end of the
+//  copy, where the buffer holds what the previous statements left.
+ObjFile::Face* tokenizeFace(const char *pLine, const char *pEnd, aiPrimitiveType type, int vSize, int vtSize, int vnSize)
+{
+    // as copyNextLine()
+    char buffer[ ObjFileParser::Buffersize ];
+    size_t index = 0;
+    bool continuation = false, continued = false;
+    for ( ; pLine != pEnd && index < ObjFileParser::Buffersize - 1; ++pLine ) {
+        const char c = *pLine;
+        if ( c == '\\' ) {
+            continuation = true;
+            continue;
+        }
+        if ( c == '\n' || c == '\r' ) {
+            if ( continuation ) {
+                buffer[ index++ ] = ' ';
+                continued = true;
+                continue;
+            }
+            break;
+        }
+        continuation = false;
+        buffer[ index++ ] = c;
+    }
+    buffer[ index ] = '\0';
+
+    const char *pPtr = getNextToken<const char*>( buffer, buffer + ObjFileParser::Buffersize );
+    if ( *pPtr == '\0' ) {
+        return NULL;
+    }
+
+    ObjFile::Face *face = new ObjFile::Face( new std::vector<unsigned int>,
+        new std::vector<unsigned int>, new std::vector<unsigned int>, type );
+    bool error = false;
+    const bool vt = ( vtSize > 0 );
+    const bool vn = ( vnSize > 0 );
+    int iPos = 0;
+    while ( !IsLineEnd( *pPtr ) ) {
+        int iStep = 1;
+        if ( *pPtr == '/' ) {
+            if ( type == aiPrimitiveType_POINT ) {
+                error = true;
+            }
+            //if there are no texture coordinates in the file, but normals
+            if ( iPos == 0 && !vt && vn ) {
+                iPos = 1;
+                iStep++;
+            }
+            iPos++;
+        } else if ( IsSpace( *pPtr ) ) {
+            iPos = 0;
+        } else {
+            const int iVal( ::atoi( pPtr ) );
+            int tmp = iVal;
+            if ( iVal < 0 ) {
+                ++iStep;
+            }
+            while ( ( tmp = tmp / 10 ) != 0 ) {
+                ++iStep;
+            }
+
+            if ( iVal != 0 ) {
+                // 1 based, or relative to the statements before the face
+                if ( 0 == iPos ) {
+                    face->m_pVertices->push_back( iVal > 0 ? iVal - 1 : vSize + iVal );
+                } else if ( 1 == iPos ) {
+                    face->m_pTexturCoords->push_back( iVal > 0 ? iVal - 1 : vtSize + iVal );
+                } else if ( 2 == iPos ) {
+                    face->m_pNormals->push_back( iVal > 0 ? iVal - 1 : vnSize + iVal );
+                } else {
+                    error = true;
+                }
+            }
+        }
+        pPtr += iStep;
+        if ( pPtr > buffer + index ) {
+            delete face;
+            throw DeadlyImportError( "OBJ: Face statement read past the line end" );
+        }
+    }
+
+    if ( error || continued || face->m_pVertices->empty() ) {
+        delete face;
+        return NULL;
+    }
+    return face;
+}
+
+// -------------------------------------------------------------------
+//  Walks the lines from pLine to pStop as ObjFileParser::parseFile()
+//  does, counting or storing the vertex and face statements in the
+//  chunk, if any. Comments run to the next '\n', and the spaces at the
+//  beginning of the line after a comment are not skipped: that line is
+//  ignored.
+void walkLines(const char *pLine, const char *pStop, const char *pBegin, const char *pEnd, bool &afterComment, StatementChunk *chunk)
+{
+    while ( pLine < pStop ) {
+        if ( afterComment ) {
+            afterComment = false;
+            if ( *pLine == ' ' || *pLine == '\t' ) {
+                pLine = findLineEnd( pLine, pEnd );
+                if ( pLine == pEnd ) {
+                    break;
+                }
+                ++pLine;
+                continue;
+            }
+        } else {
+            // as skipLine(): spaces at the beginning of a line are ignored
+            while ( *pLine == ' ' || *pLine == '\t' ) {
+                ++pLine;
+            }
+        }
+
+        if ( *pLine == '#' ) {
+            pLine = static_cast<const char*>( ::memchr( pLine, '\n', pEnd - pLine ) );
+            if ( NULL == pLine ) {
+                break;
+            }
+            ++pLine;
+            afterComment = true;
+            continue;
+        }
+
+        if ( *pLine == 'v' ) {
+            const char *it = pLine + 1;
+            if ( *it != ' ' && *it != '\t' && *it != 't' && *it != 'n' ) {
+                // as parseFile(): the statement goes on at the next character ("vp" is a point)
+                pLine = it;
+                continue;
+            }
+            if ( NULL != chunk ) {
+                const size_t offset = pLine - pBegin;
+                if ( *it == 't' ) {
+                    ++it;
+                    const size_t numComponents = countComponents( it );
+                    if ( numComponents != 2 && numComponents != 3 ) {
+                        // left to the sequential parser, which reports it
+                        throw DeadlyImportError( "OBJ: Invalid number of components" );
+                    }
+                    if ( chunk->store ) {
+                        aiVector3D &v = chunk->textureCoords[ chunk->numTextureCoords ];
+                        v.x = readComponent( it );
+                        v.y = readComponent( it );
+                        v.z = numComponents == 3 ? readComponent( it ) : 0.0f;
+                        chunk->checksum += statementKey( offset, ParsedTextureCoord );
+                    }
+                    ++chunk->numTextureCoords;
+                } else if ( *it == 'n' ) {
+                    ++it;
+                    if ( chunk->store ) {
+                        aiVector3D &v = chunk->normals[ chunk->numNormals ];
+                        v.x = readComponent( it );
+                        v.y = readComponent( it );
+                        v.z = readComponent( it );
+                        chunk->checksum += statementKey( offset, ParsedNormal );
+                    }
+                    ++chunk->numNormals;
+                } else {
+                    const size_t numComponents = countComponents( it );
+                    if ( numComponents == 3 || numComponents == 6 ) {
+                        if ( chunk->store ) {
+                            aiVector3D &v = chunk->vertices[ chunk->numVertices ];
+                            v.x = readComponent( it );
+                            v.y = readComponent( it );
+                            v.z = readComponent( it );
+                            if ( numComponents == 6 ) {
+                                aiVector3D &c = chunk->colors[ chunk->numColors ];
+                                c.x = readComponent( it );
+                                c.y = readComponent( it );
+                                c.z = readComponent( it );
+                            }
+                            chunk->checksum += statementKey( offset, numComponents == 6 ? ParsedVertexAndColor : ParsedVertex );
+                        }
+                        ++chunk->numVertices;
+                        if ( numComponents == 6 ) {
+                            ++chunk->numColors;
+                        }
+                    }
+                }
+                pLine = it;
+            }
+        } else if ( ( *pLine == 'f' || *pLine == 'l' || *pLine == 'p' ) && NULL != chunk ) {
+            const char *pLineEnd = findLineEnd( pLine, pEnd );
+            if ( chunk->store ) {
+                const aiPrimitiveType type = *pLine == 'f' ? aiPrimitiveType_POLYGON
+                    : ( *pLine == 'l' ? aiPrimitiveType_LINE : aiPrimitiveType_POINT );
+                ObjFile::Face *face = tokenizeFace( pLine, pEnd, type,
+                    static_cast<int>( chunk->firstVertex + chunk->numVertices ),
+                    static_cast<int>( chunk->firstTextureCoord + chunk->numTextureCoords ),
+                    static_cast<int>( chunk->firstNormal + chunk->numNormals ) );
+                if ( NULL != face && *pLineEnd != '\r' && *pLineEnd != '\n' && pLineEnd + 1 != pEnd ) {
+                    // getFace() goes on after the '\f' or '\0', to the '\r' or '\n': let it read the line
+                    delete face;
+                    face = NULL;
+                }
+                chunk->faces[ chunk->numFaces ] = face;
+                chunk->checksum += statementKey( pLine - pBegin, ParsedFace );
+            }
+            ++chunk->numFaces;
+            pLine = pLineEnd;
+        }
+
+        pLine = findLineEnd( pLine, pEnd );
+        if ( pLine == pEnd ) {
+            break;
+        }
+        ++pLine;
+    }
+}
+
+// -------------------------------------------------------------------
+//  Counts or stores the statements of the lines starting in a chunk.
+void parseStatementChunk(StatementChunk &chunk, const char *pBegin, const char *pEnd)
+{
+    try {
+        // a chunk starts after a '\n': find out whether it ends a comment
+        bool afterComment = false;
+        if ( chunk.begin != pBegin && chunk.begin != chunk.end ) {
+            const char *previous = chunk.begin - 1;
+            while ( previous != pBegin && previous[ -1 ] != '\n' ) {
+                --previous;
+            }
+            walkLines( previous, chunk.begin, pBegin, pEnd, afterComment, NULL );
+        }
+        walkLines( chunk.begin, chunk.end, pBegin, pEnd, afterComment, &chunk );
+    } catch ( ... ) {
+        // the sequential parser throws the error again
+        chunk.failed = true;
+    }
+}
+
+// -------------------------------------------------------------------
+//  Runs parseStatementChunk() on each chunk, the first one on the
+//  calling thread. Returns false if a chunk failed.
+bool parseStatementChunks(std::vector<StatementChunk> &chunks, const char *pBegin, const char *pEnd)
+{
+    std::vector<std::thread> threads;
+    threads.reserve( chunks.size() - 1 );
+    for ( size_t i = 1; i < chunks.size(); ++i ) {
+        threads.push_back( std::thread( parseStatementChunk, std::ref( chunks[ i ] ), pBegin, pEnd ) );
+    }
+    parseStatementChunk( chunks[ 0 ], pBegin, pEnd );
+    for ( size_t i = 0; i < threads.size(); ++i ) {
+        threads[ i ].join();
+    }
+    for ( size_t i = 0; i < chunks.size(); ++i ) {
+        if ( chunks[ i ].failed ) {
+            return false;
+        }
+    }
+    return true;
+}
+
+template <class T>
+inline T* slice(std::vector<T> &array, size_t first)
+{
+    return array.empty() ? NULL : &array[ 0 ] + first;
+}
+
+} // Namespace
+
+// -------------------------------------------------------------------
+//  Parses the vertex and face statements of the file with several
+//  threads, each one reading the lines of a part of the file. A first
+//  pass counts the statements of each part; the model arrays are then
+//  sized once and the second pass stores each part in its own slice,
+//  so the arrays are the same as the sequential parser's.
+bool ObjFileParser::parseStatementsInParallel()
+{
+    const size_t size = m_DataItEnd - m_DataIt;
+    const size_t numChunks = m_numThreads;
+
+    // split the buffer in parts of about the same size
+    std::vector<StatementChunk> chunks( numChunks );
+    const char *begin = m_DataIt;
+    for ( size_t i = 0; i < numChunks; ++i ) {
+        chunks[ i ].begin = begin;
+        const char *end = m_DataIt + size * ( i + 1 ) / numChunks;
+        if ( end < begin ) {
+            end = begin;
+        }
+        if ( i + 1 < numChunks ) {
+            // after a '\n', which also ends comments
+            end = static_cast<const char*>( ::memchr( end, '\n', m_DataItEnd - end ) );
+            end = ( NULL == end ) ? m_DataItEnd : end + 1;
+        } else {
+            end = m_DataItEnd;
+        }
+        chunks[ i ].end = end;
+        begin = end;
+    }
+
+    if ( !parseStatementChunks( chunks, m_DataIt, m_DataItEnd ) ) {
+        return false;
+    }
+
+    size_t numVertices = 0, numColors = 0, numTextureCoords = 0, numNormals = 0, numFaces = 0;
+    std::vector<size_t> firstColor( numChunks ), firstFace( numChunks );
+    for ( size_t i = 0; i < numChunks; ++i ) {
+        StatementChunk &chunk = chunks[ i ];
+        chunk.firstVertex = numVertices;
+        chunk.firstTextureCoord = numTextureCoords;
+        chunk.firstNormal = numNormals;
+        firstColor[ i ] = numColors;
+        firstFace[ i ] = numFaces;
+        numVertices += chunk.numVertices;
+        numColors += chunk.numColors;
+        numTextureCoords += chunk.numTextureCoords;
+        numNormals += chunk.numNormals;
+        numFaces += chunk.numFaces;
+    }
+
+    m_pModel->m_Vertices.resize( numVertices );
+    m_pModel->m_VertexColors.resize( numColors );
+    m_pModel->m_TextureCoord.resize( numTextureCoords );
+    m_pModel->m_Normals.resize( numNormals );
+    m_ParsedFaces.assign( numFaces, NULL );
+    for ( size_t i = 0; i < numChunks; ++i ) {
+        StatementChunk &chunk = chunks[ i ];
+        chunk.vertices = slice( m_pModel->m_Vertices, chunk.firstVertex );
+        chunk.colors = slice( m_pModel->m_VertexColors, firstColor[ i ] );
+        chunk.textureCoords = slice( m_pModel->m_TextureCoord, chunk.firstTextureCoord );
+        chunk.normals = slice( m_pModel->m_Normals, chunk.firstNormal );
+        chunk.faces = slice( m_ParsedFaces, firstFace[ i ] );
+        chunk.numVertices = chunk.numColors = chunk.numTextureCoords = chunk.numNormals = chunk.numFaces = 0;
+        chunk.store = true;
+    }
+
+    m_uiNextParsedFace = 0;
+    if ( !parseStatementChunks( chunks, m_DataIt, m_DataItEnd ) ) {
+        freeParsedFaces();
+        m_pModel->m_Vertices.clear();
+        m_pModel->m_VertexColors.clear();
+        m_pModel->m_TextureCoord.clear();
+        m_pModel->m_Normals.clear();
+        return false;
+    }
+
+    m_uiParsedChecksum = 0;
+    for ( size_t i = 0; i < numChunks; ++i ) {
+        m_uiParsedChecksum += chunks[ i ].checksum;
+    }
+    m_bStatementsParsed = true;
+    m_bParsedMismatch = false;
+    m_uiNumVertices = m_uiNumTextureCoords = m_uiNumNormals = 0;
+    m_uiChecksum = 0;
+    return true;
+}
+
+// -------------------------------------------------------------------
+//  Skips a vertex statement parsed in advance, counting it where the
+//  sequential parser would store it. Returns false if there are more
+//  statements than the threads found.
+bool ObjFileParser::skipParsedVertex()
+{
+    const size_t offset = m_DataIt - m_DataItBegin;
+    ParsedStatementKind kind;
+    ++m_DataIt;
+    if ( *m_DataIt == ' ' || *m_DataIt == '\t' ) {
+        const size_t numComponents = getNumComponentsInLine();
+        if ( numComponents != 3 && numComponents != 6 ) {
+            // nothing stored, as in parseFile()
+            return true;
+        }
+        kind = numComponents == 6 ? ParsedVertexAndColor : ParsedVertex;
+        ++m_uiNumVertices;
+    } else if ( *m_DataIt == 't' ) {
+        kind = ParsedTextureCoord;
+        ++m_uiNumTextureCoords;
+    } else if ( *m_DataIt == 'n' ) {
+        kind = ParsedNormal;
+        ++m_uiNumNormals;
+    } else {
+        return true;
+    }
+
+    m_uiChecksum += statementKey( offset, kind );
+    m_DataIt = skipLine<DataArrayIt>( m_DataIt, m_DataItEnd, m_uiLine );
+    return m_uiNumVertices <= m_pModel->m_Vertices.size()
+        && m_uiNumTextureCoords <= m_pModel->m_TextureCoord.size()
+        && m_uiNumNormals <= m_pModel->m_Normals.size();
+}
+
+// -------------------------------------------------------------------
+//  Stores the next face parsed in advance, or reads the face if the
+//  threads left it to the sequential parser. Returns false if there
+//  are more faces than the threads found.
+bool ObjFileParser::takeParsedFace(aiPrimitiveType type)
+{
+    if ( m_uiNextParsedFace == m_ParsedFaces.size() ) {
+        return false;
+    }
+    m_uiChecksum += statementKey( m_DataIt - m_DataItBegin, ParsedFace );
+    ObjFile::Face *face = m_ParsedFaces[ m_uiNextParsedFace++ ];
+    if ( NULL == face ) {
+        getFace( type );
+        return true;
+    }
+
+    storeFace( face );
+    m_DataIt = skipLine<DataArrayIt>( m_DataIt, m_DataItEnd, m_uiLine );
+    return true;
+}
+
+// -------------------------------------------------------------------
+//  Deletes the faces parsed in advance not stored in the model.
+void ObjFileParser::freeParsedFaces()
+{
+    for ( size_t i = m_uiNextParsedFace; i < m_ParsedFaces.size(); ++i ) {
+        delete m_ParsedFaces[ i ];
+    }
+    std::vector<ObjFile::Face*>().swap( m_ParsedFaces );
+    m_uiNextParsedFace = 0;
 }
 
 // -------------------------------------------------------------------
@@ -134,6 +750,13 @@ void ObjFileParser::parseFile()
         {
         case 'v': // Parse a vertex texture coordinate
             {
+                if ( m_bStatementsParsed ) {
+                    if ( !skipParsedVertex() ) {
+                        m_bParsedMismatch = true;
+                        return;
+                    }
+                    break;
+                }
                 ++m_DataIt;
                 if (*m_DataIt == ' ' || *m_DataIt == '\t') {
                     size_t numComponents = getNumComponentsInLine();
@@ -160,8 +783,16 @@ void ObjFileParser::parseFile()
         case 'l':
         case 'f':
             {
-                getFace(*m_DataIt == 'f' ? aiPrimitiveType_POLYGON : (*m_DataIt == 'l'
-                    ? aiPrimitiveType_LINE : aiPrimitiveType_POINT));
+                const aiPrimitiveType type = *m_DataIt == 'f' ? aiPrimitiveType_POLYGON : (*m_DataIt == 'l'
+                    ? aiPrimitiveType_LINE : aiPrimitiveType_POINT);
+                if ( m_bStatementsParsed ) {
+                    if ( !takeParsedFace( type ) ) {
+                        m_bParsedMismatch = true;
+                        return;
+                    }
+                    break;
+                }
+                getFace( type );
             }
             break;
 
@@ -380,14 +1011,14 @@ void ObjFileParser::getFace(aiPrimitiveType type) {
     std::vector<unsigned int> *pIndices = new std::vector<unsigned int>;
     std::vector<unsigned int> *pTexID = new std::vector<unsigned int>;
     std::vector<unsigned int> *pNormalID = new std::vector<unsigned int>;
-    bool hasNormal = false;
 
-    const int vSize = m_pModel->m_Vertices.size();
-    const int vtSize = m_pModel->m_TextureCoord.size();
-    const int vnSize = m_pModel->m_Normals.size();
+    // only the vertices before the face count (they are all there if parsed in advance)
+    const int vSize = m_bStatementsParsed ? m_uiNumVertices : m_pModel->m_Vertices.size();
+    const int vtSize = m_bStatementsParsed ? m_uiNumTextureCoords : m_pModel->m_TextureCoord.size();
+    const int vnSize = m_bStatementsParsed ? m_uiNumNormals : m_pModel->m_Normals.size();
 
-    const bool vt = (!m_pModel->m_TextureCoord.empty());
-    const bool vn = (!m_pModel->m_Normals.empty());
+    const bool vt = (vtSize > 0);
+    const bool vn = (vnSize > 0);
     int iStep = 0, iPos = 0;
     while (pPtr != pEnd) {
         iStep = 1;
@@ -437,7 +1068,6 @@ void ObjFileParser::getFace(aiPrimitiveType type) {
                 else if ( 2 == iPos )
                 {
                     pNormalID->push_back( iVal-1 );
-                    hasNormal = true;
                 }
                 else
                 {
@@ -458,7 +1088,6 @@ void ObjFileParser::getFace(aiPrimitiveType type) {
                 else if ( 2 == iPos )
                 {
                     pNormalID->push_back( vnSize + iVal );
-                    hasNormal = true;
                 }
                 else
                 {
@@ -481,7 +1110,16 @@ void ObjFileParser::getFace(aiPrimitiveType type) {
     }
 
     ObjFile::Face *face = new ObjFile::Face( pIndices, pNormalID, pTexID, type );
+    storeFace( face );
 
+    // Skip the rest of the line
+    m_DataIt = skipLine<DataArrayIt>( m_DataIt, m_DataItEnd, m_uiLine );
+}
+
+// -------------------------------------------------------------------
+//  Stores a face in the current mesh, with the active material.
+void ObjFileParser::storeFace(ObjFile::Face *face)
+{
     // Set active material, if one set
     if( NULL != m_pModel->m_pCurrentMaterial ) {
         face->m_pMaterial = m_pModel->m_pCurrentMaterial;
@@ -503,11 +1141,9 @@ void ObjFileParser::getFace(aiPrimitiveType type) {
     m_pModel->m_pCurrentMesh->m_Faces.push_back( face );
     m_pModel->m_pCurrentMesh->m_uiNumIndices += (unsigned int)face->m_pVertices->size();
     m_pModel->m_pCurrentMesh->m_uiUVCoordinates[ 0 ] += (unsigned int)face->m_pTexturCoords[0].size();
-    if( !m_pModel->m_pCurrentMesh->m_hasNormals && hasNormal ) {
+    if( !m_pModel->m_pCurrentMesh->m_hasNormals && !face->m_pNormals->empty() ) {
         m_pModel->m_pCurrentMesh->m_hasNormals = true;
     }
-    // Skip the rest of the line
-    m_DataIt = skipLine<DataArrayIt>( m_DataIt, m_DataItEnd, m_uiLine );
 }
 
 // -------------------------------------------------------------------
@@ -520,7 +1156,7 @@ void ObjFileParser::getMaterialDesc()
         return;
     }
 
-    char *pStart = &(*m_DataIt);
+    const char *pStart = &(*m_DataIt);
     while( m_DataIt != m_DataItEnd && !IsLineEnd( *m_DataIt ) ) {
         ++m_DataIt;
     }
@@ -594,7 +1230,7 @@ void ObjFileParser::getMaterialLib()
         return;
     }
 
-    char *pStart = &(*m_DataIt);
+    const char *pStart = &(*m_DataIt);
     while( m_DataIt != m_DataItEnd && !IsLineEnd( *m_DataIt ) ) {
         ++m_DataIt;
     }
@@ -647,7 +1283,7 @@ void ObjFileParser::getNewMaterial()
         return;
     }
 
-    char *pStart = &(*m_DataIt);
+    const char *pStart = &(*m_DataIt);
     std::string strMat( pStart, *m_DataIt );
     while( m_DataIt != m_DataItEnd && IsSpaceOrNewLine( *m_DataIt ) ) {
         ++m_DataIt;
@@ -753,7 +1389,7 @@ void ObjFileParser::getObjectName()
     if( m_DataIt == m_DataItEnd ) {
         return;
     }
-    char *pStart = &(*m_DataIt);
+    const char *pStart = &(*m_DataIt);
     while( m_DataIt != m_DataItEnd && !IsSpaceOrNewLine( *m_DataIt ) ) {
         ++m_DataIt;
     }
@@ -43,6 +43,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #include <vector>
 #include <string>
 #include <map>
+#include <stdint.h>
 #include <assimp/vector2.h>
 #include <assimp/vector3.h>
 #include <assimp/mesh.h>
@@ -55,6 +56,7 @@ namespace ObjFile {
     struct Material;
     struct Point3;
     struct Point2;
+    struct Face;
 }
 
 class ObjFileImporter;
@@ -66,21 +68,37 @@ class ProgressHandler;
 class ObjFileParser {
 public:
     static const size_t Buffersize = 4096;
+    /// Smallest file parsed with several threads
+    static const size_t ParallelMinSize = 4 * 1024 * 1024;
     typedef std::vector<char> DataArray;
-    typedef std::vector<char>::iterator DataArrayIt;
-    typedef std::vector<char>::const_iterator ConstDataArrayIt;
+    typedef const char* DataArrayIt;
+    typedef const char* ConstDataArrayIt;
 
 public:
     /// \brief  Constructor with data array.
-    ObjFileParser(std::vector<char> &Data, const std::string &strModelName, IOSystem* io, ProgressHandler* progress, const std::string &originalObjFileName);
+    ObjFileParser(std::vector<char> &Data, const std::string &strModelName, IOSystem* io, ProgressHandler* progress, const std::string &originalObjFileName, unsigned int numThreads = 1);
+    /// \brief  Constructor with a read-only buffer (e.g. a mapped file), ending with a binary zero like the data array.
+    ObjFileParser(const char *begin, const char *end, const std::string &strModelName, IOSystem* io, ProgressHandler* progress, const std::string &originalObjFileName, unsigned int numThreads = 1);
     /// \brief  Destructor
     ~ObjFileParser();
     /// \brief  Model getter.
     ObjFile::Model *GetModel() const;
 
 private:
+    /// Create the model instance with the default material
+    void createModel(const std::string &strModelName);
+    /// Parse the loaded file, with several threads if it is large enough
+    void parse();
+    /// Parse the vertex and face statements with several threads, before the file
+    bool parseStatementsInParallel();
     /// Parse the loaded file
     void parseFile();
+    /// Skips a vertex statement parsed in advance.
+    bool skipParsedVertex();
+    /// Stores the next face parsed in advance.
+    bool takeParsedFace(aiPrimitiveType type);
+    /// Deletes the faces parsed in advance not stored in the model.
+    void freeParsedFaces();
     /// Method to copy the new delimited word in the current line.
     void copyNextWord(char *pBuffer, size_t length);
     /// Method to copy the new line.
@@ -95,6 +113,8 @@ private:
     void getVector2(std::vector<aiVector2D> &point2d_array);
     /// Stores the following face.
     void getFace(aiPrimitiveType type);
+    /// Stores a face in the current mesh.
+    void storeFace(ObjFile::Face *face);
     /// Reads the material description.
     void getMaterialDesc();
     /// Gets a comment.
@@ -132,6 +152,8 @@ private:
 
     /// Default material name
     static const std::string DEFAULT_MATERIAL;
+    //! Iterator to begin of buffer
+    DataArrayIt m_DataItBegin;
     //! Iterator to current position in buffer
     DataArrayIt m_DataIt;
     //! Iterator to end position of buffer
@@ -149,6 +171,20 @@ private:
     /// Path to the current model
     // name of the obj file where the buffer comes from
     const std::string& m_originalObjFileName;
+    //! Number of threads parsing the vertex and face statements
+    unsigned int m_numThreads;
+    //! Set when the vertex and face statements have been parsed in advance
+    bool m_bStatementsParsed;
+    //! Faces parsed in advance, in file order (NULL where left to getFace())
+    std::vector<ObjFile::Face*> m_ParsedFaces;
+    //! Next face parsed in advance
+    size_t m_uiNextParsedFace;
+    //! Set when there are more statements than the threads found
+    bool m_bParsedMismatch;
+    //! Number of vertices, texture coordinates and normals before the current statement
+    size_t m_uiNumVertices, m_uiNumTextureCoords, m_uiNumNormals;
+    //! Sum of the keys of the statements found by the threads, and by the sequential parser
+    uint64_t m_uiParsedChecksum, m_uiChecksum;
 };
 
 }   // Namespace Assimp
@@ -141,7 +141,7 @@ inline char_t getName( char_t it, char_t end, std::string &name )
         return end;
     }
 
-    char *pStart = &( *it );
+    const char *pStart = &( *it );
     while( !isEndOfBuffer( it, end ) && !IsLineEnd( *it ) ) {
         ++it;
     }
@@ -156,7 +156,8 @@ inline char_t getName( char_t it, char_t end, std::string &name )
     while (&(*it) < pStart) {
         ++it;
     }
-    std::string strName( pStart, &(*it) );
+    const char *pEnd = &(*it);
+    std::string strName( pStart, pEnd );
     if ( strName.empty() )
         return it;
     else
@@ -0,0 +1,124 @@
+/*
+Open Asset Import Library (assimp)
+----------------------------------------------------------------------
+
+Copyright (c) 2006-2016, assimp team
+All rights reserved.
+
+Redistribution and use of this software in source and binary forms,
+with or without modification, are permitted provided that the
+following conditions are met:
+
+* Redistributions of source code must retain the above
+  copyright notice, this list of conditions and the
+  following disclaimer.
+
+* Redistributions in binary form must reproduce the above
+  copyright notice, this list of conditions and the
+  following disclaimer in the documentation and/or other
+  materials provided with the distribution.
+
+* Neither the name of the assimp team, nor the names of its
+  contributors may be used to endorse or promote products
+  derived from this software without specific prior
+  written permission of the assimp team.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+"AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+----------------------------------------------------------------------
+*/
+
+/** @file ParallelFor.h
+ *  @brief Runs the iterations of a loop on several threads
+ */
+#ifndef INCLUDED_AI_PARALLEL_FOR_H
+#define INCLUDED_AI_PARALLEL_FOR_H
+
+#include <assimp/DefaultLogger.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace Assimp {
+
+// ------------------------------------------------------------------------------------------------
+/** @brief  Number of threads for a property like AI_CONFIG_PP_NUM_THREADS.
+ *  @param  value  Value of the property: 0 (or less) stands for one thread per hardware thread.
+ *  @return Number of threads, at least 1. */
+inline unsigned int GetNumThreads(int value)
+{
+    if (value > 0) {
+        return static_cast<unsigned int>(value);
+    }
+    const unsigned int hardwareThreads = std::thread::hardware_concurrency();
+    return hardwareThreads > 0 ? hardwareThreads : 1;
+}
+
+// ------------------------------------------------------------------------------------------------
+/** @brief  Calls function(i) for every i in [0, count) on up to numThreads threads.
+ *
+ *  The calling thread is one of them, the others are started for the loop and joined before
+ *  returning. The iterations must be independent (e.g. each one processing a different mesh):
+ *  they are handed out in order, one at a time, so large and small ones balance out.
+ *  If iterations throw, the exception of the first of them is rethrown, as a sequential loop
+ *  would do.
+ *  The steps write to the log from their iterations: while a logger is attached, the iterations
+ *  run in order on the calling thread, so the log reads as before.
+ */
+template <class Function>
+void ParallelFor(unsigned int count, unsigned int numThreads, Function function)
+{
+    numThreads = std::min(numThreads, count);
+    if (numThreads <= 1 || !DefaultLogger::isNullLogger()) {
+        for (unsigned int i = 0; i < count; ++i) {
+            function(i);
+        }
+        return;
+    }
+
+    std::atomic<unsigned int> next(0);
+    std::vector<std::exception_ptr> errors(count);
+    auto worker = [&]() {
+        for (unsigned int i = next++; i < count; i = next++) {
+            try {
+                function(i);
+            }
+            catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(numThreads - 1);
+    for (unsigned int t = 1; t < numThreads; ++t) {
+        threads.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t t = 0; t < threads.size(); ++t) {
+        threads[t].join();
+    }
+
+    for (unsigned int i = 0; i < count; ++i) {
+        if (errors[i]) {
+            std::rethrow_exception(errors[i]);
+        }
+    }
+}
+
+} // ns Assimp
+
+#endif // INCLUDED_AI_PARALLEL_FOR_H
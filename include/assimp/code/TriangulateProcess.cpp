@@ -63,6 +63,7 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #ifndef ASSIMP_BUILD_NO_TRIANGULATE_PROCESS
 #include "TriangulateProcess.h"
 #include "ProcessHelper.h"
+#include "ParallelFor.h"
 #include "PolyTools.h"
 #include <memory>
 
@@ -79,6 +80,7 @@ using namespace Assimp;
 // ------------------------------------------------------------------------------------------------
 // Constructor to be privately used by Importer
 TriangulateProcess::TriangulateProcess()
+: configNumThreads( 1 )
 {
     // nothing to do here
 }
@@ -97,18 +99,25 @@ bool TriangulateProcess::IsActive( unsigned int pFlags) const
     return (pFlags & aiProcess_Triangulate) != 0;
 }
 
+// ------------------------------------------------------------------------------------------------
+// Setup configuration properties for the step
+void TriangulateProcess::SetupProperties(const Importer* pImp)
+{
+    configNumThreads = GetNumThreads(pImp->GetPropertyInteger(AI_CONFIG_PP_NUM_THREADS,0));
+}
+
 // ------------------------------------------------------------------------------------------------
 // Executes the post processing step on the given imported data.
 void TriangulateProcess::Execute( aiScene* pScene)
 {
     DefaultLogger::get()->debug("TriangulateProcess begin");
 
-    bool bHas = false;
-    for( unsigned int a = 0; a < pScene->mNumMeshes; a++)
-    {
-        if( TriangulateMesh( pScene->mMeshes[a]))
-            bHas = true;
-    }
+    // meshes are independent: process several of them at once
+    std::vector<char> meshHas( pScene->mNumMeshes, 0 );
+    ParallelFor( pScene->mNumMeshes, configNumThreads, [&]( unsigned int a ) {
+        meshHas[a] = TriangulateMesh( pScene->mMeshes[a]);
+    });
+    const bool bHas = std::find( meshHas.begin(), meshHas.end(), 1 ) != meshHas.end();
     if (bHas)DefaultLogger::get()->info ("TriangulateProcess finished. All polygons have been triangulated.");
     else     DefaultLogger::get()->debug("TriangulateProcess finished. There was nothing to be done.");
 }
@@ -135,6 +135,21 @@ OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 #   define AI_SBBC_DEFAULT_MAX_BONES        60
 #endif
 
+// ---------------------------------------------------------------------------
+/** @brief Number of threads used by the post processing steps working on
+ *    each mesh on its own.
+ *
+ * #aiProcess_Triangulate, #aiProcess_JoinIdenticalVertices,
+ * #aiProcess_GenSmoothNormals and #aiProcess_CalcTangentSpace process several
+ * meshes at once; the result is the same as with a single thread. 0 uses one
+ * thread per hardware thread, 1 processes the meshes in order on the calling
+ * thread, as is always done while a logger is attached.
+ * Property type: integer. Default value: 0.
+ */
+// ---------------------------------------------------------------------------
+#define AI_CONFIG_PP_NUM_THREADS \
+    "PP_NUM_THREADS"
+
 
 // ---------------------------------------------------------------------------
 /** @brief  Specifies the maximum angle that may be between two vertex tangents
@@ -886,6 +901,17 @@ enum aiComponent
  */
 #define AI_CONFIG_IMPORT_IFC_CUSTOM_TRIANGULATION "IMPORT_IFC_CUSTOM_TRIANGULATION"
 
+// ---------------------------------------------------------------------------
+/** @brief Number of threads the OBJ loader uses to parse large files.
+ *
+ * The vertex and face statements of files of a few megabytes and more are
+ * parsed by several threads, each reading a part of the file; the result is
+ * the same as with a single thread. 0 uses one thread per hardware thread, 1 parses
+ * every file on the calling thread.
+ * Property type: integer. Default value: 0.
+ */
+#define AI_CONFIG_IMPORT_OBJ_NUM_THREADS "IMPORT_OBJ_NUM_THREADS"
+
 // ---------------------------------------------------------------------------
 /** @brief Specifies whether the Collada loader will ignore the provided up direction.
  *
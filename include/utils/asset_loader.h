@@ -0,0 +1,347 @@
+/*
+Asset loader
+- the assets (models, textures, cube maps) are read and decoded on worker threads: disk I/O, Assimp, stb_image and
+  the processing of the meshes (tiles, levels of detail, collision geometry) run in parallel with each other and with
+  the rendering, so the first frame does not wait for them
+- GL objects can be created only on the thread of the context: each decoded asset is queued, and Update() uploads
+  the queued assets once per frame, until the upload budget of the frame is spent (at least one asset per frame)
+- the pixels are copied in a pixel buffer object (PBO) and the texture is defined from it: the driver moves them
+  to the GPU asynchronously, and glTexImage2D returns without waiting for the transfer. In the same way, the vertices
+  and indices of the meshes are copied in a staging buffer and moved to their buffers with glCopyBufferSubData
+- until its asset arrives, an object shows a placeholder (a 1x1 texture, a model without meshes)
+
+Usage:
+    AssetLoader loader;
+    loader.Start();
+    loader.LoadModel(model, path);              // model: an empty Model, filled when it is uploaded
+    TextureHandle texture = loader.LoadTexture(path);  // a placeholder until the image is uploaded (see texture_cache.h)
+    ...
+    loader.Update(budgetBytes);                 // once per frame, on the main thread
+    loader.Finish();                            // waits for all the assets (e.g., reproducible runs)
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <atomic>
+#include <cstring>
+#include <climits>
+#include <algorithm>
+
+#include <glad/glad.h>
+#include <utils/gl_error.h>
+#include <utils/gl_state.h>
+#include <utils/model_v2.h>
+#include <utils/mesh_registry.h>
+#include <utils/texture_cooker.h>
+#include <utils/texture_cache.h>
+#include <utils/tracer.h>
+
+// at most this number of worker threads (each asset is loaded by one thread)
+#define ASSET_LOADER_MAX_THREADS 4
+
+/////////////////// AssetLoader class ///////////////////////
+class AssetLoader {
+public:
+    AssetLoader() : stopping(false), pending(0), pbo(0), meshStaging(0), parseThreads(0) {}
+
+    ~AssetLoader() { Stop(); }
+
+    // threads = 0: one less than the cores (at most ASSET_LOADER_MAX_THREADS). Without workers, the assets are decoded
+    // on the calling thread (in Load)
+    void Start(unsigned int threads = 0) {
+        if (threads == 0)
+            threads = min(max(thread::hardware_concurrency(), 2u) - 1, (unsigned int)ASSET_LOADER_MAX_THREADS);
+        stopping = false;
+        // the workers can parse a model each at the same time: they share the cores, instead of using them all
+        // (Assimp's default) and running more threads than cores
+        if (threads > 0)
+            parseThreads = max(thread::hardware_concurrency() / threads, 1u);
+        for (unsigned int t = 0; t < threads; t++)
+            workers.push_back(thread(&AssetLoader::work, this, t));
+    }
+
+    // the workers finish the asset they are decoding; the assets not started are dropped
+    void Stop() {
+        {
+            lock_guard<mutex> lock(tasksMutex);
+            stopping = true;
+        }
+        tasksCondition.notify_all();
+        for (size_t t = 0; t < workers.size(); t++)
+            workers[t].join();
+        workers.clear();
+        if (pbo != 0) {
+            glDeleteBuffers(1, &pbo);
+            pbo = 0;
+        }
+        if (meshStaging != 0) {
+            glDeleteBuffers(1, &meshStaging);
+            meshStaging = 0;
+        }
+    }
+
+    // assets requested and not uploaded yet
+    int Pending() const { return pending.load(); }
+
+    // generic asset: decode runs on a worker, upload on the main thread (in Update) and returns the bytes sent to the GPU
+    void Load(const char* name, const function<void()>& decode, const function<size_t()>& upload) {
+        shared_ptr<Task> task(new Task());
+        task->name = name;
+        task->decode = decode;
+        task->upload = upload;
+        pending++;
+        if (workers.empty()) {
+            decodeTask(task);
+            return;
+        }
+        {
+            lock_guard<mutex> lock(tasksMutex);
+            tasks.push_back(task);
+        }
+        tasksCondition.notify_one();
+    }
+
+    // the model is parsed on a worker (through the registry, see mesh_registry.h), then prepare (if any) runs on the
+    // same worker with the parsed asset (e.g., to share its geometry with a collision shape). On the main thread
+    // the meshes are uploaded and moved in model, then ready (if any) is called
+    void LoadModel(Model& model, const string& path, const function<void(const shared_ptr<MeshAsset>&)>& prepare = nullptr, const function<void()>& ready = nullptr) {
+        shared_ptr<Model> staged(new Model(model.tilesPerSide, model.lodLevels, model.keepGeometry));
+        Model* target = &model;
+        GLuint* staging = &meshStaging;
+        unsigned int threads = workers.empty() ? 0 : parseThreads;
+        Load("load model", [staged, path, prepare, threads]() {
+            shared_ptr<MeshAsset> asset = meshRegistry.Acquire(path, staged->tilesPerSide, staged->lodLevels, threads);
+            staged->meshes = asset->meshes;
+            staged->directory = asset->directory;
+            if (prepare)
+                prepare(asset);
+        }, [staged, target, ready, staging]() {
+            // the model can be drawn while it is loading: it gets all the meshes at once
+            if (*staging == 0)
+                glGenBuffers(1, staging);
+            staged->Upload(*staging);
+            target->meshes.swap(staged->meshes);
+            target->textures_loaded.swap(staged->textures_loaded);
+            target->directory = staged->directory;
+            if (ready)
+                ready();
+            return target->GpuBytes();
+        });
+    }
+
+    // the texture of the image in the cache: if it is not resident, the image (or its cooked version, if it exists)
+    // replaces the placeholder of the cache when it is uploaded. Decoded images get their mip levels with
+    // glGenerateMipmap, cooked textures have them already
+    TextureHandle LoadTexture(const string& path) {
+        bool load;
+        TextureHandle texture = textureCache.Reserve(path, load);
+        if (!load)
+            return texture;
+        shared_ptr<Image> image(new Image());
+        bool cooked = CompressedTexturesSupported();
+        Load("load texture", [image, path, cooked]() {
+            decodeImage(path, cooked, *image);
+        }, [this, image, texture]() {
+            glState.BindTexture(GL_TEXTURE_2D, texture.Id());
+            size_t bytes = uploadImage(*image, GL_TEXTURE_2D, GL_TEXTURE_2D, true);
+            textureCache.Measure(texture);
+            return bytes;
+        });
+        return texture;
+    }
+
+    // the 6 faces of a cube map (in the order +X, -X, +Y, -Y, +Z, -Z) are decoded together and replace them all
+    // in the same frame: a cube map with faces of different sizes could not be sampled
+    void LoadCubeMap(GLuint texture, const vector<string>& faces) {
+        shared_ptr<vector<Image> > images(new vector<Image>(faces.size()));
+        bool cooked = CompressedTexturesSupported();
+        Load("load cube map", [images, faces, cooked]() {
+            for (size_t f = 0; f < faces.size(); f++)
+                decodeImage(faces[f], cooked, (*images)[f]);
+        }, [this, images, texture]() {
+            glState.BindTexture(GL_TEXTURE_CUBE_MAP, texture);
+            size_t bytes = 0;
+            for (size_t f = 0; f < images->size(); f++)
+                bytes += uploadImage((*images)[f], GL_TEXTURE_CUBE_MAP_POSITIVE_X + (GLenum)f, GL_TEXTURE_CUBE_MAP, false);
+            return bytes;
+        });
+    }
+
+    // uploads the decoded assets, until budgetBytes are sent to the GPU in this call
+    void Update(size_t budgetBytes) {
+        size_t uploaded = 0;
+        while (uploaded < budgetBytes) {
+            shared_ptr<Task> task;
+            {
+                lock_guard<mutex> lock(readyMutex);
+                if (ready.empty())
+                    break;
+                task = ready.front();
+                ready.pop_front();
+            }
+            ScopedTrace trace(task->name);
+            uploaded += task->upload();
+            pending--;
+        }
+        if (uploaded > 0)
+            tracer.Counter("uploaded KB", (long long)(uploaded / 1024));
+    }
+
+    // uploads all the assets, waiting for the workers
+    void Finish() {
+        ScopedTrace trace("wait assets");
+        while (pending.load() > 0) {
+            Update(SIZE_MAX);
+            unique_lock<mutex> lock(readyMutex);
+            readyCondition.wait(lock, [this]() { return !ready.empty() || pending.load() == 0; });
+        }
+    }
+
+private:
+    struct Task {
+        const char* name;
+        function<void()> decode;
+        function<size_t()> upload;
+    };
+
+    // a decoded image: pixels (RGB or RGBA, 8 bits per channel) or the levels of a cooked texture
+    struct Image {
+        bool isCooked;
+        CookedTexture cooked;
+        int width, height, channels;
+        vector<unsigned char> pixels;
+    };
+
+    vector<thread> workers;
+    deque<shared_ptr<Task> > tasks;
+    mutex tasksMutex;
+    condition_variable tasksCondition;
+    bool stopping;
+    // decoded assets, waiting for the upload
+    deque<shared_ptr<Task> > ready;
+    mutex readyMutex;
+    condition_variable readyCondition;
+    atomic<int> pending;
+    // staging buffer of the pixels
+    GLuint pbo;
+    // staging buffer of the vertices and indices of the meshes
+    GLuint meshStaging;
+    // threads of Assimp for each model parsed on a worker (see Model::Parse)
+    unsigned int parseThreads;
+
+    void work(unsigned int index) {
+        tracer.SetThreadName("loader " + to_string(index));
+        while (true) {
+            shared_ptr<Task> task;
+            {
+                unique_lock<mutex> lock(tasksMutex);
+                tasksCondition.wait(lock, [this]() { return stopping || !tasks.empty(); });
+                if (stopping)
+                    return;
+                task = tasks.front();
+                tasks.pop_front();
+            }
+            decodeTask(task);
+        }
+    }
+
+    void decodeTask(const shared_ptr<Task>& task) {
+        {
+            ScopedTrace trace(task->name);
+            task->decode();
+        }
+        {
+            lock_guard<mutex> lock(readyMutex);
+            ready.push_back(task);
+        }
+        readyCondition.notify_all();
+    }
+
+    static void decodeImage(const string& path, bool useCooked, Image& image) {
+        image.isCooked = useCooked && ReadCookedTexture(path, image.cooked);
+        if (image.isCooked)
+            return;
+        image.width = image.height = image.channels = 0;
+        int channels = 0;
+        if (!stbi_info(path.c_str(), &image.width, &image.height, &channels)) {
+            cout << "ERROR::ASSET_LOADER:: cannot read " << path << endl;
+            return;
+        }
+        image.channels = (channels == 2 || channels == 4) ? 4 : 3;
+        unsigned char* pixels = stbi_load(path.c_str(), &image.width, &image.height, &channels, image.channels);
+        if (pixels == NULL) {
+            image.channels = 0;
+            return;
+        }
+        image.pixels.assign(pixels, pixels + (size_t)image.width * image.height * image.channels);
+        stbi_image_free(pixels);
+    }
+
+    // the image is copied in the PBO, then defined in target from it. The texture must be bound to textureTarget
+    size_t uploadImage(const Image& image, GLenum target, GLenum textureTarget, bool mipmaps) {
+        size_t bytes = 0;
+        if (image.isCooked)
+            for (size_t l = 0; l < image.cooked.levels.size(); l++)
+                bytes += image.cooked.levels[l].size();
+        else
+            bytes = image.pixels.size();
+        if (bytes == 0)
+            return 0;
+
+        if (pbo == 0)
+            glGenBuffers(1, &pbo);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+        // new storage for each image: the previous upload may still be reading the old one
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, GL_STREAM_DRAW);
+        unsigned char* staging = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        glCheckError();
+        if (staging == NULL) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return 0;
+        }
+        if (image.isCooked) {
+            size_t offset = 0;
+            for (size_t l = 0; l < image.cooked.levels.size(); l++) {
+                memcpy(staging + offset, &image.cooked.levels[l][0], image.cooked.levels[l].size());
+                offset += image.cooked.levels[l].size();
+            }
+        }
+        else
+            memcpy(staging, &image.pixels[0], bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+
+        // with a PBO bound, the data pointer is an offset in the buffer
+        if (image.isCooked) {
+            int w = image.cooked.width, h = image.cooked.height;
+            size_t offset = 0;
+            for (size_t l = 0; l < image.cooked.levels.size(); l++) {
+                glCompressedTexImage2D(target, (GLint)l, image.cooked.format, w, h, 0, (GLsizei)image.cooked.levels[l].size(), (GLvoid*)offset);
+                offset += image.cooked.levels[l].size();
+                w = max(w / 2, 1);
+                h = max(h / 2, 1);
+            }
+            glTexParameteri(textureTarget, GL_TEXTURE_MAX_LEVEL, (GLint)image.cooked.levels.size() - 1);
+        }
+        else {
+            GLenum format = image.channels == 4 ? GL_RGBA : GL_RGB;
+            // rows of RGB images are not aligned to 4 bytes
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+            glTexImage2D(target, 0, format, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, (GLvoid*)0);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            if (mipmaps)
+                glGenerateMipmap(textureTarget);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glCheckError();
+        return bytes;
+    }
+};
@@ -0,0 +1,147 @@
+/*
+Benchmark results
+- the statistics of each rendered frame (frame time, time of each pass on CPU and GPU, draw calls, particles)
+  are collected for a named scenario
+- at the end of a run the results of all the scenarios are written as JSON:
+  frame time mean, median, 95th and 99th percentile and max, mean time of each pass, draw calls and particles
+
+A baseline and a new result can be compared with lib/bench_compare.py.
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <map>
+#include <algorithm>
+#include <cstdio>
+#include <cmath>
+#include <iostream>
+
+// version of the JSON report: change it if the fields change
+#define BENCHMARK_REPORT_VERSION 1
+
+/////////////////// FrameStats struct ///////////////////////
+struct FrameStats {
+    double frameMs;
+    // time of each pass in milliseconds. A negative GPU time means "not measured"
+    map<string, double> cpuMs, gpuMs;
+    unsigned int drawCalls;
+    unsigned int particles;
+
+    FrameStats() : frameMs(0.0), drawCalls(0), particles(0) {}
+
+    void AddPass(const string& name, double cpu, double gpu = -1.0) {
+        cpuMs[name] += cpu;
+        if (gpu >= 0.0)
+            gpuMs[name] += gpu;
+    }
+};
+
+/////////////////// Benchmark class ///////////////////////
+class Benchmark {
+public:
+    void BeginScenario(const string& name) {
+        Scenario scenario;
+        scenario.name = name;
+        scenarios.push_back(scenario);
+    }
+
+    void AddFrame(const FrameStats& stats) {
+        if (!scenarios.empty())
+            scenarios.back().frames.push_back(stats);
+    }
+
+    // prints a short summary of the last scenario
+    void EndScenario() {
+        if (scenarios.empty() || scenarios.back().frames.empty())
+            return;
+        vector<double> times = frameTimes(scenarios.back());
+        printf("%-16s mean %7.2f ms  p99 %7.2f ms\n", scenarios.back().name.c_str(), mean(times), percentile(times, 0.99));
+    }
+
+    bool WriteJson(const string& path, int width, int height) const {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cout << "ERROR::BENCHMARK::Cannot write " << path << endl;
+            return false;
+        }
+        fprintf(file, "{\n  \"version\": %d,\n  \"resolution\": [%d, %d],\n  \"scenarios\": [", BENCHMARK_REPORT_VERSION, width, height);
+        for (size_t s = 0; s < scenarios.size(); s++) {
+            const Scenario& scenario = scenarios[s];
+            vector<double> times = frameTimes(scenario);
+            fprintf(file, "%s\n    {\n      \"name\": \"%s\",\n      \"frames\": %d,\n", s > 0 ? "," : "", scenario.name.c_str(), (int)times.size());
+            fprintf(file, "      \"frame_ms\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f},\n",
+                mean(times), percentile(times, 0.5), percentile(times, 0.95), percentile(times, 0.99), percentile(times, 1.0));
+
+            // mean time of each pass, over all the frames (a pass not executed in a frame counts as 0)
+            map<string, double> cpu, gpu;
+            map<string, int> gpuFrames;
+            double drawCalls = 0.0, particles = 0.0;
+            unsigned int maxDrawCalls = 0, maxParticles = 0;
+            for (size_t f = 0; f < scenario.frames.size(); f++) {
+                const FrameStats& frame = scenario.frames[f];
+                for (map<string, double>::const_iterator it = frame.cpuMs.begin(); it != frame.cpuMs.end(); ++it)
+                    cpu[it->first] += it->second;
+                for (map<string, double>::const_iterator it = frame.gpuMs.begin(); it != frame.gpuMs.end(); ++it) {
+                    gpu[it->first] += it->second;
+                    gpuFrames[it->first]++;
+                }
+                drawCalls += frame.drawCalls;
+                particles += frame.particles;
+                maxDrawCalls = max(maxDrawCalls, frame.drawCalls);
+                maxParticles = max(maxParticles, frame.particles);
+            }
+            double count = max((double)scenario.frames.size(), 1.0);
+            fprintf(file, "      \"passes\": {");
+            for (map<string, double>::const_iterator it = cpu.begin(); it != cpu.end(); ++it) {
+                fprintf(file, "%s\n        \"%s\": {\"cpu_ms\": %.4f, \"gpu_ms\": ", it == cpu.begin() ? "" : ",", it->first.c_str(), it->second / count);
+                // GPU times are averaged on the frames where they are available (query results can arrive late)
+                map<string, int>::const_iterator frames = gpuFrames.find(it->first);
+                if (frames != gpuFrames.end())
+                    fprintf(file, "%.4f}", gpu.find(it->first)->second / frames->second);
+                else
+                    fprintf(file, "null}");
+            }
+            fprintf(file, "%s},\n", cpu.empty() ? "" : "\n      ");
+            fprintf(file, "      \"draw_calls\": {\"mean\": %.1f, \"max\": %u},\n", drawCalls / count, maxDrawCalls);
+            fprintf(file, "      \"particles\": {\"mean\": %.1f, \"max\": %u}\n    }", particles / count, maxParticles);
+        }
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+        return true;
+    }
+
+private:
+    struct Scenario {
+        string name;
+        vector<FrameStats> frames;
+    };
+    vector<Scenario> scenarios;
+
+    static vector<double> frameTimes(const Scenario& scenario) {
+        vector<double> times;
+        for (size_t f = 0; f < scenario.frames.size(); f++)
+            times.push_back(scenario.frames[f].frameMs);
+        sort(times.begin(), times.end());
+        return times;
+    }
+
+    static double mean(const vector<double>& values) {
+        if (values.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        return sum / values.size();
+    }
+
+    // nearest rank percentile of sorted values
+    static double percentile(const vector<double>& sorted, double p) {
+        if (sorted.empty())
+            return 0.0;
+        size_t rank = (size_t)ceil(p * sorted.size());
+        return sorted[rank > 0 ? rank - 1 : 0];
+    }
+};
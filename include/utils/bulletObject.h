@@ -19,10 +19,13 @@ public:
 	ContactType type;
 	btRigidBody* body;
 	Particle* particle;
+	// position in Physics::bodies
+	int index;
 
 	bulletObject(btRigidBody* b, ContactType t, Particle *p) {
 		type = t;
 		body = b;
 		particle = p;
+		index = -1;
 	}
 };
\ No newline at end of file
@@ -146,6 +146,16 @@ public:
         this->updateCameraVectors();
     }
 
+    //////////////////////////////////////////
+    // it places the camera in a given pose (e.g., when a recorded camera path is played)
+    void SetPose(glm::vec3 position, GLfloat yaw, GLfloat pitch)
+    {
+        this->Position = position;
+        this->Yaw = yaw;
+        this->Pitch = pitch;
+        this->updateCameraVectors();
+    }
+
 private:
     //////////////////////////////////////////
     // Aggiorna il sistema di riferimento della camera
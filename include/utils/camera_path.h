@@ -0,0 +1,247 @@
+/*
+Camera path
+- sequence of camera poses (position, yaw, pitch) sampled with a fixed time step, and a list of events
+  (e.g., weather changes) with their time step
+- recording: the pose of a Camera is sampled while the user moves it, events are added when they happen
+- playback: the pose at any time is interpolated with a Catmull-Rom spline, and drives a Camera
+- compact binary file: a header, then the poses (5 floats each) and the events (2 integers each)
+- a set of standard paths, generated procedurally, so benchmarks can be repeated on the same views
+
+The meaning of the event codes is up to the application.
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <cmath>
+#include <iostream>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <utils/camera.h>
+
+// version of the file format
+#define CAMERA_PATH_VERSION 1
+
+/////////////////// CameraKey struct ///////////////////////
+struct CameraKey {
+    glm::vec3 position;
+    GLfloat yaw, pitch;
+};
+
+/////////////////// CameraEvent struct ///////////////////////
+struct CameraEvent {
+    // index of the time step when the event happens
+    GLuint step;
+    GLuint code;
+};
+
+/////////////////// CameraPath class ///////////////////////
+class CameraPath {
+public:
+    // time between two keys, in seconds
+    GLfloat step;
+    vector<CameraKey> keys;
+    vector<CameraEvent> events;
+
+    CameraPath(GLfloat step = 1.0f / 30.0f) : step(step) {}
+
+    GLfloat Duration() const {
+        return keys.size() < 2 ? 0.0f : (keys.size() - 1) * step;
+    }
+
+    //////////////////////////////////////////
+    // recording: a key is added for each time step passed since the last call
+    void Record(GLfloat time, const Camera& camera) {
+        CameraKey key;
+        key.position = camera.Position;
+        key.yaw = camera.Yaw;
+        key.pitch = camera.Pitch;
+        while (keys.size() * step <= time)
+            keys.push_back(key);
+    }
+
+    // the event is assigned to the nearest time step
+    void RecordEvent(GLfloat time, GLuint code) {
+        CameraEvent event;
+        event.step = (GLuint)floor(time / step + 0.5f);
+        event.code = code;
+        events.push_back(event);
+    }
+
+    //////////////////////////////////////////
+    // playback: pose at the given time (clamped to the path), interpolated with a Catmull-Rom spline
+    void Evaluate(GLfloat time, Camera& camera) const {
+        if (keys.empty())
+            return;
+        GLfloat t = glm::clamp(time / step, 0.0f, (GLfloat)(keys.size() - 1));
+        int i = (int)t;
+        if (i >= (int)keys.size() - 1)
+            i = (int)keys.size() - 2;
+        if (i < 0) {
+            camera.SetPose(keys[0].position, keys[0].yaw, keys[0].pitch);
+            return;
+        }
+        GLfloat f = t - i;
+        const CameraKey& k0 = keys[i > 0 ? i - 1 : 0];
+        const CameraKey& k1 = keys[i];
+        const CameraKey& k2 = keys[i + 1];
+        const CameraKey& k3 = keys[i + 2 < (int)keys.size() ? i + 2 : i + 1];
+        glm::vec3 position = catmullRom(k0.position, k1.position, k2.position, k3.position, f);
+        GLfloat yaw = catmullRom(k0.yaw, k1.yaw, k2.yaw, k3.yaw, f);
+        GLfloat pitch = glm::clamp(catmullRom(k0.pitch, k1.pitch, k2.pitch, k3.pitch, f), -89.0f, 89.0f);
+        camera.SetPose(position, yaw, pitch);
+    }
+
+    // codes of the events in the time interval (from, to]. Events at step 0 are returned when from < 0
+    void EventsBetween(GLfloat from, GLfloat to, vector<GLuint>& codes) const {
+        codes.clear();
+        for (size_t e = 0; e < events.size(); e++) {
+            GLfloat time = events[e].step * step;
+            if (time > from && time <= to)
+                codes.push_back(events[e].code);
+        }
+    }
+
+    //////////////////////////////////////////
+    bool Save(const string& path) const {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            cout << "ERROR::CAMERA_PATH::Cannot write " << path << endl;
+            return false;
+        }
+        Header header;
+        memcpy(header.magic, "CPTH", 4);
+        header.version = CAMERA_PATH_VERSION;
+        header.step = step;
+        header.keyCount = (GLuint)keys.size();
+        header.eventCount = (GLuint)events.size();
+        fwrite(&header, sizeof(header), 1, file);
+        for (size_t k = 0; k < keys.size(); k++) {
+            GLfloat values[5] = { keys[k].position.x, keys[k].position.y, keys[k].position.z, keys[k].yaw, keys[k].pitch };
+            fwrite(values, sizeof(GLfloat), 5, file);
+        }
+        for (size_t e = 0; e < events.size(); e++) {
+            GLuint values[2] = { events[e].step, events[e].code };
+            fwrite(values, sizeof(GLuint), 2, file);
+        }
+        fclose(file);
+        return true;
+    }
+
+    bool Load(const string& path) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file) {
+            cout << "ERROR::CAMERA_PATH::Cannot read " << path << endl;
+            return false;
+        }
+        Header header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1 && memcmp(header.magic, "CPTH", 4) == 0
+            && header.version == CAMERA_PATH_VERSION && header.step > 0.0f;
+        if (valid) {
+            // the counts must fit in the rest of the file, before they size the arrays
+            long start = ftell(file);
+            valid = start >= 0 && fseek(file, 0, SEEK_END) == 0;
+            long end = valid ? ftell(file) : -1;
+            valid = valid && end >= start && fseek(file, start, SEEK_SET) == 0
+                && (uint64_t)header.keyCount * 5 * sizeof(GLfloat) + (uint64_t)header.eventCount * 2 * sizeof(GLuint)
+                    <= (uint64_t)(end - start);
+        }
+        if (valid) {
+            step = header.step;
+            keys.resize(header.keyCount);
+            events.resize(header.eventCount);
+            for (size_t k = 0; k < keys.size() && valid; k++) {
+                GLfloat values[5];
+                valid = fread(values, sizeof(GLfloat), 5, file) == 5;
+                keys[k].position = glm::vec3(values[0], values[1], values[2]);
+                keys[k].yaw = values[3];
+                keys[k].pitch = values[4];
+            }
+            for (size_t e = 0; e < events.size() && valid; e++) {
+                GLuint values[2];
+                valid = fread(values, sizeof(GLuint), 2, file) == 2;
+                events[e].step = values[0];
+                events[e].code = values[1];
+            }
+        }
+        fclose(file);
+        if (!valid) {
+            keys.clear();
+            events.clear();
+            cout << "ERROR::CAMERA_PATH::Invalid file " << path << endl;
+        }
+        return valid;
+    }
+
+    //////////////////////////////////////////
+    // standard paths around a point of interest (center) of a given size (radius):
+    // "orbit" - a turn around the center, looking at it
+    // "flyover" - a pass over the center, from one side to the other
+    // "valley" - a low turn near the ground, looking ahead
+    // returns false if the name is not known
+    static bool Standard(const string& name, glm::vec3 center, GLfloat radius, CameraPath& path) {
+        path = CameraPath();
+        GLfloat duration;
+        if (name == "orbit") duration = 30.0f;
+        else if (name == "flyover") duration = 20.0f;
+        else if (name == "valley") duration = 40.0f;
+        else return false;
+
+        GLuint count = (GLuint)(duration / path.step + 0.5f) + 1;
+        GLfloat previousYaw = 0.0f;
+        for (GLuint k = 0; k < count; k++) {
+            GLfloat s = (GLfloat)k / (count - 1);
+            glm::vec3 position, target;
+            if (name == "orbit") {
+                GLfloat angle = s * 2.0f * glm::pi<GLfloat>();
+                position = center + glm::vec3(cos(angle) * radius * 1.4f, radius * 0.5f, sin(angle) * radius * 1.4f);
+                target = center;
+            }
+            else if (name == "flyover") {
+                position = center + glm::vec3(glm::mix(-1.3f, 1.3f, s) * radius, radius * 0.6f, glm::mix(-0.4f, 0.4f, s) * radius);
+                target = position + glm::vec3(1.0f, -0.5f, 0.3f);
+            }
+            else {
+                GLfloat angle = s * 2.0f * glm::pi<GLfloat>();
+                position = center + glm::vec3(cos(angle) * radius * 0.9f, radius * 0.08f, sin(angle) * radius * 0.9f);
+                // the camera looks along the tangent of the circle, slightly inwards
+                target = position + glm::vec3(-sin(angle) - 0.3f * cos(angle), -0.05f, cos(angle) - 0.3f * sin(angle));
+            }
+            glm::vec3 direction = glm::normalize(target - position);
+            CameraKey key;
+            key.position = position;
+            key.pitch = glm::degrees(asin(direction.y));
+            key.yaw = glm::degrees(atan2(direction.z, direction.x));
+            // the yaw is unwrapped, so the interpolation does not turn the wrong way at +-180 degrees
+            if (k > 0) {
+                while (key.yaw - previousYaw > 180.0f) key.yaw -= 360.0f;
+                while (key.yaw - previousYaw < -180.0f) key.yaw += 360.0f;
+            }
+            previousYaw = key.yaw;
+            path.keys.push_back(key);
+        }
+        return true;
+    }
+
+private:
+    struct Header {
+        char magic[4];
+        GLuint version;
+        GLfloat step;
+        GLuint keyCount, eventCount;
+    };
+
+    template <typename T>
+    static T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, GLfloat t) {
+        GLfloat t2 = t * t, t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+};
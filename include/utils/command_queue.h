@@ -0,0 +1,75 @@
+/*
+Command queue
+- state changes requested by input callbacks (which run inside glfwPollEvents, at an undefined point of the frame)
+  are queued as commands, and applied all together at a fixed point of the frame
+- expensive work (e.g., destroying thousands of rigid bodies, warming a shader) is queued as jobs: a job does a small
+  step of its work at each call, and returns true when it is finished. At each frame the jobs are called, in order,
+  until the time budget of the frame is spent: the work is spread over several frames
+
+Usage:
+    commandQueue.Push([]() { ToggleRain(); });             // from a callback
+    commandQueue.PushJob([&]() { return DoSomeWork(); });  // from a command
+    commandQueue.Execute(budgetMs);                        // once per frame
+*/
+
+#pragma once
+using namespace std;
+
+#include <deque>
+#include <vector>
+#include <functional>
+#include <chrono>
+
+#include <utils/tracer.h>
+
+/////////////////// CommandQueue class ///////////////////////
+class CommandQueue {
+public:
+    void Push(const function<void()>& command) {
+        commands.push_back(command);
+    }
+
+    void PushJob(const function<bool()>& job) {
+        jobs.push_back(job);
+    }
+
+    // pending jobs
+    size_t Jobs() const { return jobs.size(); }
+
+    // applies all the queued commands, then runs the jobs for at most budgetMs milliseconds
+    // (a job step always runs to its end: the steps must be short)
+    void Execute(double budgetMs) {
+        if (!commands.empty()) {
+            ScopedTrace trace("commands");
+            // commands can queue other commands: they are applied in the next frame
+            vector<function<void()> > current;
+            current.swap(commands);
+            for (size_t c = 0; c < current.size(); c++)
+                current[c]();
+        }
+        if (jobs.empty())
+            return;
+        ScopedTrace trace("jobs");
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        while (!jobs.empty() && chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() < budgetMs) {
+            if (jobs.front()())
+                jobs.pop_front();
+        }
+        tracer.Counter("pending jobs", (long long)jobs.size());
+    }
+
+    // runs all the jobs to their end (e.g., before changes that need them finished)
+    void Finish() {
+        while (!jobs.empty()) {
+            if (jobs.front()())
+                jobs.pop_front();
+        }
+    }
+
+private:
+    vector<function<void()> > commands;
+    deque<function<bool()> > jobs;
+};
+
+// the single instance used by the whole application
+CommandQueue commandQueue;
@@ -0,0 +1,96 @@
+/*
+Flight recorder
+- always on: the event tracer (tracer.h) runs in ring mode, so the last seconds of spans and counters are kept in memory
+- the time of each frame is recorded too, as a counter of the trace
+- when a frame takes more than the budget, the events of a window around it (some seconds before, a fraction
+  of second after) are written to disk as Chrome trace JSON: rare stalls in long runs can be inspected
+  without tracing the whole run
+- a slowdown lasting many frames gives a single dump: a new spike is captured only after the last window is written,
+  and the dumps of a run are limited
+
+Usage:
+    flightRecorder.Start(budgetMs, folder);   // enables the tracer in ring mode, if it is not already enabled
+    ...
+    flightRecorder.EndFrame(frame, frameMs);  // at the end of each frame
+*/
+
+#pragma once
+using namespace std;
+
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#include <utils/tracer.h>
+
+// events kept for each thread: about 20 seconds of the main loop at 60 fps
+#define FLIGHT_RECORDER_EVENTS (1 << 16)
+// window written around a spike, in seconds
+#define FLIGHT_RECORDER_BEFORE 3.0
+#define FLIGHT_RECORDER_AFTER 0.5
+// maximum number of dumps of a run
+#define FLIGHT_RECORDER_MAX_DUMPS 10
+
+/////////////////// FlightRecorder class ///////////////////////
+class FlightRecorder {
+public:
+    FlightRecorder() : budgetMs(0.0), dumps(0), pending(false) {}
+
+    // a budget <= 0 disables the recorder
+    void Start(double budget, const string& dumpFolder) {
+        budgetMs = budget;
+        folder = dumpFolder;
+        if (budgetMs > 0.0 && !tracer.Enabled())
+            tracer.Enable(FLIGHT_RECORDER_EVENTS, true);
+    }
+
+    bool Active() const { return budgetMs > 0.0; }
+
+    void EndFrame(long long frame, double frameMs) {
+        if (!Active())
+            return;
+        tracer.Counter("frame us", (long long)(frameMs * 1000.0));
+        long long now = tracer.Now();
+        // the window of the last spike is complete
+        if (pending && now >= windowEnd) {
+            pending = false;
+            dump();
+        }
+        if (!pending && frameMs > budgetMs && dumps < FLIGHT_RECORDER_MAX_DUMPS) {
+            pending = true;
+            spikeFrame = frame;
+            spikeMs = frameMs;
+            windowStart = now - (long long)(frameMs * 1000.0) - (long long)(FLIGHT_RECORDER_BEFORE * 1000000.0);
+            windowEnd = now + (long long)(FLIGHT_RECORDER_AFTER * 1000000.0);
+        }
+    }
+
+    // the window of a spike near the end of the run is written anyway
+    void Stop() {
+        if (pending) {
+            pending = false;
+            dump();
+        }
+    }
+
+private:
+    double budgetMs;
+    string folder;
+    int dumps;
+    bool pending;
+    long long spikeFrame;
+    double spikeMs;
+    long long windowStart, windowEnd;
+
+    void dump() {
+        char name[64];
+        snprintf(name, sizeof(name), "/spike_%02d_frame_%lld.json", dumps, spikeFrame);
+        string path = folder + name;
+        dumps++;
+        if (tracer.Write(path, windowStart, windowEnd))
+            printf("Frame %lld took %.2f ms (budget %.2f ms): trace written in %s\n", spikeFrame, spikeMs, budgetMs, path.c_str());
+    }
+};
+
+// the single instance used by the whole application
+FlightRecorder flightRecorder;
@@ -0,0 +1,138 @@
+/*
+Frustum culling
+- AABB: axis aligned bounding box
+- Frustum: the 6 clipping planes extracted from a projection * view (* model) matrix
+
+If the matrix includes the model matrix, the planes are in the local space of the model, so the
+bounding boxes computed at load time can be tested without transforming them.
+
+The planes are stored "structure of arrays", so a box is tested against 4 planes at once using SSE
+(if not available, a scalar version is used).
+
+Plane extraction: Gribb, Hartmann - "Fast Extraction of Viewing Frustum Planes from the World-View-Projection Matrix"
+*/
+
+#pragma once
+
+#include <vector>
+#include <cfloat>
+#include <cmath>
+
+#include <glm/glm.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+/////////////////// AABB struct ///////////////////////
+struct AABB {
+	glm::vec3 min, max;
+
+	// an "empty" box: the first Extend() sets it to the point
+	AABB() : min(glm::vec3(FLT_MAX)), max(glm::vec3(-FLT_MAX)) {}
+	AABB(glm::vec3 min, glm::vec3 max) : min(min), max(max) {}
+
+	void Extend(const glm::vec3& p) {
+		min = glm::min(min, p);
+		max = glm::max(max, p);
+	}
+
+	void Extend(const AABB& box) {
+		min = glm::min(min, box.min);
+		max = glm::max(max, box.max);
+	}
+
+	bool IsEmpty() const { return min.x > max.x; }
+	glm::vec3 Center() const { return (min + max) * 0.5f; }
+	glm::vec3 Extent() const { return (max - min) * 0.5f; }
+};
+
+/////////////////// Frustum class ///////////////////////
+class Frustum {
+public:
+	Frustum() {
+		// a frustum that contains everything
+		for (int i = 0; i < PLANES; i++) {
+			nx[i] = ny[i] = nz[i] = 0.0f;
+			d[i] = FLT_MAX;
+		}
+	}
+
+	Frustum(const glm::mat4& m) {
+		Set(m);
+	}
+
+	// planes are extracted from the rows of the matrix (GLM matrices are column major: m[column][row])
+	void Set(const glm::mat4& m) {
+		glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+		glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+		glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+		glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+		setPlane(0, row3 + row0);	// left
+		setPlane(1, row3 - row0);	// right
+		setPlane(2, row3 + row1);	// bottom
+		setPlane(3, row3 - row1);	// top
+		setPlane(4, row3 + row2);	// near
+		setPlane(5, row3 - row2);	// far
+		// padding planes, always passed
+		for (int i = 6; i < PLANES; i++) {
+			nx[i] = ny[i] = nz[i] = 0.0f;
+			d[i] = FLT_MAX;
+		}
+	}
+
+	// false if the box is completely outside at least one plane
+	bool IsVisible(const AABB& box) const {
+		glm::vec3 c = box.Center();
+		glm::vec3 e = box.Extent();
+#ifdef FRUSTUM_USE_SSE
+		const __m128 signMask = _mm_set1_ps(-0.0f);
+		__m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+		__m128 ex = _mm_set1_ps(e.x), ey = _mm_set1_ps(e.y), ez = _mm_set1_ps(e.z);
+		for (int i = 0; i < PLANES; i += 4) {
+			__m128 px = _mm_loadu_ps(&nx[i]), py = _mm_loadu_ps(&ny[i]), pz = _mm_loadu_ps(&nz[i]);
+			// signed distance of the center from the 4 planes
+			__m128 dist = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, cx), _mm_mul_ps(py, cy)), _mm_add_ps(_mm_mul_ps(pz, cz), _mm_loadu_ps(&d[i])));
+			// projection of the half extent on the plane normals
+			__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, px), ex), _mm_mul_ps(_mm_andnot_ps(signMask, py), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, pz), ez));
+			if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), _mm_setzero_ps())) != 0)
+				return false;
+		}
+		return true;
+#else
+		for (int i = 0; i < 6; i++) {
+			float dist = nx[i] * c.x + ny[i] * c.y + nz[i] * c.z + d[i];
+			float radius = fabsf(nx[i]) * e.x + fabsf(ny[i]) * e.y + fabsf(nz[i]) * e.z;
+			if (dist + radius < 0.0f)
+				return false;
+		}
+		return true;
+#endif
+	}
+
+	// tests a list of boxes, and writes 1 (visible) or 0 (culled) for each one. It returns the number of visible boxes
+	int Cull(const std::vector<AABB>& boxes, std::vector<unsigned char>& visible) const {
+		int count = 0;
+		visible.resize(boxes.size());
+		for (size_t i = 0; i < boxes.size(); i++) {
+			visible[i] = IsVisible(boxes[i]) ? 1 : 0;
+			count += visible[i];
+		}
+		return count;
+	}
+
+private:
+	// 6 planes + 2 padding planes, to test 2 groups of 4 planes with SSE
+	static const int PLANES = 8;
+	float nx[PLANES], ny[PLANES], nz[PLANES], d[PLANES];
+
+	void setPlane(int i, glm::vec4 p) {
+		float length = glm::length(glm::vec3(p));
+		nx[i] = p.x / length;
+		ny[i] = p.y / length;
+		nz[i] = p.z / length;
+		d[i] = p.w / length;
+	}
+};
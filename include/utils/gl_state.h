@@ -0,0 +1,158 @@
+/*
+GL state cache
+- keeps a shadow copy of the bound program, VAO, active texture unit and texture bindings
+- redundant glUseProgram, glBindVertexArray, glActiveTexture and glBindTexture calls are skipped
+- draw calls are counted, for the statistics of the frame
+
+Every bind of these objects in the application must go through the global glState instance,
+otherwise the shadow copy is out of sync with the driver. If some code binds objects directly
+(e.g. a third-party library), call Invalidate() afterwards.
+*/
+
+#pragma once
+
+#include <glad/glad.h>
+#include <utils/gl_error.h>
+
+// number of texture units tracked by the cache (GL 3.3 guarantees at least 16 in the fragment stage)
+#define GL_STATE_TEXTURE_UNITS 16
+// value used to mark an unknown binding: the next bind is always issued
+#define GL_STATE_UNKNOWN 0xFFFFFFFFu
+
+/////////////////// GLStateCache class ///////////////////////
+class GLStateCache {
+public:
+	// number of calls sent to the driver and number of calls skipped since the last ResetCounters()
+	unsigned int issuedCalls, skippedCalls;
+	// number of draw calls since the last ResetCounters()
+	unsigned int drawCalls;
+
+	GLStateCache() {
+		Invalidate();
+		ResetCounters();
+	}
+
+	// forget everything: the next bind of each kind is sent to the driver
+	void Invalidate() {
+		program = GL_STATE_UNKNOWN;
+		vao = GL_STATE_UNKNOWN;
+		activeUnit = GL_STATE_UNKNOWN;
+		for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+			for (int t = 0; t < TARGETS; t++)
+				textures[i][t] = GL_STATE_UNKNOWN;
+	}
+
+	void ResetCounters() {
+		issuedCalls = 0;
+		skippedCalls = 0;
+		drawCalls = 0;
+	}
+
+	void UseProgram(GLuint p) {
+		if (p == program) {
+			skippedCalls++;
+			return;
+		}
+		glUseProgram(p);
+		glCheckError();
+		program = p;
+		issuedCalls++;
+	}
+
+	void BindVertexArray(GLuint v) {
+		if (v == vao) {
+			skippedCalls++;
+			return;
+		}
+		glBindVertexArray(v);
+		glCheckError();
+		vao = v;
+		issuedCalls++;
+	}
+
+	// unit is an enum as in glActiveTexture (GL_TEXTURE0 + i)
+	void ActiveTexture(GLenum unit) {
+		GLuint index = unit - GL_TEXTURE0;
+		if (index == activeUnit) {
+			skippedCalls++;
+			return;
+		}
+		glActiveTexture(unit);
+		glCheckError();
+		activeUnit = index;
+		issuedCalls++;
+	}
+
+	// binds the texture on the currently active unit, as glBindTexture does
+	void BindTexture(GLenum target, GLuint texture) {
+		int t = TargetIndex(target);
+		if (activeUnit < GL_STATE_TEXTURE_UNITS && t >= 0) {
+			if (textures[activeUnit][t] == texture) {
+				skippedCalls++;
+				return;
+			}
+			textures[activeUnit][t] = texture;
+		}
+		glBindTexture(target, texture);
+		glCheckError();
+		issuedCalls++;
+	}
+
+	// shortcut for ActiveTexture + BindTexture
+	void BindTextureUnit(GLuint unit, GLenum target, GLuint texture) {
+		ActiveTexture(GL_TEXTURE0 + unit);
+		BindTexture(target, texture);
+	}
+
+	// draw calls: they are only counted, the caller checks the errors
+	void DrawArrays(GLenum mode, GLint first, GLsizei count) {
+		glDrawArrays(mode, first, count);
+		drawCalls++;
+	}
+
+	void DrawElements(GLenum mode, GLsizei count, GLenum type, const GLvoid* offset) {
+		glDrawElements(mode, count, type, offset);
+		drawCalls++;
+	}
+
+	void DrawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const GLvoid* offset, GLsizei instances) {
+		glDrawElementsInstanced(mode, count, type, offset, instances);
+		drawCalls++;
+	}
+
+	GLuint CurrentProgram() { return program; }
+
+	// deleted objects are unbound by the driver: the ids can be reused by the next glGen*, so we forget them
+	void ForgetProgram(GLuint p) {
+		if (program == p) program = GL_STATE_UNKNOWN;
+	}
+
+	void ForgetVertexArray(GLuint v) {
+		if (vao == v) vao = GL_STATE_UNKNOWN;
+	}
+
+	void ForgetTexture(GLuint texture) {
+		for (int i = 0; i < GL_STATE_TEXTURE_UNITS; i++)
+			for (int t = 0; t < TARGETS; t++)
+				if (textures[i][t] == texture) textures[i][t] = GL_STATE_UNKNOWN;
+	}
+
+private:
+	// texture targets tracked per unit
+	static const int TARGETS = 3;
+
+	GLuint program, vao, activeUnit;
+	GLuint textures[GL_STATE_TEXTURE_UNITS][TARGETS];
+
+	static int TargetIndex(GLenum target) {
+		switch (target) {
+			case GL_TEXTURE_2D:			return 0;
+			case GL_TEXTURE_CUBE_MAP:	return 1;
+			case GL_TEXTURE_3D:			return 2;
+			default:					return -1;
+		}
+	}
+};
+
+// the single instance used by the whole application (we have only one GL context)
+GLStateCache glState;
@@ -0,0 +1,40 @@
+/*
+Mapped file
+- a file mapped read-only in memory: its bytes are read from the page cache when they are touched, without copying
+  them in a buffer first (e.g., the vertices of a cooked mesh are given as they are to glBufferData)
+- the mapping is released when the object is destroyed: share it (shared_ptr) with the objects pointing inside it
+- the system calls are in mapped_file.cpp: this header is included by the meshes, and must not bring windows.h in
+  every file that includes them (see the check after glad.h in work06a.cpp)
+
+Usage:
+    shared_ptr<MappedFile> file(new MappedFile());
+    if (file->Open(path)) { const unsigned char* data = file->Data(); size_t size = file->Size(); ... }
+*/
+
+#pragma once
+using namespace std;
+
+#include <string>
+#include <cstddef>
+
+/////////////////// MappedFile class ///////////////////////
+class MappedFile {
+public:
+    MappedFile() : data(NULL), size(0) {}
+
+    ~MappedFile() { Close(); }
+
+    bool Open(const string& path);
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+
+    // the mapping cannot be copied (it would be released twice)
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
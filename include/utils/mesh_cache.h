@@ -0,0 +1,291 @@
+/*
+Cooked meshes
+- the meshes of a model, as they are sent to the GPU (interleaved vertices, indices reordered in tiles, levels of
+  detail), are written in a file next to the model (same name, .mesh extension) the first time the model is loaded
+- at the next runs the file is mapped in memory (see mapped_file.h) and the meshes point inside it: Assimp, the
+  tiling and the simplification are skipped, and the buffers are given to glBufferData without being copied
+- the file is valid only for the same source file (size and modification time) and the same tiling parameters,
+  and for the same version of the format: otherwise the model is loaded from the source and the file is rewritten
+
+Layout (little endian, each section aligned to 16 bytes):
+    CookedModelHeader
+    CookedMeshRecord x meshCount
+    for each mesh: vertices (Vertex), indices (GLuint), tiles (MeshTile), tile bounds (6 floats),
+                   levels of detail after the first (MeshTile x tiles), textures (CookedTextureRef)
+
+Usage:
+    if (!ReadCookedModel(path, tilesPerSide, lodLevels, meshes)) { ... load with Assimp ...; WriteCookedModel(path, tilesPerSide, lodLevels, meshes); }
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <iostream>
+#include <sys/stat.h>
+
+#include <utils/mesh_v2.h>
+#include <utils/mapped_file.h>
+#include <utils/tracer.h>
+
+// change it when the layout of the file or the content of the meshes (e.g., Vertex, tiling, simplification) changes
+#define MESH_CACHE_VERSION 2
+#define MESH_CACHE_ALIGNMENT 16
+
+struct CookedModelHeader {
+    char magic[4];          // "MESH"
+    uint32_t version;
+    uint32_t meshCount;
+    uint32_t tilesPerSide;
+    uint32_t lodLevels;
+    uint32_t vertexSize;    // sizeof(Vertex) of the writer
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t reserved[2];
+};
+
+struct CookedMeshRecord {
+    uint64_t vertexOffset, indexOffset, tilesOffset, texturesOffset;
+    uint32_t vertexCount, indexCount, baseIndexCount, tileCount;
+    // levels of detail, including the full detail level (0 if the mesh has no levels of detail)
+    uint32_t lodCount, textureCount, hasTexture, reserved;
+    float boundsMin[3], boundsMax[3];
+    // vertex cache efficiency before and after the optimization: ACMR, ATVR
+    float cacheBefore[2], cacheAfter[2];
+    uint64_t reserved2;
+};
+
+struct CookedTextureRef {
+    char type[32];
+    char path[224];
+};
+
+// file of the cooked meshes of a model
+string CookedMeshPath(const string& source) {
+    size_t dot = source.find_last_of('.');
+    size_t slash = source.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return source + ".mesh";
+    return source.substr(0, dot) + ".mesh";
+}
+
+namespace mesh_cache {
+
+inline bool sourceStamp(const string& path, uint64_t& size, int64_t& time) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    size = (uint64_t)info.st_size;
+    time = (int64_t)info.st_mtime;
+    return true;
+}
+
+inline uint64_t align(uint64_t offset) {
+    return (offset + MESH_CACHE_ALIGNMENT - 1) / MESH_CACHE_ALIGNMENT * MESH_CACHE_ALIGNMENT;
+}
+
+// section of count elements of type T at offset: false if it is outside the file
+template <typename T>
+inline bool section(const MappedFile& file, uint64_t offset, uint64_t count, const T*& data) {
+    if (offset % MESH_CACHE_ALIGNMENT != 0 || offset > file.Size() || count * sizeof(T) > file.Size() - offset)
+        return false;
+    data = (const T*)(file.Data() + offset);
+    return true;
+}
+
+inline void writeAt(FILE* file, uint64_t& offset, const void* data, size_t bytes) {
+    // padding up to the alignment of the section
+    static const char zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+    uint64_t start = align(offset);
+    fwrite(zeros, 1, (size_t)(start - offset), file);
+    if (bytes > 0)
+        fwrite(data, 1, bytes, file);
+    offset = start + bytes;
+}
+
+}
+
+// the meshes of the cooked file of the model at path, if it is valid. Their textures must still be loaded
+bool ReadCookedModel(const string& path, GLuint tilesPerSide, GLuint lodLevels, vector<Mesh>& meshes) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!mesh_cache::sourceStamp(path, sourceSize, sourceTime))
+        return false;
+    shared_ptr<MappedFile> file(new MappedFile());
+    if (!file->Open(CookedMeshPath(path)))
+        return false;
+    ScopedTrace trace("read cooked meshes");
+
+    const CookedModelHeader* header;
+    if (!mesh_cache::section(*file, 0, 1, header) || memcmp(header->magic, "MESH", 4) != 0 || header->version != MESH_CACHE_VERSION
+        || header->vertexSize != sizeof(Vertex) || header->tilesPerSide != tilesPerSide || header->lodLevels != lodLevels
+        || header->sourceSize != sourceSize || header->sourceTime != sourceTime)
+        return false;
+    const CookedMeshRecord* records;
+    if (!mesh_cache::section(*file, mesh_cache::align(sizeof(CookedModelHeader)), header->meshCount, records))
+        return false;
+
+    vector<Mesh> cookedMeshes;
+    for (uint32_t m = 0; m < header->meshCount; m++) {
+        const CookedMeshRecord& record = records[m];
+        CookedMesh cooked;
+        cooked.geometry.reset(new MeshGeometry());
+        cooked.geometry->file = file;
+        cooked.geometry->vertexOffset = (size_t)record.vertexOffset;
+        cooked.geometry->indexOffset = (size_t)record.indexOffset;
+        cooked.geometry->vertexCount = record.vertexCount;
+        cooked.geometry->indexCount = record.indexCount;
+        cooked.baseIndexCount = record.baseIndexCount;
+        cooked.bounds = AABB(glm::vec3(record.boundsMin[0], record.boundsMin[1], record.boundsMin[2]),
+            glm::vec3(record.boundsMax[0], record.boundsMax[1], record.boundsMax[2]));
+        VertexCacheStats before = { record.cacheBefore[0], record.cacheBefore[1] };
+        VertexCacheStats after = { record.cacheAfter[0], record.cacheAfter[1] };
+        cooked.cacheBefore = before;
+        cooked.cacheAfter = after;
+
+        const Vertex* vertices;
+        const GLuint* indices;
+        const MeshTile* tiles;
+        const float* bounds;
+        const MeshTile* lods;
+        const CookedTextureRef* textureRefs;
+        uint64_t tilesBytes = mesh_cache::align((uint64_t)record.tileCount * sizeof(MeshTile));
+        uint64_t boundsBytes = mesh_cache::align((uint64_t)record.tileCount * 6 * sizeof(float));
+        uint64_t lodTiles = record.lodCount > 1 ? (uint64_t)(record.lodCount - 1) * record.tileCount : 0;
+        if (!mesh_cache::section(*file, record.vertexOffset, record.vertexCount, vertices)
+            || !mesh_cache::section(*file, record.indexOffset, record.indexCount, indices)
+            || !mesh_cache::section(*file, record.tilesOffset, record.tileCount, tiles)
+            || !mesh_cache::section(*file, record.tilesOffset + tilesBytes, (uint64_t)record.tileCount * 6, bounds)
+            || !mesh_cache::section(*file, record.tilesOffset + tilesBytes + boundsBytes, lodTiles, lods)
+            || !mesh_cache::section(*file, record.texturesOffset, record.textureCount, textureRefs)
+            || record.baseIndexCount > record.indexCount || record.vertexCount == 0 || record.indexCount == 0) {
+            cout << "WARNING::MESH_CACHE:: " << CookedMeshPath(path) << " is damaged" << endl;
+            return false;
+        }
+
+        cooked.tiles.assign(tiles, tiles + record.tileCount);
+        for (uint32_t t = 0; t < record.tileCount; t++)
+            cooked.tileBounds.push_back(AABB(glm::vec3(bounds[6 * t], bounds[6 * t + 1], bounds[6 * t + 2]),
+                glm::vec3(bounds[6 * t + 3], bounds[6 * t + 4], bounds[6 * t + 5])));
+        if (record.lodCount > 0)
+            cooked.lods.push_back(cooked.tiles);
+        for (uint32_t l = 1; l < record.lodCount; l++)
+            cooked.lods.push_back(vector<MeshTile>(lods + (l - 1) * record.tileCount, lods + l * record.tileCount));
+
+        vector<TextureStruct> textures;
+        for (uint32_t t = 0; t < record.textureCount; t++) {
+            TextureStruct texture;
+            texture.id = 0;
+            texture.type = string(textureRefs[t].type, strnlen(textureRefs[t].type, sizeof(textureRefs[t].type)));
+            texture.path = aiString(string(textureRefs[t].path, strnlen(textureRefs[t].path, sizeof(textureRefs[t].path))));
+            textures.push_back(texture);
+        }
+        cookedMeshes.emplace_back(std::move(cooked), std::move(textures), record.hasTexture != 0, false);
+    }
+    meshes.swap(cookedMeshes);
+    return true;
+}
+
+// writes the meshes of the model at path in its cooked file (in a temporary file, renamed at the end,
+// so a reader never maps a partial file)
+bool WriteCookedModel(const string& path, GLuint tilesPerSide, GLuint lodLevels, const vector<Mesh>& meshes) {
+    CookedModelHeader header;
+    memset(&header, 0, sizeof(header));
+    if (!mesh_cache::sourceStamp(path, header.sourceSize, header.sourceTime))
+        return false;
+    ScopedTrace trace("write cooked meshes");
+    memcpy(header.magic, "MESH", 4);
+    header.version = MESH_CACHE_VERSION;
+    header.meshCount = (uint32_t)meshes.size();
+    header.tilesPerSide = tilesPerSide;
+    header.lodLevels = lodLevels;
+    header.vertexSize = sizeof(Vertex);
+
+    // offsets of the sections of each mesh
+    vector<CookedMeshRecord> records(meshes.size());
+    uint64_t offset = mesh_cache::align(sizeof(CookedModelHeader)) + mesh_cache::align(meshes.size() * sizeof(CookedMeshRecord));
+    for (size_t m = 0; m < meshes.size(); m++) {
+        const Mesh& mesh = meshes[m];
+        CookedMeshRecord& record = records[m];
+        memset(&record, 0, sizeof(record));
+        record.vertexCount = mesh.VertexCount();
+        record.indexCount = mesh.IndexCount();
+        record.baseIndexCount = mesh.BaseIndexCount();
+        record.tileCount = (uint32_t)mesh.tiles.size();
+        record.lodCount = (uint32_t)mesh.lods.size();
+        record.textureCount = (uint32_t)mesh.textures.size();
+        record.hasTexture = mesh.hasTexture ? 1 : 0;
+        for (int k = 0; k < 3; k++) {
+            record.boundsMin[k] = mesh.bounds.min[k];
+            record.boundsMax[k] = mesh.bounds.max[k];
+        }
+        record.cacheBefore[0] = mesh.cacheBefore.acmr;
+        record.cacheBefore[1] = mesh.cacheBefore.atvr;
+        record.cacheAfter[0] = mesh.cacheAfter.acmr;
+        record.cacheAfter[1] = mesh.cacheAfter.atvr;
+        record.vertexOffset = offset;
+        offset = mesh_cache::align(offset + (uint64_t)record.vertexCount * sizeof(Vertex));
+        record.indexOffset = offset;
+        offset = mesh_cache::align(offset + (uint64_t)record.indexCount * sizeof(GLuint));
+        record.tilesOffset = offset;
+        offset = mesh_cache::align(offset + (uint64_t)record.tileCount * sizeof(MeshTile));
+        offset = mesh_cache::align(offset + (uint64_t)record.tileCount * 6 * sizeof(float));
+        if (record.lodCount > 1)
+            offset = mesh_cache::align(offset + (uint64_t)(record.lodCount - 1) * record.tileCount * sizeof(MeshTile));
+        record.texturesOffset = offset;
+        offset = mesh_cache::align(offset + (uint64_t)record.textureCount * sizeof(CookedTextureRef));
+    }
+
+    string destination = CookedMeshPath(path);
+    string temporary = destination + ".tmp";
+    FILE* file = fopen(temporary.c_str(), "wb");
+    if (!file) {
+        cout << "WARNING::MESH_CACHE:: cannot write " << temporary << endl;
+        return false;
+    }
+    uint64_t written = 0;
+    mesh_cache::writeAt(file, written, &header, sizeof(header));
+    mesh_cache::writeAt(file, written, records.empty() ? NULL : &records[0], records.size() * sizeof(CookedMeshRecord));
+    for (size_t m = 0; m < meshes.size(); m++) {
+        const Mesh& mesh = meshes[m];
+        const CookedMeshRecord& record = records[m];
+        mesh_cache::writeAt(file, written, mesh.VertexData(), record.vertexCount * sizeof(Vertex));
+        mesh_cache::writeAt(file, written, mesh.IndexData(), record.indexCount * sizeof(GLuint));
+        mesh_cache::writeAt(file, written, record.tileCount ? &mesh.tiles[0] : NULL, record.tileCount * sizeof(MeshTile));
+        vector<float> bounds;
+        for (uint32_t t = 0; t < record.tileCount; t++) {
+            const AABB& box = mesh.tileBounds[t];
+            float values[6] = { box.min.x, box.min.y, box.min.z, box.max.x, box.max.y, box.max.z };
+            bounds.insert(bounds.end(), values, values + 6);
+        }
+        mesh_cache::writeAt(file, written, bounds.empty() ? NULL : &bounds[0], bounds.size() * sizeof(float));
+        if (record.lodCount > 1) {
+            mesh_cache::writeAt(file, written, NULL, 0);
+            for (uint32_t l = 1; l < record.lodCount; l++)
+                fwrite(&mesh.lods[l][0], sizeof(MeshTile), record.tileCount, file);
+            written += (uint64_t)(record.lodCount - 1) * record.tileCount * sizeof(MeshTile);
+        }
+        vector<CookedTextureRef> refs(record.textureCount);
+        for (uint32_t t = 0; t < record.textureCount; t++) {
+            memset(&refs[t], 0, sizeof(CookedTextureRef));
+            strncpy(refs[t].type, mesh.textures[t].type.c_str(), sizeof(refs[t].type) - 1);
+            strncpy(refs[t].path, mesh.textures[t].path.C_Str(), sizeof(refs[t].path) - 1);
+        }
+        mesh_cache::writeAt(file, written, refs.empty() ? NULL : &refs[0], refs.size() * sizeof(CookedTextureRef));
+    }
+    bool valid = ferror(file) == 0;
+    fclose(file);
+    // rename does not replace an existing file on every platform
+    remove(destination.c_str());
+    if (!valid || rename(temporary.c_str(), destination.c_str()) != 0) {
+        cout << "WARNING::MESH_CACHE:: cannot write " << destination << endl;
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
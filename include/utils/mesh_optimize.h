@@ -0,0 +1,314 @@
+/*
+Mesh optimization for the GPU
+- vertex cache: the triangles are reordered so that consecutive triangles share vertices, and the GPU reuses the
+  vertex shader results in its post-transform cache instead of running the shader again (Forsyth's algorithm: each
+  vertex has a score, higher if it is in the cache and if few triangles still use it, and the triangle with the highest
+  score among those touching the cache is emitted next)
+- overdraw: the reordered triangles are split in clusters (where the cache order allows it, without losing more than
+  a threshold of its efficiency), and the clusters facing outwards are moved first, so they occlude the others
+- vertex fetch: the vertices are renumbered in the order they are first used, so the GPU reads the vertex buffer
+  almost sequentially
+
+The efficiency is measured with a FIFO cache of VERTEX_CACHE_SIZE entries:
+- ACMR (average cache miss ratio) = vertex shader invocations / triangles: 3 without reuse, about 0.5-0.7 at best
+- ATVR (average transformed vertex ratio) = vertex shader invocations / vertices: 1 is the minimum
+
+References:
+Forsyth - "Linear-Speed Vertex Cache Optimisation"
+Sander, Nehab, Barczak - "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+// size of the post-transform cache used to measure ACMR and ATVR (and to place the overdraw clusters)
+#define VERTEX_CACHE_SIZE 16
+// size of the LRU cache modelled by the vertex cache optimization
+#define FORSYTH_CACHE_SIZE 32
+// largest ACMR increase allowed when splitting the triangles in clusters for the overdraw optimization
+#define OVERDRAW_THRESHOLD 1.05f
+
+/////////////////// VertexCacheStats struct ///////////////////////
+struct VertexCacheStats {
+	float acmr;
+	float atvr;
+};
+
+// cache misses of each triangle of indices[0..indexCount), simulating a FIFO cache of cacheSize entries
+// timestamps: one entry per vertex, with the time of the last miss of the vertex (kept between calls, to continue a simulation)
+static unsigned int SimulateVertexCacheTriangle(const GLuint* triangle, std::vector<unsigned int>& timestamps, unsigned int& time, unsigned int cacheSize)
+{
+	unsigned int misses = 0;
+	for (int k = 0; k < 3; k++)
+	{
+		GLuint v = triangle[k];
+		if (time - timestamps[v] > cacheSize)
+		{
+			timestamps[v] = time++;
+			misses++;
+		}
+	}
+	return misses;
+}
+
+VertexCacheStats AnalyzeVertexCache(const GLuint* indices, size_t indexCount, size_t vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE)
+{
+	VertexCacheStats stats = { 0.0f, 0.0f };
+	if (indexCount < 3 || vertexCount == 0)
+		return stats;
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	std::vector<unsigned char> used(vertexCount, 0);
+	// the first access must always be a miss
+	unsigned int time = cacheSize + 1;
+	size_t misses = 0, usedCount = 0;
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		misses += SimulateVertexCacheTriangle(&indices[t], timestamps, time, cacheSize);
+		for (int k = 0; k < 3; k++)
+			if (!used[indices[t + k]])
+			{
+				used[indices[t + k]] = 1;
+				usedCount++;
+			}
+	}
+	stats.acmr = (float)misses / (float)(indexCount / 3);
+	stats.atvr = (float)misses / (float)usedCount;
+	return stats;
+}
+
+// Reordering of the triangles in indices[0..indexCount) for the vertex cache (Forsyth)
+void OptimizeVertexCache(GLuint* indices, size_t indexCount, size_t vertexCount)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	// scores of a vertex for its position in the cache, and for the number of triangles still using it
+	const int maxValence = 32;
+	float cacheScore[FORSYTH_CACHE_SIZE];
+	float valenceScore[maxValence + 1];
+	for (int i = 0; i < FORSYTH_CACHE_SIZE; i++)
+		// the last triangle gets a fixed score, so its vertices are not preferred over the others in the cache
+		cacheScore[i] = i < 3 ? 0.75f : powf(1.0f - (float)(i - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+	valenceScore[0] = 0.0f;
+	for (int i = 1; i <= maxValence; i++)
+		valenceScore[i] = 2.0f / sqrtf((float)i);
+
+	// triangles using each vertex (the first remaining[v] of the list of v are not emitted yet)
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+	std::vector<size_t> firstTriangle(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		firstTriangle[v + 1] = firstTriangle[v] + remaining[v];
+	std::vector<unsigned int> vertexTriangles(triangleCount * 3);
+	{
+		std::vector<size_t> cursor(firstTriangle.begin(), firstTriangle.end() - 1);
+		for (size_t t = 0; t < triangleCount; t++)
+			for (int k = 0; k < 3; k++)
+				vertexTriangles[cursor[indices[3 * t + k]]++] = (unsigned int)t;
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount, 0.0f);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = remaining[v] > 0 ? valenceScore[std::min((int)remaining[v], maxValence)] : 0.0f;
+	std::vector<float> triangleScore(triangleCount);
+	for (size_t t = 0; t < triangleCount; t++)
+		triangleScore[t] = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+	std::vector<unsigned char> emitted(triangleCount, 0);
+
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+	std::vector<GLuint> cache, newCache;
+	cache.reserve(FORSYTH_CACHE_SIZE + 3);
+	newCache.reserve(FORSYTH_CACHE_SIZE + 3);
+	// without candidates in the cache, the next triangle not emitted (in input order) starts again
+	size_t deadEndCursor = 0;
+	long long best = 0;
+	for (size_t t = 1; t < triangleCount; t++)
+		if (triangleScore[t] > triangleScore[best])
+			best = (long long)t;
+
+	for (size_t emittedCount = 0; emittedCount < triangleCount; emittedCount++)
+	{
+		if (best < 0)
+		{
+			while (emitted[deadEndCursor])
+				deadEndCursor++;
+			best = (long long)deadEndCursor;
+		}
+		const GLuint* triangle = &indices[3 * best];
+		output.insert(output.end(), triangle, triangle + 3);
+		emitted[best] = 1;
+
+		// the triangle is removed from the lists of its vertices
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint v = triangle[k];
+			unsigned int* list = &vertexTriangles[firstTriangle[v]];
+			for (unsigned int i = 0; i < remaining[v]; i++)
+				if (list[i] == (unsigned int)best)
+				{
+					std::swap(list[i], list[remaining[v] - 1]);
+					break;
+				}
+			remaining[v]--;
+		}
+
+		// the vertices of the triangle go on top of the cache, the others are pushed down
+		newCache.assign(triangle, triangle + 3);
+		for (size_t i = 0; i < cache.size(); i++)
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2])
+				newCache.push_back(cache[i]);
+
+		// scores of the vertices in the cache (and of those just evicted), and of their triangles
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			GLuint v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? (int)i : -1;
+			float score = 0.0f;
+			if (remaining[v] > 0)
+			{
+				score = valenceScore[std::min((int)remaining[v], maxValence)];
+				if (cachePosition[v] >= 0)
+					score += cacheScore[cachePosition[v]];
+			}
+			vertexScore[v] = score;
+		}
+		for (size_t i = 0; i < newCache.size(); i++)
+		{
+			GLuint v = newCache[i];
+			const unsigned int* list = &vertexTriangles[firstTriangle[v]];
+			for (unsigned int j = 0; j < remaining[v]; j++)
+			{
+				unsigned int t = list[j];
+				float score = vertexScore[indices[3 * t]] + vertexScore[indices[3 * t + 1]] + vertexScore[indices[3 * t + 2]];
+				triangleScore[t] = score;
+				if (score > bestScore)
+				{
+					bestScore = score;
+					best = (long long)t;
+				}
+			}
+		}
+		if (newCache.size() > FORSYTH_CACHE_SIZE)
+			newCache.resize(FORSYTH_CACHE_SIZE);
+		cache.swap(newCache);
+	}
+	std::copy(output.begin(), output.end(), indices);
+}
+
+// Reordering of the triangles in indices[0..indexCount) to reduce overdraw, keeping most of the vertex cache order
+// (run it after OptimizeVertexCache). Positions are read from positionData with a stride in bytes
+void OptimizeOverdraw(GLuint* indices, size_t indexCount, const GLubyte* positionData, size_t stride, size_t vertexCount, float threshold = OVERDRAW_THRESHOLD)
+{
+	size_t triangleCount = indexCount / 3;
+	if (triangleCount < 2)
+		return;
+
+	#define OVERDRAW_POSITION(i) (*(const glm::vec3*)(positionData + (size_t)(i) * stride))
+
+	// 1) hard boundaries: triangles with 3 misses, where the cache starts again anyway
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = VERTEX_CACHE_SIZE + 1;
+	std::vector<size_t> hard;
+	for (size_t t = 0; t < triangleCount; t++)
+		if (SimulateVertexCacheTriangle(&indices[3 * t], timestamps, time, VERTEX_CACHE_SIZE) == 3 || t == 0)
+			hard.push_back(t);
+	hard.push_back(triangleCount);
+
+	// 2) soft boundaries: a hard cluster is split as soon as the ACMR of the current part gets within threshold of the
+	// ACMR of the whole cluster
+	std::vector<size_t> clusters;
+	for (size_t h = 0; h + 1 < hard.size(); h++)
+	{
+		size_t start = hard[h], end = hard[h + 1];
+		time += VERTEX_CACHE_SIZE + 1;
+		size_t clusterMisses = 0;
+		for (size_t t = start; t < end; t++)
+			clusterMisses += SimulateVertexCacheTriangle(&indices[3 * t], timestamps, time, VERTEX_CACHE_SIZE);
+		float clusterThreshold = threshold * (float)clusterMisses / (float)(end - start);
+
+		clusters.push_back(start);
+		time += VERTEX_CACHE_SIZE + 1;
+		size_t runningMisses = 0, runningTriangles = 0;
+		for (size_t t = start; t < end; t++)
+		{
+			runningMisses += SimulateVertexCacheTriangle(&indices[3 * t], timestamps, time, VERTEX_CACHE_SIZE);
+			runningTriangles++;
+			if ((float)runningMisses / (float)runningTriangles <= clusterThreshold && t + 1 < end)
+			{
+				clusters.push_back(t + 1);
+				time += VERTEX_CACHE_SIZE + 1;
+				runningMisses = runningTriangles = 0;
+			}
+		}
+	}
+	clusters.push_back(triangleCount);
+
+	// 3) the clusters facing away from the center of the mesh are drawn first
+	glm::dvec3 meshCentroid(0.0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		meshCentroid += glm::dvec3(OVERDRAW_POSITION(indices[i]));
+	meshCentroid /= (double)(triangleCount * 3);
+
+	size_t clusterCount = clusters.size() - 1;
+	std::vector<float> facing(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+	{
+		glm::dvec3 centroid(0.0), normal(0.0);
+		double area = 0.0;
+		for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+		{
+			glm::dvec3 p0(OVERDRAW_POSITION(indices[3 * t])), p1(OVERDRAW_POSITION(indices[3 * t + 1])), p2(OVERDRAW_POSITION(indices[3 * t + 2]));
+			glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+			double triangleArea = glm::length(n);
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0);
+			normal += n;
+			area += triangleArea;
+		}
+		double normalLength = glm::length(normal);
+		if (area > 0.0)
+			centroid /= area;
+		if (normalLength > 0.0)
+			normal /= normalLength;
+		facing[c] = (float)glm::dot(centroid - meshCentroid, normal);
+	}
+	#undef OVERDRAW_POSITION
+
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++)
+		order[c] = c;
+	std::stable_sort(order.begin(), order.end(), [&facing](size_t a, size_t b) { return facing[a] > facing[b]; });
+
+	std::vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+	for (size_t i = 0; i < clusterCount; i++)
+		output.insert(output.end(), indices + 3 * clusters[order[i]], indices + 3 * clusters[order[i] + 1]);
+	std::copy(output.begin(), output.end(), indices);
+}
+
+// Renumbering of the vertices in the order they are first used by indices[0..indexCount) (the indices are updated).
+// remap[old vertex] = new vertex, or ~0u if the vertex is not used. Returns the number of vertices used
+size_t OptimizeVertexFetch(GLuint* indices, size_t indexCount, size_t vertexCount, std::vector<GLuint>& remap)
+{
+	remap.assign(vertexCount, ~0u);
+	GLuint next = 0;
+	for (size_t i = 0; i < indexCount; i++)
+	{
+		GLuint& v = remap[indices[i]];
+		if (v == ~0u)
+			v = next++;
+		indices[i] = v;
+	}
+	return next;
+}
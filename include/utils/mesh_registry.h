@@ -0,0 +1,162 @@
+/*
+Mesh registry
+- a model needed by several users (e.g., rendered with OpenGL and simulated by Bullet) is parsed once: the registry
+  keeps the assets in use by path (and tiling parameters), and a request for an asset still in use gets the same one
+- the users share the CPU copy of the vertices and indices of each mesh (MeshGeometry, reference counted): the GL
+  meshes read it once for the upload and release it, the collision shape (CollisionMesh, a btTriangleIndexVertexArray)
+  reads the triangles from it for the whole simulation, without copying them, or builds a simplified copy from it.
+  It is freed when the last user releases it
+- assets can be requested from any thread (e.g., the workers of AssetLoader)
+
+Usage:
+    shared_ptr<MeshAsset> asset = meshRegistry.Acquire(path, tilesPerSide, lodLevels);
+    model.meshes = asset->meshes;                       // the copies share the geometry
+    CollisionMesh* triangles = new CollisionMesh(asset, 256);  // for a btBvhTriangleMeshShape (0 = full detail)
+    model.Upload();                                     // the meshes release the geometry, the collision mesh keeps it
+*/
+
+#pragma once
+using namespace std;
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <bullet\src\btBulletCollisionCommon.h>
+
+#include <utils/model_v2.h>
+#include <utils/tracer.h>
+
+// a parsed model: its meshes are not uploaded, and can be copied in any number of Models
+struct MeshAsset {
+    string path;
+    // folder of the model (for its textures)
+    string directory;
+    vector<Mesh> meshes;
+};
+
+/////////////////// CollisionMesh class ///////////////////////
+// triangles of an asset for a Bullet concave shape. The skirts of the tiles are left out: they hang below the surface.
+// cellsPerSide = 0: each tile of each mesh is a part pointing in the index buffer of the mesh, and all the parts of a
+//   mesh point to its vertices (Bullet reads only the positions, with the stride of Vertex): nothing is copied
+// cellsPerSide > 0: the surface is simplified by clustering, with cells of size (largest side of the asset / cellsPerSide),
+//   in a copy owned by the collision mesh. The levels of detail of the tiles are not used: they have cracks between
+//   the tiles, hidden only on screen by the skirts
+class CollisionMesh : public btTriangleIndexVertexArray {
+public:
+    CollisionMesh(const shared_ptr<MeshAsset>& asset, GLuint cellsPerSide = 0)
+    {
+        float cellSize = 0.0f;
+        if (cellsPerSide > 0) {
+            AABB bounds;
+            for (size_t m = 0; m < asset->meshes.size(); m++)
+                bounds.Extend(asset->meshes[m].bounds);
+            glm::vec3 size = bounds.max - bounds.min;
+            cellSize = glm::max(size.x, glm::max(size.y, size.z)) / cellsPerSide;
+            this->simplified.resize(asset->meshes.size());
+        }
+
+        for (size_t m = 0; m < asset->meshes.size(); m++) {
+            const Mesh& mesh = asset->meshes[m];
+            if (!mesh.geometry)
+                continue;
+            vector<MeshTile> ranges = mesh.tiles;
+            if (ranges.empty()) {
+                MeshTile whole = { 0, mesh.BaseIndexCount(), mesh.BaseIndexCount(), 0.0f };
+                ranges.push_back(whole);
+            }
+
+            if (cellSize > 0.0f) {
+                this->addSimplified(mesh, ranges, cellSize, this->simplified[m]);
+                continue;
+            }
+            for (size_t r = 0; r < ranges.size(); r++) {
+                if (ranges[r].surfaceCount < 3)
+                    continue;
+                btIndexedMesh part;
+                part.m_numTriangles = ranges[r].surfaceCount / 3;
+                part.m_triangleIndexBase = (const unsigned char*)(mesh.geometry->Indices() + ranges[r].firstIndex);
+                part.m_triangleIndexStride = 3 * sizeof(GLuint);
+                part.m_numVertices = mesh.geometry->VertexCount();
+                part.m_vertexBase = (const unsigned char*)&mesh.geometry->Vertices()->Position;
+                part.m_vertexStride = sizeof(Vertex);
+                part.m_vertexType = PHY_FLOAT;
+                this->addIndexedMesh(part, PHY_INTEGER);
+            }
+            this->geometry.push_back(mesh.geometry);
+        }
+    }
+
+private:
+    // the memory pointed by the parts: the geometry of the asset, or the simplified copy of each mesh
+    vector<shared_ptr<MeshGeometry> > geometry;
+    vector<SimplifiedMesh> simplified;
+
+    // one part with the full detail surface of the tiles of mesh, clustered
+    void addSimplified(const Mesh& mesh, const vector<MeshTile>& ranges, float cellSize, SimplifiedMesh& out)
+    {
+        vector<GLuint> surface;
+        const GLuint* meshIndices = mesh.geometry->Indices();
+        for (size_t r = 0; r < ranges.size(); r++)
+            surface.insert(surface.end(), meshIndices + ranges[r].firstIndex, meshIndices + ranges[r].firstIndex + ranges[r].surfaceCount);
+        SimplifyByClustering((const GLubyte*)&mesh.geometry->Vertices()->Position, sizeof(Vertex), surface.empty() ? NULL : &surface[0], surface.size(), cellSize, out);
+        if (out.indices.size() < 3)
+            return;
+        btIndexedMesh part;
+        part.m_numTriangles = out.indices.size() / 3;
+        part.m_triangleIndexBase = (const unsigned char*)&out.indices[0];
+        part.m_triangleIndexStride = 3 * sizeof(GLuint);
+        part.m_numVertices = out.positions.size();
+        part.m_vertexBase = (const unsigned char*)&out.positions[0];
+        part.m_vertexStride = sizeof(glm::vec3);
+        part.m_vertexType = PHY_FLOAT;
+        this->addIndexedMesh(part, PHY_INTEGER);
+    }
+};
+
+/////////////////// MeshRegistry class ///////////////////////
+class MeshRegistry {
+public:
+    // the model at path, parsed now if no one is using it. Two threads asking for the same model get the same
+    // asset: the second one waits for the parsing of the first one. threads: see Model::Parse
+    shared_ptr<MeshAsset> Acquire(const string& path, GLuint tilesPerSide = 0, GLuint lodLevels = 0, unsigned int threads = 0)
+    {
+        string key = path + "#" + to_string(tilesPerSide) + "x" + to_string(lodLevels);
+        shared_ptr<Entry> entry;
+        {
+            lock_guard<mutex> lock(this->entriesMutex);
+            shared_ptr<Entry>& slot = this->entries[key];
+            if (!slot)
+                slot.reset(new Entry());
+            entry = slot;
+        }
+
+        lock_guard<mutex> lock(entry->loading);
+        shared_ptr<MeshAsset> asset = entry->asset.lock();
+        if (asset)
+            return asset;
+        ScopedTrace trace("MeshRegistry::Acquire");
+        Model model(tilesPerSide, lodLevels);
+        model.Parse(path, threads);
+        asset.reset(new MeshAsset());
+        asset->path = path;
+        asset->directory = model.directory;
+        asset->meshes.swap(model.meshes);
+        entry->asset = asset;
+        return asset;
+    }
+
+private:
+    struct Entry {
+        // held only by the users: it expires when the last one releases it
+        weak_ptr<MeshAsset> asset;
+        mutex loading;
+    };
+
+    map<string, shared_ptr<Entry> > entries;
+    mutex entriesMutex;
+};
+
+MeshRegistry meshRegistry;
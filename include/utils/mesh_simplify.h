@@ -0,0 +1,255 @@
+/*
+Mesh simplification by vertex clustering
+- the space is divided in cubic cells, and all the vertices inside a cell are collapsed in a single vertex
+- the position of the new vertex minimizes the sum of the squared distances from the planes of the triangles around
+  the original vertices (quadric error metric), so sharp features like ridges and crater rims are preserved
+- triangles with two or more vertices in the same cell are removed
+
+Cell size controls the level of detail: doubling the cell size gives (more or less) a quarter of the triangles.
+
+The geometric error of the result is estimated as the largest distance between a collapsed vertex and
+the planes of the triangles around the original vertex.
+
+References:
+Garland, Heckbert - "Surface Simplification Using Quadric Error Metrics"
+Lindstrom - "Out-of-Core Simplification of Large Polygonal Models"
+*/
+
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+/////////////////// Quadric struct ///////////////////////
+// symmetric 4x4 matrix (10 coefficients) accumulating squared distances from planes
+struct Quadric {
+	double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+
+	Quadric() : a2(0), ab(0), ac(0), ad(0), b2(0), bc(0), bd(0), c2(0), cd(0), d2(0) {}
+
+	// plane: n.x*x + n.y*y + n.z*z + d = 0, with n normalized
+	void AddPlane(glm::dvec3 n, double d, double weight) {
+		a2 += weight * n.x * n.x; ab += weight * n.x * n.y; ac += weight * n.x * n.z; ad += weight * n.x * d;
+		b2 += weight * n.y * n.y; bc += weight * n.y * n.z; bd += weight * n.y * d;
+		c2 += weight * n.z * n.z; cd += weight * n.z * d;
+		d2 += weight * d * d;
+	}
+
+	void Add(const Quadric& q) {
+		a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+		b2 += q.b2; bc += q.bc; bd += q.bd;
+		c2 += q.c2; cd += q.cd;
+		d2 += q.d2;
+	}
+
+	// sum of the (weighted) squared distances of p from the planes
+	double Evaluate(glm::dvec3 p) const {
+		return a2 * p.x * p.x + 2 * ab * p.x * p.y + 2 * ac * p.x * p.z + 2 * ad * p.x
+			+ b2 * p.y * p.y + 2 * bc * p.y * p.z + 2 * bd * p.y
+			+ c2 * p.z * p.z + 2 * cd * p.z
+			+ d2;
+	}
+
+	// point with the minimum error. Returns false if the system is ill-conditioned (e.g., all the planes are parallel)
+	bool Minimize(glm::dvec3& p) const {
+		double det = a2 * (b2 * c2 - bc * bc) - ab * (ab * c2 - bc * ac) + ac * (ab * bc - b2 * ac);
+		double scale = a2 + b2 + c2;
+		if (fabs(det) < 1e-6 * scale * scale * scale)
+			return false;
+		// Cramer's rule on A p = -b
+		double bx = -ad, by = -bd, bz = -cd;
+		p.x = (bx * (b2 * c2 - bc * bc) - ab * (by * c2 - bc * bz) + ac * (by * bc - b2 * bz)) / det;
+		p.y = (a2 * (by * c2 - bc * bz) - bx * (ab * c2 - bc * ac) + ac * (ab * bz - by * ac)) / det;
+		p.z = (a2 * (b2 * bz - by * bc) - ab * (ab * bz - by * ac) + bx * (ab * bc - b2 * ac)) / det;
+		return true;
+	}
+};
+
+/////////////////// SimplifiedMesh struct ///////////////////////
+struct SimplifiedMesh {
+	// position of each new vertex
+	std::vector<glm::vec3> positions;
+	// for each new vertex, the original vertex nearest to it (used to copy normals, UVs, etc.)
+	std::vector<GLuint> sourceVertex;
+	// triangles, referring to the new vertices
+	std::vector<GLuint> indices;
+	// estimated geometric error, in the same units of the positions
+	float error;
+};
+
+// Simplification of the triangles in indices[0..indexCount).
+// Positions are read from positionData with a stride in bytes, so the vertex array of a Mesh can be used directly.
+void SimplifyByClustering(const GLubyte* positionData, size_t stride, const GLuint* indices, size_t indexCount, float cellSize, SimplifiedMesh& out)
+{
+	out.positions.clear();
+	out.sourceVertex.clear();
+	out.indices.clear();
+	out.error = 0.0f;
+	if (indexCount < 3 || cellSize <= 0.0f)
+		return;
+
+	#define SIMPLIFY_POSITION(i) (*(const glm::vec3*)(positionData + (size_t)(i) * stride))
+
+	// 1) per-vertex quadrics, from the planes of the triangles (weighted by area)
+	std::unordered_map<GLuint, Quadric> vertexQuadric;
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		glm::dvec3 p0(SIMPLIFY_POSITION(indices[t])), p1(SIMPLIFY_POSITION(indices[t + 1])), p2(SIMPLIFY_POSITION(indices[t + 2]));
+		glm::dvec3 n = glm::cross(p1 - p0, p2 - p0);
+		double length = glm::length(n);
+		Quadric& q0 = vertexQuadric[indices[t]];
+		Quadric& q1 = vertexQuadric[indices[t + 1]];
+		Quadric& q2 = vertexQuadric[indices[t + 2]];
+		if (length <= 0.0)
+			continue;
+		n /= length;
+		double d = -glm::dot(n, p0);
+		double area = 0.5 * length;
+		q0.AddPlane(n, d, area);
+		q1.AddPlane(n, d, area);
+		q2.AddPlane(n, d, area);
+	}
+
+	// 2) vertices are assigned to the cells
+	struct Cluster {
+		Quadric q;
+		glm::dvec3 sum;
+		int count;
+		GLuint output;
+	};
+	std::vector<Cluster> clusters;
+	std::unordered_map<unsigned long long, GLuint> clusterOfCell;
+	std::unordered_map<GLuint, GLuint> clusterOfVertex;
+	clusterOfVertex.reserve(vertexQuadric.size());
+	for (std::unordered_map<GLuint, Quadric>::const_iterator it = vertexQuadric.begin(); it != vertexQuadric.end(); ++it)
+	{
+		glm::vec3 p = SIMPLIFY_POSITION(it->first);
+		// 21 bits per axis are enough for 2 million cells per side
+		unsigned long long cx = (unsigned long long)((long long)floor(p.x / cellSize) + (1 << 20)) & 0x1FFFFF;
+		unsigned long long cy = (unsigned long long)((long long)floor(p.y / cellSize) + (1 << 20)) & 0x1FFFFF;
+		unsigned long long cz = (unsigned long long)((long long)floor(p.z / cellSize) + (1 << 20)) & 0x1FFFFF;
+		unsigned long long key = (cx << 42) | (cy << 21) | cz;
+		std::unordered_map<unsigned long long, GLuint>::iterator cell = clusterOfCell.find(key);
+		GLuint c;
+		if (cell == clusterOfCell.end())
+		{
+			c = (GLuint)clusters.size();
+			clusterOfCell[key] = c;
+			Cluster cluster;
+			cluster.sum = glm::dvec3(0.0);
+			cluster.count = 0;
+			cluster.output = 0;
+			clusters.push_back(cluster);
+		}
+		else
+			c = cell->second;
+		clusters[c].q.Add(it->second);
+		clusters[c].sum += glm::dvec3(p);
+		clusters[c].count++;
+		clusterOfVertex[it->first] = c;
+	}
+
+	// 3) position of the new vertices: minimum of the quadric, if it falls near the cell, otherwise the average position
+	for (GLuint c = 0; c < clusters.size(); c++)
+	{
+		glm::dvec3 mean = clusters[c].sum / (double)clusters[c].count;
+		glm::dvec3 p;
+		if (!clusters[c].q.Minimize(p) || glm::length(p - mean) > cellSize)
+			p = mean;
+		clusters[c].output = (GLuint)out.positions.size();
+		out.positions.push_back(glm::vec3(p));
+		out.sourceVertex.push_back(0);
+	}
+
+	// 4) nearest original vertex for the attributes, and error estimation
+	std::vector<float> nearest(out.positions.size(), -1.0f);
+	double maxError = 0.0;
+	for (std::unordered_map<GLuint, GLuint>::const_iterator it = clusterOfVertex.begin(); it != clusterOfVertex.end(); ++it)
+	{
+		GLuint v = clusters[it->second].output;
+		glm::vec3 p = SIMPLIFY_POSITION(it->first);
+		float distance = glm::length(p - out.positions[v]);
+		if (nearest[v] < 0.0f || distance < nearest[v])
+		{
+			nearest[v] = distance;
+			out.sourceVertex[v] = it->first;
+		}
+		// the quadric of the original vertex is normalized by the area of its triangles
+		const Quadric& q = vertexQuadric[it->first];
+		double weight = q.a2 + q.b2 + q.c2;
+		if (weight > 0.0)
+			maxError = std::max(maxError, q.Evaluate(glm::dvec3(out.positions[v])) / weight);
+	}
+	out.error = (float)sqrt(maxError);
+
+	// 5) triangles: degenerate ones are removed, duplicates are removed (the orientation is preserved)
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		GLuint a = clusters[clusterOfVertex[indices[t]]].output;
+		GLuint b = clusters[clusterOfVertex[indices[t + 1]]].output;
+		GLuint c = clusters[clusterOfVertex[indices[t + 2]]].output;
+		if (a == b || b == c || a == c)
+			continue;
+		// rotation with the smallest index first, to recognize duplicates
+		while (a > b || a > c) { GLuint tmp = a; a = b; b = c; c = tmp; }
+		out.indices.push_back(a);
+		out.indices.push_back(b);
+		out.indices.push_back(c);
+	}
+	// duplicates: the triangles are sorted by their indices, so equal triangles are adjacent
+	std::vector<size_t> order(out.indices.size() / 3);
+	for (size_t t = 0; t < order.size(); t++)
+		order[t] = t;
+	std::sort(order.begin(), order.end(), [&out](size_t x, size_t y) {
+		for (int k = 0; k < 3; k++)
+			if (out.indices[3 * x + k] != out.indices[3 * y + k])
+				return out.indices[3 * x + k] < out.indices[3 * y + k];
+		return x < y;
+	});
+	std::vector<bool> keep(order.size(), true);
+	for (size_t t = 1; t < order.size(); t++)
+		if (std::equal(&out.indices[3 * order[t]], &out.indices[3 * order[t]] + 3, &out.indices[3 * order[t - 1]]))
+			keep[order[t]] = false;
+	size_t written = 0;
+	for (size_t t = 0; t < keep.size(); t++)
+	{
+		if (!keep[t])
+			continue;
+		for (int k = 0; k < 3; k++)
+			out.indices[3 * written + k] = out.indices[3 * t + k];
+		written++;
+	}
+	out.indices.resize(3 * written);
+
+	#undef SIMPLIFY_POSITION
+}
+
+// edges used by a single triangle (border of the mesh), with the orientation of the triangle
+void FindBoundaryEdges(const GLuint* indices, size_t indexCount, std::vector<std::pair<GLuint, GLuint> >& edges)
+{
+	edges.clear();
+	std::unordered_map<unsigned long long, int> count;
+	std::vector<std::pair<GLuint, GLuint> > all;
+	for (size_t t = 0; t + 2 < indexCount; t += 3)
+	{
+		for (int k = 0; k < 3; k++)
+		{
+			GLuint a = indices[t + k], b = indices[t + (k + 1) % 3];
+			unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+			count[key]++;
+			all.push_back(std::make_pair(a, b));
+		}
+	}
+	for (size_t e = 0; e < all.size(); e++)
+	{
+		GLuint a = all[e].first, b = all[e].second;
+		unsigned long long key = ((unsigned long long)std::min(a, b) << 32) | std::max(a, b);
+		if (count[key] == 1)
+			edges.push_back(all[e]);
+	}
+}
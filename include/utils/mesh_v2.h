@@ -28,12 +28,20 @@ using namespace std;
 #include <sstream>
 #include <iostream>
 #include <vector>
+#include <map>
+#include <memory>
+#include <cstring>
 
 // GL Includes
 #include <glad/glad.h> // Contains all the necessery OpenGL includes
 // we use GLM data structures to write data in the VBO, VAO and EBO buffers
 #include <glm/glm.hpp>
 
+#include <utils/frustum.h>
+#include <utils/mesh_simplify.h>
+#include <utils/mesh_optimize.h>
+#include <utils/mapped_file.h>
+
 // data structure for vertices
 struct Vertex {
     // vertex coordinates
@@ -48,6 +56,16 @@ struct Vertex {
     glm::vec3 Bitangent;
 };
 
+// per-instance data of an instanced draw (see Mesh::DrawInstanced), read from a buffer with divisor 1
+struct InstanceTransform {
+    glm::mat4 modelMatrix;
+    // transpose of the inverse of the model-view matrix
+    glm::mat3 normalMatrix;
+};
+
+// first attribute location of InstanceTransform: 4 locations for the model matrix, 3 for the normal matrix
+#define INSTANCE_ATTRIBUTE_LOCATION 5
+
 // data structure for textures
 struct TextureStruct {
     GLuint id;
@@ -55,88 +73,351 @@ struct TextureStruct {
     aiString path;
 };
 
-/////////////////// MESH class ///////////////////////
-class Mesh {
+// texture units reserved to each kind of texture: the N-th texture of a kind is bound to unit (base + N - 1)
+// the layout is the same for every material, so the sampler uniforms of a Shader Program are valid for all the meshes
+#define MATERIAL_SLOTS_PER_TYPE 4
+
+// a texture of the material, with the texture unit and the name of the sampler resolved at load time
+struct MaterialSampler {
+    GLuint unit;
+    GLuint textureId;
+    string uniformName;
+};
+
+/////////////////// MATERIAL class ///////////////////////
+// Sampler names and texture units are computed once when the mesh is created.
+// Uniform locations are resolved the first time the material is used with a Shader Program, and then reused.
+class Material {
 public:
-    // data structures for vertices, and indices of vertices (for faces)
+    vector<MaterialSampler> samplers;
+    bool hasTexture;
+
+    Material() : hasTexture(false) {}
+
+    Material(const vector<TextureStruct>& textures, bool hasTexture)
+    {
+        this->hasTexture = hasTexture;
+        // counters for the N in texture_diffuseN, texture_specularN, ...
+        GLuint counters[4] = { 0, 0, 0, 0 };
+        for (GLuint i = 0; i < textures.size(); i++)
+        {
+            int type = TypeIndex(textures[i].type);
+            if (type < 0 || counters[type] >= MATERIAL_SLOTS_PER_TYPE)
+            {
+                cout << "WARNING::MATERIAL:: texture " << textures[i].path.C_Str() << " ignored (type " << textures[i].type << ")" << endl;
+                continue;
+            }
+            MaterialSampler sampler;
+            sampler.unit = type * MATERIAL_SLOTS_PER_TYPE + counters[type];
+            sampler.textureId = textures[i].id;
+            sampler.uniformName = textures[i].type + to_string(++counters[type]);
+            this->samplers.push_back(sampler);
+        }
+    }
+
+    // the Shader Program is made active, the textures are bound to their units and the per-material uniforms are set
+    void Bind(const Shader& shader)
+    {
+        shader.Use();
+        const ProgramBinding& binding = this->resolve(shader.Program);
+        for (GLuint i = 0; i < this->samplers.size(); i++)
+            glState.BindTextureUnit(this->samplers[i].unit, GL_TEXTURE_2D, this->samplers[i].textureId);
+        if (binding.hasTextureLocation >= 0)
+            glUniform1i(binding.hasTextureLocation, this->hasTexture);
+    }
+
+private:
+    // uniform locations of a Shader Program
+    struct ProgramBinding {
+        GLuint program;
+        GLint hasTextureLocation;
+    };
+    // we have very few Shader Programs, so a linear scan is enough
+    vector<ProgramBinding> bindings;
+
+    const ProgramBinding& resolve(GLuint program)
+    {
+        for (GLuint i = 0; i < this->bindings.size(); i++)
+            if (this->bindings[i].program == program)
+                return this->bindings[i];
+
+        // first use with this program (which is active): locations are retrieved, and the sampler uniforms are set
+        // once and for all, because they are part of the state of the program and the units layout is fixed
+        ProgramBinding binding;
+        binding.program = program;
+        binding.hasTextureLocation = glGetUniformLocation(program, "hasTexture");
+        for (GLuint i = 0; i < this->samplers.size(); i++)
+        {
+            GLint location = glGetUniformLocation(program, this->samplers[i].uniformName.c_str());
+            if (location >= 0)
+                glUniform1i(location, this->samplers[i].unit);
+        }
+        glCheckError();
+        this->bindings.push_back(binding);
+        return this->bindings.back();
+    }
+
+    static int TypeIndex(const string& type)
+    {
+        if (type == "texture_diffuse") return 0;
+        if (type == "texture_specular") return 1;
+        if (type == "texture_normal") return 2;
+        if (type == "texture_height") return 3;
+        return -1;
+    }
+};
+
+// meshes with less triangles than this are not split in tiles (culling would cost more than drawing them)
+#define MESH_TILE_MIN_TRIANGLES 8192
+
+// a tile of a mesh split on a grid: a contiguous range of the index buffer
+// (surface triangles first, then the triangles of the skirt)
+struct MeshTile {
+    GLuint firstIndex;
+    GLuint indexCount;
+    GLuint surfaceCount;
+    // geometric error of the tile at its level of detail (0 for the original triangles), in local units
+    float error;
+};
+
+// CPU copy of the vertices and indices of a mesh: in its own vectors, or in a mapped file (cooked mesh, see mesh_cache.h).
+// It is shared by the objects reading it (the GL upload of the mesh, a collision shape, see mesh_registry.h),
+// and freed with the last of them
+struct MeshGeometry {
     vector<Vertex> vertices;
     vector<GLuint> indices;
+    // cooked mesh: the file with vertices and indices (at the given offsets), kept mapped while the geometry exists
+    shared_ptr<MappedFile> file;
+    size_t vertexOffset, indexOffset;
+    GLuint vertexCount, indexCount;
+
+    MeshGeometry() : vertexOffset(0), indexOffset(0), vertexCount(0), indexCount(0) {}
+
+    const Vertex* Vertices() const { return this->file ? (const Vertex*)(this->file->Data() + this->vertexOffset) : &this->vertices[0]; }
+    const GLuint* Indices() const { return this->file ? (const GLuint*)(this->file->Data() + this->indexOffset) : &this->indices[0]; }
+    GLuint VertexCount() const { return this->file ? this->vertexCount : (GLuint)this->vertices.size(); }
+    GLuint IndexCount() const { return this->file ? this->indexCount : (GLuint)this->indices.size(); }
+};
+
+// a mesh read from a cooked file (see mesh_cache.h): vertices and indices stay in the mapped file,
+// tiles and levels of detail are ready
+struct CookedMesh {
+    shared_ptr<MeshGeometry> geometry;
+    GLuint baseIndexCount;
+    AABB bounds;
+    vector<MeshTile> tiles;
+    vector<AABB> tileBounds;
+    vector<vector<MeshTile> > lods;
+    VertexCacheStats cacheBefore, cacheAfter;
+};
+
+// parameters for the choice of the level of detail of each tile
+struct LodSelection {
+    // camera position, in the local space of the mesh
+    glm::vec3 viewPosition;
+    // pixels covered by 1 unit at distance 1 (= projection[1][1] * screenHeight / 2)
+    float pixelsPerUnit;
+    // largest error allowed on screen, in pixels
+    float maxPixelError;
+};
+
+/////////////////// MESH class ///////////////////////
+class Mesh {
+public:
+    // vertices, and indices of vertices (for faces): shared with the other users of the geometry, and released
+    // by ReleaseGeometry when the GL buffers do not need them anymore
+    shared_ptr<MeshGeometry> geometry;
     // data structures for textures
     vector<TextureStruct> textures;
-	
-	bool hasTexture;
+    // textures and uniforms, prepared for rendering
+    Material material;
+
+    bool hasTexture;
+
+    // bounding box of the mesh, in local coordinates
+    AABB bounds;
+    // tiles (empty if the mesh has not been split), and their bounding boxes in local coordinates
+    vector<MeshTile> tiles;
+    vector<AABB> tileBounds;
+    // levels of detail of the tiles (lods[level][tile]): lods[0] is equal to tiles. Empty if no LOD has been built
+    vector<vector<MeshTile> > lods;
+    // number of tiles and number of triangles drawn in the last frustum-culled Draw
+    GLuint visibleTiles;
+    GLuint drawnTriangles;
+    // efficiency of the vertex cache (ACMR, ATVR) with the triangles in the order of the file, and after the optimization
+    VertexCacheStats cacheBefore, cacheAfter;
 
     // VAO
     GLuint VAO;
 
     //////////////////////////////////////////
     // Constructor
-    Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<TextureStruct> textures, bool hasTexture)
+    // if tilesPerSide > 0 and the mesh is big enough, the triangles are split on a tilesPerSide x tilesPerSide grid
+    // if lodLevels > 0, lodLevels simplified versions of each tile are built too
+    // then triangles and vertices are reordered for the vertex cache, the overdraw and the vertex fetch (see mesh_optimize.h)
+    // if upload is false, no GL call is made (e.g., on a loading thread): Upload() must be called later, on the thread of the context
+    // the vectors are moved in the mesh: pass them with std::move, so the geometry is never copied
+    Mesh(vector<Vertex> vertices, vector<GLuint> indices, vector<TextureStruct> textures, bool hasTexture, GLuint tilesPerSide = 0, GLuint lodLevels = 0, bool upload = true)
+    {
+        this->vertices = std::move(vertices);
+        this->indices = std::move(indices);
+        this->textures = std::move(textures);
+        this->hasTexture = hasTexture;
+        this->visibleTiles = 0;
+        this->drawnTriangles = 0;
+        this->VAO = this->VBO = this->EBO = 0;
+        this->gpuBytes = 0;
+
+        for (GLuint i = 0; i < this->vertices.size(); i++)
+            this->bounds.Extend(this->vertices[i].Position);
+        if (tilesPerSide > 0 && this->indices.size() / 3 >= MESH_TILE_MIN_TRIANGLES)
+        {
+            this->buildTiles(tilesPerSide);
+            if (lodLevels > 0)
+                this->buildLods(lodLevels);
+        }
+        this->optimize();
+        this->baseIndexCount = this->tiles.empty() ? this->indices.size() : this->tiles.back().firstIndex + this->tiles.back().indexCount;
+        // the levels of detail and the skirts grew the vectors: the spare capacity is given back before they are shared
+        this->vertices.shrink_to_fit();
+        this->indices.shrink_to_fit();
+        this->geometry.reset(new MeshGeometry());
+        this->geometry->vertices.swap(this->vertices);
+        this->geometry->indices.swap(this->indices);
+
+        if (upload)
+            this->Upload();
+    }
+
+    // mesh of a cooked file: nothing is computed, the buffers are uploaded from the mapped file
+    Mesh(CookedMesh cooked, vector<TextureStruct> textures, bool hasTexture, bool upload = true)
+    {
+        this->geometry = std::move(cooked.geometry);
+        this->baseIndexCount = cooked.baseIndexCount;
+        this->bounds = cooked.bounds;
+        this->tiles = std::move(cooked.tiles);
+        this->tileBounds = std::move(cooked.tileBounds);
+        this->lods = std::move(cooked.lods);
+        this->cacheBefore = cooked.cacheBefore;
+        this->cacheAfter = cooked.cacheAfter;
+        this->textures = std::move(textures);
+        this->hasTexture = hasTexture;
+        this->visibleTiles = 0;
+        this->drawnTriangles = 0;
+        this->VAO = this->VBO = this->EBO = 0;
+        this->gpuBytes = 0;
+        if (upload)
+            this->Upload();
+    }
+
+    // vertices and indices of the mesh (NULL and 0 after ReleaseGeometry)
+    const Vertex* VertexData() const { return this->geometry ? this->geometry->Vertices() : NULL; }
+    const GLuint* IndexData() const { return this->geometry ? this->geometry->Indices() : NULL; }
+    GLuint VertexCount() const { return this->geometry ? this->geometry->VertexCount() : 0; }
+    GLuint IndexCount() const { return this->geometry ? this->geometry->IndexCount() : 0; }
+    GLuint BaseIndexCount() const { return this->baseIndexCount; }
+
+    // the mesh does not need its CPU copy anymore (the GL buffers are ready): it is freed, unless another user still holds it
+    void ReleaseGeometry()
+    {
+        this->geometry.reset();
+    }
+
+    // initialization of OpenGL buffers and of the material (the ids of the textures must be valid)
+    // staging: buffer used to pass the vertices and indices to the GPU (see AssetLoader), or 0 to give them to glBufferData
+    void Upload(GLuint staging = 0)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-		this->hasTexture = hasTexture;
+        this->material = Material(this->textures, this->hasTexture);
+        this->setupMesh(staging);
+    }
 
-        // initialization of OpenGL buffers
-        this->setupMesh();
+    // bytes of the vertex and index buffers
+    size_t GpuBytes() const
+    {
+        return this->gpuBytes;
     }
 
     //////////////////////////////////////////
 
     // Renderizza il modello
-    void Draw(Shader shader)
+    // redundant state changes are filtered by glState, so consecutive draws of the same mesh
+    // (e.g., particles) only set the per-draw uniforms and issue the draw call
+    void Draw(const Shader& shader)
+    {
+        this->material.Bind(shader);
+        // VAO is made "active"
+        glState.BindVertexArray(this->VAO);
+        // rendering of data in the VAO (if the mesh has LODs, only the full detail level)
+        glState.DrawElements(GL_TRIANGLES, this->baseIndexCount, GL_UNSIGNED_INT, 0);
+        glCheckError();
+    }
+
+    // rendering of count instances of the mesh with a single call: their InstanceTransform are read from
+    // instanceBuffer, starting at offset. The instance attributes are enabled only for this draw
+    void DrawInstanced(const Shader& shader, GLuint instanceBuffer, GLintptr offset, GLsizei count)
     {
-        // Bind appropriate textures
-        GLuint diffuseNr = 1;
-        GLuint specularNr = 1;
-        GLuint normalNr = 1;
-        GLuint heightNr = 1;
-        for(GLuint i = 0; i < this->textures.size(); i++)
+        this->material.Bind(shader);
+        glState.BindVertexArray(this->VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        for (GLuint c = 0; c < 7; c++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // Active proper texture unit before binding
-			glCheckError();
-            // Retrieve texture number (the N in diffuse_textureN)
-            stringstream ss;
-            string number;
-            string name = this->textures[i].type;
-            if(name == "texture_diffuse")
-                ss << diffuseNr++; // Transfer GLuint to stream
-            else if(name == "texture_specular")
-                ss << specularNr++; // Transfer GLuint to stream
-            else if(name == "texture_normal")
-                ss << normalNr++; // Transfer GLuint to stream
-             else if(name == "texture_height")
-                ss << heightNr++; // Transfer GLuint to stream
-            number = ss.str();
-            // Now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.Program, (name + number).c_str()), i);
-			glCheckError();
-            // And finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
-			glCheckError();
+            GLuint location = INSTANCE_ATTRIBUTE_LOCATION + c;
+            // columns of the model matrix (vec4), then columns of the normal matrix (vec3)
+            GLintptr column = c < 4 ? offsetof(InstanceTransform, modelMatrix) + c * sizeof(glm::vec4)
+                                    : offsetof(InstanceTransform, normalMatrix) + (c - 4) * sizeof(glm::vec3);
+            glEnableVertexAttribArray(location);
+            glVertexAttribPointer(location, c < 4 ? 4 : 3, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (GLvoid*)(offset + column));
+            glVertexAttribDivisor(location, 1);
         }
-		
-		glUniform1i(glGetUniformLocation(shader.Program, "hasTexture"), hasTexture);
-		glCheckError();
-        // VAO is made "active"
-        glBindVertexArray(this->VAO);
-		glCheckError();
-        // rendering of data in the VAO
-        glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glCheckError();
-        // VAO is "detached"
-        glBindVertexArray(0);
-		glCheckError();
-
-        // Always good practice to set everything back to defaults once configured.
-        for (GLuint i = 0; i < this->textures.size(); i++)
+        glState.DrawElementsInstanced(GL_TRIANGLES, this->baseIndexCount, GL_UNSIGNED_INT, 0, count);
+        for (GLuint c = 0; c < 7; c++)
+            glDisableVertexAttribArray(INSTANCE_ATTRIBUTE_LOCATION + c);
+        glCheckError();
+    }
+
+    // rendering of the parts of the mesh inside the frustum (planes must be in the local space of the mesh)
+    // consecutive visible tiles are contiguous in the index buffer, so they are drawn with a single call
+    void Draw(const Shader& shader, const Frustum& frustum)
+    {
+        if (this->tiles.empty())
         {
-            glActiveTexture(GL_TEXTURE0 + i);
-			glCheckError();
-            glBindTexture(GL_TEXTURE_2D, 0);
-			glCheckError();
+            this->visibleTiles = frustum.IsVisible(this->bounds) ? 1 : 0;
+            this->drawnTriangles = this->visibleTiles * this->baseIndexCount / 3;
+            if (this->visibleTiles)
+                this->Draw(shader);
+            return;
         }
+
+        this->visibleTiles = frustum.Cull(this->tileBounds, this->tileVisibility);
+        this->tileLevel.assign(this->tiles.size(), 0);
+        this->drawTiles(shader);
+    }
+
+    // rendering of the parts of the mesh inside the frustum, each tile at the coarsest level of detail
+    // whose error, projected on the screen, is below lod.maxPixelError
+    void Draw(const Shader& shader, const Frustum& frustum, const LodSelection& lod)
+    {
+        if (this->lods.empty())
+        {
+            this->Draw(shader, frustum);
+            return;
+        }
+
+        this->visibleTiles = frustum.Cull(this->tileBounds, this->tileVisibility);
+        this->tileLevel.resize(this->tiles.size());
+        for (GLuint i = 0; i < this->tiles.size(); i++)
+        {
+            if (!this->tileVisibility[i])
+                continue;
+            // distance from the nearest point of the tile (the error of the whole tile is considered at this distance)
+            glm::vec3 nearest = glm::clamp(lod.viewPosition, this->tileBounds[i].min, this->tileBounds[i].max);
+            float distance = glm::max(glm::length(nearest - lod.viewPosition), 1e-6f);
+            GLuint level = 0;
+            while (level + 1 < this->lods.size() && this->lods[level + 1][i].error * lod.pixelsPerUnit / distance <= lod.maxPixelError)
+                level++;
+            this->tileLevel[i] = level;
+        }
+        this->drawTiles(shader);
     }
 
     //////////////////////////////////////////
@@ -144,6 +425,7 @@ public:
     // buffers are deallocated when application ends
     void Delete()
     {
+        glState.ForgetVertexArray(VAO);
         glDeleteVertexArrays(1, &VAO);
         glDeleteBuffers(1, &VBO);
         glDeleteBuffers(1, &EBO);
@@ -152,6 +434,262 @@ public:
 private:
   // VBO and EBO
   GLuint VBO, EBO;
+  // number of indices of the full detail level (all the indices if there are no LODs)
+  GLuint baseIndexCount;
+  // size of the GL buffers (the geometry may be released after the upload)
+  size_t gpuBytes;
+  // vertices and indices while the mesh is built (then moved in geometry)
+  vector<Vertex> vertices;
+  vector<GLuint> indices;
+  // result of the culling of the tiles and level chosen for each tile (kept to avoid an allocation each frame)
+  vector<unsigned char> tileVisibility;
+  vector<GLuint> tileLevel;
+  // axis of the mesh pointing up (the one with the smallest extent), and the 2 axes of the tiles grid
+  int upAxis, gridAxisA, gridAxisB;
+
+  //////////////////////////////////////////
+  // rendering of the visible tiles, at the level in tileLevel
+  // consecutive tiles with the same level are contiguous in the index buffer, so they are drawn with a single call
+  void drawTiles(const Shader& shader)
+  {
+      this->drawnTriangles = 0;
+      if (this->visibleTiles == 0)
+          return;
+
+      this->material.Bind(shader);
+      glState.BindVertexArray(this->VAO);
+      GLuint i = 0;
+      while (i < this->tiles.size())
+      {
+          if (!this->tileVisibility[i]) { i++; continue; }
+          GLuint level = this->tileLevel[i];
+          const vector<MeshTile>& ranges = level == 0 ? this->tiles : this->lods[level];
+          GLuint first = ranges[i].firstIndex;
+          GLuint count = 0;
+          while (i < this->tiles.size() && this->tileVisibility[i] && this->tileLevel[i] == level)
+              count += ranges[i++].indexCount;
+          glState.DrawElements(GL_TRIANGLES, count, GL_UNSIGNED_INT, (GLvoid*)(first * sizeof(GLuint)));
+          this->drawnTriangles += count / 3;
+      }
+      glCheckError();
+  }
+
+  //////////////////////////////////////////
+  // the ranges of indices drawn by a single call (the whole mesh, or the surface and the skirt of each tile at each level)
+  // are optimized separately, so the tiles stay valid. Then the vertices are renumbered for all the levels together
+  void optimize()
+  {
+      VertexCacheStats none = { 0.0f, 0.0f };
+      this->cacheBefore = this->cacheAfter = none;
+      if (this->indices.empty())
+          return;
+      this->cacheBefore = AnalyzeVertexCache(&this->indices[0], this->indices.size(), this->vertices.size());
+      if (this->tiles.empty())
+          this->optimizeRange(0, this->indices.size());
+      else
+      {
+          const vector<vector<MeshTile> >& levels = this->lods.empty() ? vector<vector<MeshTile> >(1, this->tiles) : this->lods;
+          for (GLuint level = 0; level < levels.size(); level++)
+              for (GLuint t = 0; t < levels[level].size(); t++)
+              {
+                  const MeshTile& tile = levels[level][t];
+                  this->optimizeRange(tile.firstIndex, tile.surfaceCount);
+                  this->optimizeRange(tile.firstIndex + tile.surfaceCount, tile.indexCount - tile.surfaceCount);
+              }
+      }
+
+      vector<GLuint> remap;
+      size_t used = OptimizeVertexFetch(&this->indices[0], this->indices.size(), this->vertices.size(), remap);
+      vector<Vertex> fetched(used);
+      for (GLuint v = 0; v < this->vertices.size(); v++)
+          if (remap[v] != ~0u)
+              fetched[remap[v]] = this->vertices[v];
+      this->vertices.swap(fetched);
+      this->cacheAfter = AnalyzeVertexCache(&this->indices[0], this->indices.size(), this->vertices.size());
+  }
+
+  void optimizeRange(GLuint first, GLuint count)
+  {
+      if (count < 6)
+          return;
+      OptimizeVertexCache(&this->indices[first], count, this->vertices.size());
+      OptimizeOverdraw(&this->indices[first], count, (const GLubyte*)&this->vertices[0].Position, sizeof(Vertex), this->vertices.size());
+  }
+
+  //////////////////////////////////////////
+  // the triangles are assigned to the cells of a grid, on the 2 axes with the largest extent (the ground plane of a terrain),
+  // using their centroid. Indices are then reordered cell by cell, so each tile is a contiguous range of the index buffer
+  void buildTiles(GLuint tilesPerSide)
+  {
+      glm::vec3 size = this->bounds.max - this->bounds.min;
+      // the "up" axis is the one with the smallest extent
+      int up = (size.x <= size.y && size.x <= size.z) ? 0 : (size.y <= size.z ? 1 : 2);
+      int a = (up == 0) ? 1 : 0;
+      int b = (up == 2) ? 1 : 2;
+      this->upAxis = up;
+      this->gridAxisA = a;
+      this->gridAxisB = b;
+
+      GLuint numTriangles = this->indices.size() / 3;
+      vector<GLuint> cellOfTriangle(numTriangles);
+      vector<GLuint> cellCount(tilesPerSide * tilesPerSide, 0);
+      for (GLuint t = 0; t < numTriangles; t++)
+      {
+          glm::vec3 centroid = (this->vertices[this->indices[3 * t]].Position + this->vertices[this->indices[3 * t + 1]].Position + this->vertices[this->indices[3 * t + 2]].Position) / 3.0f;
+          GLuint ca = cellIndex(centroid[a], this->bounds.min[a], size[a], tilesPerSide);
+          GLuint cb = cellIndex(centroid[b], this->bounds.min[b], size[b], tilesPerSide);
+          cellOfTriangle[t] = cb * tilesPerSide + ca;
+          cellCount[cellOfTriangle[t]]++;
+      }
+
+      // first triangle of each cell in the reordered buffer (counting sort)
+      vector<GLuint> cellStart(cellCount.size(), 0);
+      for (GLuint c = 1; c < cellCount.size(); c++)
+          cellStart[c] = cellStart[c - 1] + cellCount[c - 1];
+
+      vector<GLuint> sorted(this->indices.size());
+      vector<GLuint> cursor = cellStart;
+      for (GLuint t = 0; t < numTriangles; t++)
+      {
+          GLuint dst = 3 * cursor[cellOfTriangle[t]]++;
+          sorted[dst] = this->indices[3 * t];
+          sorted[dst + 1] = this->indices[3 * t + 1];
+          sorted[dst + 2] = this->indices[3 * t + 2];
+      }
+      this->indices.swap(sorted);
+
+      // empty cells are skipped; the bounding box of a tile contains all the vertices of its triangles
+      for (GLuint c = 0; c < cellCount.size(); c++)
+      {
+          if (cellCount[c] == 0)
+              continue;
+          MeshTile tile;
+          tile.firstIndex = 3 * cellStart[c];
+          tile.indexCount = 3 * cellCount[c];
+          tile.surfaceCount = tile.indexCount;
+          tile.error = 0.0f;
+          AABB box;
+          for (GLuint i = tile.firstIndex; i < tile.firstIndex + tile.indexCount; i++)
+              box.Extend(this->vertices[this->indices[i]].Position);
+          this->tiles.push_back(tile);
+          this->tileBounds.push_back(box);
+      }
+  }
+
+  //////////////////////////////////////////
+  // levels of detail of the tiles: each tile is simplified independently by vertex clustering (mesh_simplify.h).
+  // At level L the cells are 2^L times the average edge of the tile, so each level has about 1/4 of the triangles of the previous one. Adjacent tiles at different levels do not match exactly on their border,
+  // so every tile (at every level) gets a "skirt": a vertical strip hanging from the border, which hides the cracks.
+  // The index buffer is rebuilt ordered by level, then by tile: [level 0: tile 0, tile 1, ...][level 1: ...]
+  void buildLods(GLuint levels)
+  {
+      GLuint numTiles = this->tiles.size();
+      // simplified triangles of each tile at each level (level 0 = original triangles)
+      vector<vector<vector<GLuint> > > surfaces(levels + 1, vector<vector<GLuint> >(numTiles));
+      vector<vector<float> > errors(levels + 1, vector<float>(numTiles, 0.0f));
+      vector<float> skirtDepth(numTiles);
+      SimplifiedMesh simplified;
+      for (GLuint t = 0; t < numTiles; t++)
+      {
+          const MeshTile& tile = this->tiles[t];
+          surfaces[0][t].assign(this->indices.begin() + tile.firstIndex, this->indices.begin() + tile.firstIndex + tile.indexCount);
+          glm::vec3 size = this->tileBounds[t].max - this->tileBounds[t].min;
+          float tileExtent = glm::max(size[this->gridAxisA], size[this->gridAxisB]);
+          float edge = this->averageEdge(surfaces[0][t]);
+          for (GLuint level = 1; level <= levels; level++)
+          {
+              float cellSize = edge * (float)(1 << level);
+              SimplifyByClustering((const GLubyte*)&this->vertices[0].Position, sizeof(Vertex), &surfaces[0][t][0], surfaces[0][t].size(), cellSize, simplified);
+              // new vertices are appended, copying the attributes from the nearest original vertex
+              GLuint base = this->vertices.size();
+              for (GLuint v = 0; v < simplified.positions.size(); v++)
+              {
+                  Vertex vertex = this->vertices[simplified.sourceVertex[v]];
+                  vertex.Position = simplified.positions[v];
+                  this->vertices.push_back(vertex);
+              }
+              for (GLuint i = 0; i < simplified.indices.size(); i++)
+                  surfaces[level][t].push_back(base + simplified.indices[i]);
+              // the error never decreases with the level
+              errors[level][t] = glm::max(simplified.error, errors[level - 1][t]);
+          }
+          // the skirt must cover the largest gap with a neighbour, at any level
+          skirtDepth[t] = 2.0f * errors[levels][t] + 0.01f * tileExtent;
+      }
+
+      vector<GLuint> sorted;
+      this->lods.assign(levels + 1, vector<MeshTile>(numTiles));
+      for (GLuint level = 0; level <= levels; level++)
+      {
+          for (GLuint t = 0; t < numTiles; t++)
+          {
+              MeshTile& range = this->lods[level][t];
+              range.firstIndex = sorted.size();
+              range.error = errors[level][t];
+              sorted.insert(sorted.end(), surfaces[level][t].begin(), surfaces[level][t].end());
+              range.surfaceCount = sorted.size() - range.firstIndex;
+              this->appendSkirt(surfaces[level][t], skirtDepth[t], sorted);
+              range.indexCount = sorted.size() - range.firstIndex;
+          }
+      }
+      this->indices.swap(sorted);
+      this->tiles = this->lods[0];
+
+      // bounding boxes must contain the skirts
+      for (GLuint t = 0; t < numTiles; t++)
+      {
+          this->tileBounds[t].min[this->upAxis] -= skirtDepth[t];
+          this->bounds.Extend(this->tileBounds[t]);
+      }
+  }
+
+  float averageEdge(const vector<GLuint>& triangles)
+  {
+      double sum = 0.0;
+      for (GLuint i = 0; i + 2 < triangles.size(); i += 3)
+          for (int k = 0; k < 3; k++)
+              sum += glm::length(this->vertices[triangles[i + k]].Position - this->vertices[triangles[i + (k + 1) % 3]].Position);
+      return triangles.empty() ? 0.0f : (float)(sum / triangles.size());
+  }
+
+  // for each border edge (a, b) of the triangles, the quad (a, a', b', b) is added, where a' and b' are a and b moved down by depth
+  void appendSkirt(const vector<GLuint>& triangles, float depth, vector<GLuint>& out)
+  {
+      if (triangles.empty())
+          return;
+      vector<pair<GLuint, GLuint> > edges;
+      FindBoundaryEdges(&triangles[0], triangles.size(), edges);
+      map<GLuint, GLuint> lowered;
+      for (GLuint e = 0; e < edges.size(); e++)
+      {
+          GLuint a = edges[e].first, b = edges[e].second;
+          GLuint lowA = this->lowerVertex(a, depth, lowered);
+          GLuint lowB = this->lowerVertex(b, depth, lowered);
+          // same orientation of the triangle adjacent to the edge, seen from outside the tile
+          out.push_back(a); out.push_back(lowA); out.push_back(lowB);
+          out.push_back(a); out.push_back(lowB); out.push_back(b);
+      }
+  }
+
+  GLuint lowerVertex(GLuint v, float depth, map<GLuint, GLuint>& lowered)
+  {
+      map<GLuint, GLuint>::iterator it = lowered.find(v);
+      if (it != lowered.end())
+          return it->second;
+      Vertex vertex = this->vertices[v];
+      vertex.Position[this->upAxis] -= depth;
+      this->vertices.push_back(vertex);
+      lowered[v] = this->vertices.size() - 1;
+      return this->vertices.size() - 1;
+  }
+
+  static GLuint cellIndex(float value, float min, float size, GLuint cells)
+  {
+      if (size <= 0.0f)
+          return 0;
+      int cell = (int)((value - min) / size * cells);
+      return (GLuint)glm::clamp(cell, 0, (int)cells - 1);
+  }
 
   //////////////////////////////////////////
   // buffer objects\arrays are initialized
@@ -159,21 +697,26 @@ private:
   // https://learnopengl.com/#!Getting-started/Hello-Triangle
   // (in different parts of the page), or here:
   // http://www.informit.com/articles/article.aspx?p=1377833&seqNum=8
-  void setupMesh()
+  void setupMesh(GLuint staging)
   {
       // we create the buffers
       glGenVertexArrays(1, &this->VAO);
       glGenBuffers(1, &this->VBO);
       glGenBuffers(1, &this->EBO);
+      size_t vertexBytes = this->VertexCount() * sizeof(Vertex);
+      size_t indexBytes = this->IndexCount() * sizeof(GLuint);
+      this->gpuBytes = vertexBytes + indexBytes;
+      // with a staging buffer, the buffers are only allocated here and filled by stageBuffers
+      bool staged = staging != 0 && this->gpuBytes > 0;
 
       // VAO is made "active"
-      glBindVertexArray(this->VAO);
+      glState.BindVertexArray(this->VAO);
       // we copy data in the VBO - we must set the data dimension, and the pointer to the structure cointaining the data
       glBindBuffer(GL_ARRAY_BUFFER, this->VBO);
-      glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+      glBufferData(GL_ARRAY_BUFFER, vertexBytes, staged ? NULL : this->VertexData(), GL_STATIC_DRAW);
       // we copy data in the EBO - we must set the data dimension, and the pointer to the structure cointaining the data
       glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->EBO);
-      glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBytes, staged ? NULL : this->IndexData(), GL_STATIC_DRAW);
 
       // we set in the VAO the pointers to the different vertex attributes (with the relative offsets inside the data structure)
       // vertex positions
@@ -192,6 +735,39 @@ private:
       glEnableVertexAttribArray(4);
       glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, Bitangent));
 
-      glBindVertexArray(0);
+      glState.BindVertexArray(0);
+      if (staged)
+          this->stageBuffers(staging, vertexBytes, indexBytes);
+  }
+
+  // vertices and indices are written in the staging buffer, then copied from it to the VBO and the EBO by the GPU:
+  // the driver does not need to copy them during the call, as with glBufferData
+  void stageBuffers(GLuint staging, size_t vertexBytes, size_t indexBytes)
+  {
+      glBindBuffer(GL_COPY_READ_BUFFER, staging);
+      // new storage for each mesh: the previous copies may still be reading the old one
+      glBufferData(GL_COPY_READ_BUFFER, vertexBytes + indexBytes, NULL, GL_STREAM_DRAW);
+      unsigned char* data = (unsigned char*)glMapBufferRange(GL_COPY_READ_BUFFER, 0, vertexBytes + indexBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+      glCheckError();
+      if (data != NULL) {
+          memcpy(data, this->VertexData(), vertexBytes);
+          memcpy(data + vertexBytes, this->IndexData(), indexBytes);
+      }
+      // the content of the staging buffer is lost if the mapping fails or is corrupted: the buffers are filled directly
+      if (data == NULL || glUnmapBuffer(GL_COPY_READ_BUFFER) == GL_FALSE) {
+          glBindBuffer(GL_COPY_WRITE_BUFFER, this->VBO);
+          glBufferSubData(GL_COPY_WRITE_BUFFER, 0, vertexBytes, this->VertexData());
+          glBindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+          glBufferSubData(GL_COPY_WRITE_BUFFER, 0, indexBytes, this->IndexData());
+      }
+      else {
+          glBindBuffer(GL_COPY_WRITE_BUFFER, this->VBO);
+          glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, vertexBytes);
+          glBindBuffer(GL_COPY_WRITE_BUFFER, this->EBO);
+          glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, vertexBytes, 0, indexBytes);
+      }
+      glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+      glBindBuffer(GL_COPY_READ_BUFFER, 0);
+      glCheckError();
   }
 };
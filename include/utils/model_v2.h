@@ -36,45 +36,146 @@ using namespace std;
 #include <assimp\include\assimp\Importer.hpp>
 #include <assimp\include\assimp\scene.h>
 #include <assimp\include\assimp\postprocess.h>
+#include <assimp\include\assimp\config.h>
 
 // we include the library for image loading
 #include <stb_image/stb_image.h>
 
 // we include the Mesh class (v2), which manages the "OpenGL side" (= creation and allocation of VBO, VAO, EBO buffers) of the loading of models
 #include <utils/mesh_v2.h>
-
-// function used to load image data
-GLint TextureFromFile(const char* path, string directory);
+#include <utils/mesh_cache.h>
+#include <utils/texture_cache.h>
+#include <utils/tracer.h>
 
 
 /////////////////// MODEL class ///////////////////////
 class Model
 {
 public:
-    // a vector with the textures loaded
-    vector<TextureStruct> textures_loaded;
+    // the textures used by the meshes (a reference for each material slot), shared with the other models through the cache
+    vector<TextureHandle> textures_loaded;
     // at the end of loading, we will have a vector of Mesh class instances
     vector<Mesh> meshes;
     // the folder on disk of the model (needed for the loading of textures, if model is provided of textures)
     string directory;
+    // number of tiles per side used to split big meshes (0 = no split), and number of simplified levels built for each tile
+    GLuint tilesPerSide;
+    GLuint lodLevels;
+    // keep the CPU copy of vertices and indices after the upload (e.g., for CPU picking). Otherwise it is freed,
+    // unless another user holds it (e.g., a collision shape, see mesh_registry.h)
+    bool keepGeometry;
 
     //////////////////////////////////////////
 
     // constructor
-    Model(const string& path)
+    // tilesPerSide > 0 splits the big meshes in tiles, to render only the visible parts (e.g., terrains)
+    // lodLevels > 0 builds simplified versions of the tiles, to render far tiles with less triangles
+    Model(const string& path, GLuint tilesPerSide = 0, GLuint lodLevels = 0, bool keepGeometry = false)
+    {
+        this->tilesPerSide = tilesPerSide;
+        this->lodLevels = lodLevels;
+        this->keepGeometry = keepGeometry;
+        this->Parse(path);
+        this->Upload();
+    }
+
+    // empty model (nothing is drawn), to fill later with Parse and Upload (e.g., loaded in background, see AssetLoader)
+    Model(GLuint tilesPerSide = 0, GLuint lodLevels = 0, bool keepGeometry = false)
     {
-        this->loadModel(path);
+        this->tilesPerSide = tilesPerSide;
+        this->lodLevels = lodLevels;
+        this->keepGeometry = keepGeometry;
+    }
+
+    // loading of the model using Assimp library: only CPU work, so it can run on any thread
+    // threads: threads used by Assimp to parse the file and to process the meshes (0 = one per core). Less when
+    // several models are loaded at once (see AssetLoader)
+    void Parse(const string& path, unsigned int threads = 0)
+    {
+        this->loadModel(path, threads);
+    }
+
+    // creation of the textures and of the GL buffers of the meshes, on the thread of the context
+    // staging: buffer used to pass the vertices and indices to the GPU (see Mesh::Upload), or 0
+    void Upload(GLuint staging = 0)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+        {
+            vector<TextureStruct>& textures = this->meshes[i].textures;
+            for(GLuint t = 0; t < textures.size(); t++)
+                textures[t].id = this->loadTexture(textures[t]);
+            this->meshes[i].Upload(staging);
+            // the GL buffers have their copy: the CPU one stays only if another user holds it (see mesh_registry.h)
+            if (!this->keepGeometry)
+                this->meshes[i].ReleaseGeometry();
+        }
+    }
+
+    // bytes of the vertex and index buffers of all the meshes
+    size_t GpuBytes() const
+    {
+        size_t bytes = 0;
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            bytes += this->meshes[i].GpuBytes();
+        return bytes;
     }
 
     //////////////////////////////////////////
 
     // model rendering: calls rendering methods of each instance of Mesh class in the vector
-    void Draw(Shader& shader)
+    void Draw(const Shader& shader)
     {
         for(GLuint i = 0; i < this->meshes.size(); i++)
             this->meshes[i].Draw(shader);
     }
 
+    // instanced rendering: count copies of the model, with the InstanceTransform read from instanceBuffer at offset
+    void DrawInstanced(const Shader& shader, GLuint instanceBuffer, GLintptr offset, GLsizei count)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].DrawInstanced(shader, instanceBuffer, offset, count);
+    }
+
+    // model rendering with frustum culling. The frustum must be built from projection * view * model matrix
+    void Draw(const Shader& shader, const Frustum& frustum)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].Draw(shader, frustum);
+    }
+
+    // model rendering with frustum culling and a level of detail for each tile, chosen from its error on screen
+    void Draw(const Shader& shader, const Frustum& frustum, const LodSelection& lod)
+    {
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            this->meshes[i].Draw(shader, frustum, lod);
+    }
+
+    // number of triangles drawn in the last frustum-culled Draw
+    GLuint DrawnTriangles()
+    {
+        GLuint count = 0;
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            count += this->meshes[i].drawnTriangles;
+        return count;
+    }
+
+    // number of tiles (or not-split meshes) drawn in the last frustum-culled Draw, and total number
+    GLuint VisibleTiles()
+    {
+        GLuint count = 0;
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            count += this->meshes[i].visibleTiles;
+        return count;
+    }
+
+    GLuint TotalTiles()
+    {
+        GLuint count = 0;
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            count += this->meshes[i].tiles.empty() ? 1 : this->meshes[i].tiles.size();
+        return count;
+    }
+
     //////////////////////////////////////////
 
     // destructor. when application closes, we deallocate memory allocated by the instances of Mesh class
@@ -88,16 +189,28 @@ public:
 private:
 
     //////////////////////////////////////////
-    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances
-    void loadModel(string path)
+    // loading of the model using Assimp library. Nodes are processed to build a vector of Mesh class instances.
+    // If a valid cooked file of the model exists (see mesh_cache.h), the meshes are read from it instead,
+    // otherwise it is written after the processing
+    void loadModel(string path, unsigned int threads)
     {
+        ScopedTrace trace("Model::loadModel");
+        // we get the folder on disk of the model
+        this->directory = path.substr(0, path.find_last_of('/'));
+        if (ReadCookedModel(path, this->tilesPerSide, this->lodLevels, this->meshes))
+            return;
+
         // loading using Assimp
         // N.B.: it is possible to set, if needed, some operations to be performed by Assimp after the loading.
         // Details on the different flags to use are available at: http://assimp.sourceforge.net/lib_html/postprocess_8h.html#a64795260b95f5a4b3f3dc1be4f52e410
         // VERY IMPORTANT: calculation of Tangents and Bitangents is possible only if the model has Texture Coordinates
         // If they are not present, the calculation is skipped (but no error is provided in the foillowing checks!)
         Assimp::Importer importer;
+        importer.SetPropertyInteger(AI_CONFIG_IMPORT_OBJ_NUM_THREADS, (int)threads);
+        importer.SetPropertyInteger(AI_CONFIG_PP_NUM_THREADS, (int)threads);
+        tracer.Begin("Assimp::ReadFile");
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices | aiProcess_FlipUVs | aiProcess_GenSmoothNormals | aiProcess_CalcTangentSpace);
+        tracer.End();
 
         // check for errors (see comment above)
         if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) // if is Not Zero
@@ -106,11 +219,17 @@ private:
             return;
         }
 
-        // we get the folder on disk of the model
-        this->directory = path.substr(0, path.find_last_of('/'));
-
         // we start the recursive processing of nodes in the Assimp data structure
+        this->meshes.reserve(scene->mNumMeshes);
         this->processNode(scene->mRootNode, scene);
+        // the meshes have their own data: the Assimp scene is freed before writing the cooked file
+        importer.FreeScene();
+        for(GLuint i = 0; i < this->meshes.size(); i++)
+            cout << "Mesh " << i << " of " << path << ": " << this->meshes[i].IndexCount() / 3 << " triangles, ACMR "
+                << this->meshes[i].cacheBefore.acmr << " -> " << this->meshes[i].cacheAfter.acmr << ", ATVR "
+                << this->meshes[i].cacheBefore.atvr << " -> " << this->meshes[i].cacheAfter.atvr << endl;
+
+        WriteCookedModel(path, this->tilesPerSide, this->lodLevels, this->meshes);
     }
 
     //////////////////////////////////////////
@@ -125,7 +244,8 @@ private:
             // "Scene" contains all the data. Class node is used only to point to one or more mesh inside the scene and to maintain informations on relations between nodes
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
             // we start processing of the Assimp mesh using processMesh method.
-            // the result (an istance of the Mesh class) is added to the vector
+            // the result (an istance of the Mesh class) is moved in the vector
+            ScopedTrace trace("Model::processMesh");
             this->meshes.push_back(this->processMesh(mesh, scene));
         }
         // we then recursively process each of the children nodes
@@ -145,6 +265,9 @@ private:
       // data structures for vertices and indices of vertices (for faces)
         vector<Vertex> vertices;
         vector<GLuint> indices;
+        vertices.reserve(mesh->mNumVertices);
+        // after aiProcess_Triangulate all the faces are triangles
+        indices.reserve(3 * mesh->mNumFaces);
         // vector with all the model textures
         vector<TextureStruct> textures;
 		bool hasTexture = true;
@@ -199,7 +322,7 @@ private:
         // for each face of the mesh, we retrieve the indices of its vertices , and we store them in a vector data structure
         for(GLuint i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace& face = mesh->mFaces[i];
             for(GLuint j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
         }
@@ -230,10 +353,11 @@ private:
         }
 
         // we return an instance of the Mesh class created using the vertices and faces data structures we have created above.
-        return Mesh(vertices, indices, textures, hasTexture);
+        // The GL buffers are created later, by Upload()
+        return Mesh(std::move(vertices), std::move(indices), std::move(textures), hasTexture, this->tilesPerSide, this->lodLevels, false);
     }
 
-    // Load (if not yet loaded) the textures defined in the model materials (if defined)
+    // textures defined in the model materials (if defined): only their paths, the textures are created by Upload()
     vector<TextureStruct> loadMaterialTextures(aiMaterial* mat, aiTextureType type, string typeName)
     {
         vector<TextureStruct> textures;
@@ -241,59 +365,21 @@ private:
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // if texture has been already loaded, jump to the next one
-            GLboolean skip = false;
-            for(GLuint j = 0; j < textures_loaded.size(); j++)
-            {
-                if(textures_loaded[j].path == str)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // A texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // If texture hasn't been loaded already, load it
-                TextureStruct texture;
-                texture.id = TextureFromFile(str.C_Str(), this->directory);
-                texture.type = typeName;
-                texture.path = str;
-                textures.push_back(texture);
-                this->textures_loaded.push_back(texture);  // Store it as texture loaded for entire model, to ensure we won't unnecessary load duplicate textures.
-            }
+            TextureStruct texture;
+            texture.id = 0;
+            texture.type = typeName;
+            texture.path = str;
+            textures.push_back(texture);
         }
         return textures;
     }
-};
 
-// we load texture from disk, and we create OpenGL Texture Unit
-GLint TextureFromFile(const char* path, string directory)
-{
-     //Generate texture ID and load texture data
-    string filename = string(path);
-    filename = directory + '/' + filename;
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    int width,height,channels;
-    unsigned char* image = stbi_load(filename.c_str(), &width, &height, &channels, STBI_rgb);
-
-    // Assign texture to ID
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    // 3 channels = RGB ; 4 channel = RGBA
-    if (channels==3)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-    else if (channels==4)
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-    glGenerateMipmap(GL_TEXTURE_2D);
-
-    // we set how to consider UVs outside [0,1] range
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT );
-    // we set the filtering for minification and magnification
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR );
-    glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    // we free the memory once we have created an OpenGL texture
-    stbi_image_free(image);
-    return textureID;
-}
+    // Load (if not yet loaded) a texture of the materials
+    GLuint loadTexture(const TextureStruct& texture)
+    {
+        // if texture has been already loaded (by this or by another model), we use it (see texture_cache.h)
+        TextureHandle loaded = textureCache.Acquire(this->directory + '/' + texture.path.C_Str());
+        this->textures_loaded.push_back(loaded);
+        return loaded.Id();
+    }
+};
@@ -0,0 +1,259 @@
+/*
+Baked noise textures
+- value noise (fractional Brownian motion) computed on the CPU and stored in a RGBA float texture:
+  rgb = analytic gradient, a = value. A shader gets the noise and its derivatives with a single fetch
+- 2D textures have no z gradient: b holds white noise instead, an independent hash in [0, 1) per texel (read it with
+  texelFetch: filtering would smooth it)
+- the noise is periodic, so the textures tile (GL_REPEAT)
+- 3D textures (for noise on the surface of a model, in object space) and 2D textures (size x size x 1)
+- the texels of a row are computed 4 at a time with SSE (if not available, a scalar version is used),
+  and the rows are distributed on all the available cores
+- the baked texels are cached on disk: if the cache file matches the parameters, the noise is only read from it
+
+The noise is defined in "noise units": the texture covers [0, period) on each axis, with a lattice cell
+per noise unit in the first octave. To sample it in a shader: texture(noise, position / period).
+The octaves are not normalized, as in the fBm previously evaluated in the shaders: each one adds value noise in [0, 1)
+with amplitude 0.5, 0.25, ..., so the values are in [0, 1 - 0.5^octaves) (e.g., [0, 0.75) with 2 octaves, centered
+on 0.375). The gradient is expressed per noise unit.
+
+Gradient formulas: Quilez - "Value Noise Derivatives"
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <cstdio>
+#include <cstring>
+#include <cmath>
+#include <iostream>
+
+#include <glad/glad.h>
+#include <utils/gl_state.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define NOISE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// version of the cache file format: change it if the noise function changes, to discard old caches
+#define NOISE_CACHE_VERSION 2
+
+/////////////////// NoiseSettings struct ///////////////////////
+struct NoiseSettings {
+    // texels per side (multiple of 4)
+    GLuint size;
+    // 2 or 3
+    GLuint dimensions;
+    // lattice cells per side in the first octave (= noise units covered by the texture)
+    GLuint period;
+    GLuint octaves;
+    GLuint seed;
+};
+
+/////////////////// Float4 struct ///////////////////////
+// 4 floats, with the operations needed by the noise evaluation
+#ifdef NOISE_USE_SSE
+struct Float4 {
+    __m128 v;
+    Float4() {}
+    Float4(__m128 v) : v(v) {}
+    Float4(float s) : v(_mm_set1_ps(s)) {}
+    Float4(const float* p) : v(_mm_loadu_ps(p)) {}
+    void Store(float* p) const { _mm_storeu_ps(p, v); }
+};
+inline Float4 operator+(Float4 a, Float4 b) { return _mm_add_ps(a.v, b.v); }
+inline Float4 operator-(Float4 a, Float4 b) { return _mm_sub_ps(a.v, b.v); }
+inline Float4 operator*(Float4 a, Float4 b) { return _mm_mul_ps(a.v, b.v); }
+#else
+struct Float4 {
+    float v[4];
+    Float4() {}
+    Float4(float s) { v[0] = v[1] = v[2] = v[3] = s; }
+    Float4(const float* p) { for (int i = 0; i < 4; i++) v[i] = p[i]; }
+    void Store(float* p) const { for (int i = 0; i < 4; i++) p[i] = v[i]; }
+};
+inline Float4 operator+(Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] + b.v[i]; return r; }
+inline Float4 operator-(Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] - b.v[i]; return r; }
+inline Float4 operator*(Float4 a, Float4 b) { Float4 r; for (int i = 0; i < 4; i++) r.v[i] = a.v[i] * b.v[i]; return r; }
+#endif
+
+/////////////////// NoiseTexture class ///////////////////////
+class NoiseTexture {
+public:
+    GLuint id;
+    // GL_TEXTURE_2D or GL_TEXTURE_3D
+    GLenum target;
+    NoiseSettings settings;
+
+    // bakes the noise (or reads it from cachePath) and creates the texture. An empty cachePath disables the cache
+    NoiseTexture(const NoiseSettings& settings, const string& cachePath) : settings(settings) {
+        target = (settings.dimensions == 2) ? GL_TEXTURE_2D : GL_TEXTURE_3D;
+        vector<float> texels;
+        if (cachePath.empty() || !readCache(cachePath, texels)) {
+            Bake(settings, texels);
+            if (!cachePath.empty())
+                writeCache(cachePath, texels);
+        }
+        createTexture(texels);
+    }
+
+    void Delete() {
+        glState.ForgetTexture(id);
+        glDeleteTextures(1, &id);
+    }
+
+    // computes the RGBA texels (gradient, value; white noise in b for 2D textures), with a thread per core
+    static void Bake(const NoiseSettings& settings, vector<float>& texels) {
+        GLuint depth = (settings.dimensions == 2) ? 1 : settings.size;
+        GLuint rows = settings.size * depth;
+        texels.resize((size_t)rows * settings.size * 4);
+
+        unsigned int threadCount = thread::hardware_concurrency();
+        if (threadCount == 0)
+            threadCount = 1;
+        vector<thread> threads;
+        for (unsigned int t = 0; t < threadCount; t++) {
+            threads.push_back(thread([&settings, &texels, rows, threadCount, t]() {
+                // rows are interleaved among the threads, so each one gets the same amount of work
+                for (GLuint row = t; row < rows; row += threadCount)
+                    bakeRow(settings, row % settings.size, row / settings.size, &texels[(size_t)row * settings.size * 4]);
+            }));
+        }
+        for (size_t t = 0; t < threads.size(); t++)
+            threads[t].join();
+    }
+
+private:
+    struct CacheHeader {
+        char magic[4];
+        GLuint version, size, dimensions, period, octaves, seed;
+    };
+
+    // integer hash of a lattice point (wrapped, so the noise is periodic), in [0, 1)
+    static float lattice(int x, int y, int z, int cells, GLuint seed) {
+        unsigned int h = (unsigned int)(((x % cells) + cells) % cells) * 73856093u
+            ^ (unsigned int)(((y % cells) + cells) % cells) * 19349663u
+            ^ (unsigned int)(((z % cells) + cells) % cells) * 83492791u
+            ^ seed * 2654435761u;
+        h ^= h >> 16; h *= 0x7feb352du;
+        h ^= h >> 15; h *= 0x846ca68bu;
+        h ^= h >> 16;
+        return (h & 0xFFFFFF) / 16777216.0f;
+    }
+
+    // one row of texels (fixed y and z), 4 texels at a time
+    static void bakeRow(const NoiseSettings& s, GLuint y, GLuint z, float* out) {
+        float scale = (float)s.period / s.size;
+        for (GLuint x0 = 0; x0 < s.size; x0 += 4) {
+            Float4 value(0.0f), gx(0.0f), gy(0.0f), gz(0.0f);
+            float amplitude = 0.5f, frequency = 1.0f;
+            for (GLuint o = 0; o < s.octaves; o++) {
+                int cells = (int)(s.period * frequency);
+                // fractional position inside the cell, and values at the corners of the cell, for the 4 texels
+                float fx[4], fy[4], fz[4], c[8][4];
+                for (int i = 0; i < 4; i++) {
+                    float px = (x0 + i + 0.5f) * scale * frequency;
+                    float py = (y + 0.5f) * scale * frequency;
+                    float pz = (s.dimensions == 2) ? 0.0f : (z + 0.5f) * scale * frequency;
+                    int ix = (int)floor(px), iy = (int)floor(py), iz = (int)floor(pz);
+                    fx[i] = px - ix; fy[i] = py - iy; fz[i] = pz - iz;
+                    for (int k = 0; k < 8; k++)
+                        c[k][i] = lattice(ix + (k & 1), iy + ((k >> 1) & 1), iz + ((k >> 2) & 1), cells, s.seed + o);
+                }
+                Float4 f[3] = { Float4(fx), Float4(fy), Float4(fz) };
+                // smoothstep interpolation and its derivative
+                Float4 u[3], du[3];
+                for (int a = 0; a < 3; a++) {
+                    u[a] = f[a] * f[a] * (Float4(3.0f) - Float4(2.0f) * f[a]);
+                    du[a] = Float4(6.0f) * f[a] * (Float4(1.0f) - f[a]);
+                }
+                Float4 a(c[0]), b(c[1]), cc(c[2]), d(c[3]), e(c[4]), ff(c[5]), g(c[6]), h(c[7]);
+                Float4 k1 = b - a, k2 = cc - a, k3 = e - a;
+                Float4 k4 = a - b - cc + d, k5 = a - cc - e + g, k6 = a - b - e + ff;
+                Float4 k7 = b + cc + e + h - a - d - ff - g;
+                Float4 v = a + k1 * u[0] + k2 * u[1] + k3 * u[2] + k4 * u[0] * u[1] + k5 * u[1] * u[2] + k6 * u[2] * u[0] + k7 * u[0] * u[1] * u[2];
+                Float4 dx = du[0] * (k1 + k4 * u[1] + k6 * u[2] + k7 * u[1] * u[2]);
+                Float4 dy = du[1] * (k2 + k5 * u[2] + k4 * u[0] + k7 * u[2] * u[0]);
+                Float4 dz = du[2] * (k3 + k6 * u[0] + k5 * u[1] + k7 * u[0] * u[1]);
+                // the derivative of an octave is scaled by its frequency (chain rule)
+                value = value + Float4(amplitude) * v;
+                gx = gx + Float4(amplitude * frequency) * dx;
+                gy = gy + Float4(amplitude * frequency) * dy;
+                gz = gz + Float4(amplitude * frequency) * dz;
+                amplitude *= 0.5f;
+                frequency *= 2.0f;
+            }
+            float rv[4], rx[4], ry[4], rz[4];
+            value.Store(rv); gx.Store(rx); gy.Store(ry); gz.Store(rz);
+            for (int i = 0; i < 4; i++) {
+                float* texel = out + (x0 + i) * 4;
+                texel[0] = rx[i];
+                texel[1] = ry[i];
+                // the lattices of the octaves use the seeds from s.seed to s.seed + octaves - 1
+                texel[2] = (s.dimensions == 2) ? lattice(x0 + i, y, 0, s.size, s.seed + s.octaves) : rz[i];
+                texel[3] = rv[i];
+            }
+        }
+    }
+
+    bool readCache(const string& path, vector<float>& texels) {
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+        CacheHeader header;
+        bool valid = fread(&header, sizeof(header), 1, file) == 1
+            && memcmp(header.magic, "NOIS", 4) == 0 && header.version == NOISE_CACHE_VERSION
+            && header.size == settings.size && header.dimensions == settings.dimensions
+            && header.period == settings.period && header.octaves == settings.octaves && header.seed == settings.seed;
+        if (valid) {
+            size_t count = (size_t)settings.size * settings.size * ((settings.dimensions == 2) ? 1 : settings.size) * 4;
+            texels.resize(count);
+            valid = fread(&texels[0], sizeof(float), count, file) == count;
+        }
+        fclose(file);
+        return valid;
+    }
+
+    void writeCache(const string& path, const vector<float>& texels) {
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            cout << "WARNING::NOISE_TEXTURE::Cannot write the cache " << path << endl;
+            return;
+        }
+        CacheHeader header;
+        memcpy(header.magic, "NOIS", 4);
+        header.version = NOISE_CACHE_VERSION;
+        header.size = settings.size;
+        header.dimensions = settings.dimensions;
+        header.period = settings.period;
+        header.octaves = settings.octaves;
+        header.seed = settings.seed;
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(&texels[0], sizeof(float), texels.size(), file);
+        fclose(file);
+    }
+
+    void createTexture(const vector<float>& texels) {
+        glGenTextures(1, &id);
+        glCheckError();
+        glState.BindTexture(target, id);
+        if (target == GL_TEXTURE_2D)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, settings.size, settings.size, 0, GL_RGBA, GL_FLOAT, &texels[0]);
+        else
+            glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, settings.size, settings.size, settings.size, 0, GL_RGBA, GL_FLOAT, &texels[0]);
+        glCheckError();
+        glGenerateMipmap(target);
+        glCheckError();
+        // the noise is periodic
+        glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(target, GL_TEXTURE_WRAP_R, GL_REPEAT);
+        glCheckError();
+        glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glCheckError();
+    }
+};
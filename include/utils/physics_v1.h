@@ -17,11 +17,6 @@ Universita' degli Studi di Milano
 
 #include  <bullet\src\btBulletDynamicsCommon.h>
 
-#include <bullet\examples\Importers\ImportObjDemo\LoadMeshFromObj.h>
-#include <bullet\examples\Utils\b3ResourcePath.h>
-#include <bullet\examples\ThirdPartyLibs\Wavefront\tiny_obj_loader.h>
-#include <bullet\src\Bullet3Common\b3FileUtils.h>
-#include <bullet\examples\OpenGLWindow\GLInstanceGraphicsShape.h>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -29,6 +24,8 @@ Universita' degli Studi di Milano
 #include <glm/gtc/type_ptr.hpp>
 
 #include <utils\bulletObject.h>
+#include <utils/mesh_registry.h>
+#include <utils/tracer.h>
 
 ///////////////////  Physics class ///////////////////////
 class Physics
@@ -42,6 +39,7 @@ public:
     btBroadphaseInterface* overlappingPairCache; // method for the broadphase collision detection
     btSequentialImpulseConstraintSolver* solver; // constraints solver
 	btRigidBody* map;
+	btStridingMeshInterface* mapTriangles; // triangles of the map, if it has been created from a triangle mesh
 
     //////////////////////////////////////////
     // constructor
@@ -67,6 +65,9 @@ public:
 
         // we set the gravity force
         this->dynamicsWorld->setGravity(btVector3(0,-150,0));
+
+        this->map = NULL;
+        this->mapTriangles = NULL;
     }
 
     //////////////////////////////////////////
@@ -76,35 +77,119 @@ public:
 
         btCollisionShape* cShape = NULL;
 
-        // we convert the glm vector to a Bullet vector
-        btVector3 position = btVector3(pos.x,pos.y,pos.z);
-
-        // we set a quaternion from the Euler angles passed as parameters
-        btQuaternion rotation;
-        rotation.setEuler(rot.x,rot.y,rot.z);
-
         // Sphere Collision Shape (in this case we consider only the first component)
         if (type == PARTICLE)
             cShape = new btSphereShape(radius);
 
         // create the mesh
         else if (type == MAP) {
-			char relativeFilename[1024];
-			if (b3ResourcePath::findResourcePath(filename, relativeFilename, 1024)) {
-				char pathPrefix[1024];
-				b3FileUtils::extractPath(relativeFilename, pathPrefix, 1024);
-			}
-			// load mesh from .obj
-			GLInstanceGraphicsShape* glmesh = LoadMeshFromObj(relativeFilename, "");
+			// the mesh is parsed by the registry, only if the rendered model is not using it already (see mesh_registry.h)
+			shared_ptr<MeshAsset> asset = meshRegistry.Acquire(filename);
 			// generate convex hull by vertices
-			const GLInstanceVertex& v = glmesh->m_vertices->at(0);
-			btConvexHullShape* shape = new btConvexHullShape((const btScalar*)(&(v.xyzw[0])), glmesh->m_numvertices, sizeof(GLInstanceVertex));
+			btConvexHullShape* shape = new btConvexHullShape();
+			for (size_t m = 0; m < asset->meshes.size(); m++) {
+				const Vertex* vertices = asset->meshes[m].VertexData();
+				for (GLuint v = 0; v < asset->meshes[m].VertexCount(); v++)
+					shape->addPoint(btVector3(vertices[v].Position.x, vertices[v].Position.y, vertices[v].Position.z), false);
+			}
+			shape->recalcLocalAabb();
 			shape->optimizeConvexHull();
 			cShape = shape;
 
 			cShape->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
         }
 
+        return this->addRigidBody(type, cShape, pos, rot, m, friction, restitution);
+    }
+
+    //////////////////////////////////////////
+    // Method for the creation of the static rigid body of the map, from a triangle mesh (e.g., the CollisionMesh of the rendered model)
+    // Unlike the convex hull built from the OBJ file, the concave surface of the map is preserved
+    // Bullet reads the triangles where they are, without copying them: they are deleted with the simulation
+    bulletObject* createRigidBody(btStridingMeshInterface* triangles, glm::vec3 pos, glm::vec3 rot, float friction, float restitution, glm::vec3 scale) {
+
+        this->mapTriangles = triangles;
+        // static concave shape, with a bounding volume hierarchy for the collision queries
+        btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(this->mapTriangles, true);
+        shape->setLocalScaling(btVector3(scale.x, scale.y, scale.z));
+
+        return this->addRigidBody(MAP, shape, pos, rot, 0.0f, friction, restitution);
+    }
+
+	//////////////////////////////////////////
+	// removes a single rigid body from the dynamics world, and deletes it with its Collision Shape, in constant time
+	// (many bodies can be removed a few at a time, over several frames, instead of all at once with ClearRbs)
+	void RemoveRigidBody(bulletObject* object) {
+		btRigidBody* body = object->body;
+		this->dynamicsWorld->removeRigidBody(body);
+		delete body->getMotionState();
+		delete body->getCollisionShape();
+		delete body;
+		// the last object of the vector takes the place of the removed one
+		int last = this->bodies.size() - 1;
+		if (object->index >= 0 && object->index <= last) {
+			this->bodies[object->index] = this->bodies[last];
+			this->bodies[object->index]->index = object->index;
+			this->bodies.pop_back();
+		}
+		delete object;
+	}
+
+	void ClearRbs() {
+		ScopedTrace trace("Physics::ClearRbs");
+		//we remove the rigid bodies from the dynamics world and delete them
+		for (int i = this->dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--)
+		{
+			// we remove all the Motion States
+			btCollisionObject* obj = this->dynamicsWorld->getCollisionObjectArray()[i];
+			btRigidBody* body = btRigidBody::upcast(obj);
+			if (body != map) {
+				if (body && body->getMotionState()) {
+					delete body->getMotionState();
+				}
+				this->dynamicsWorld->removeCollisionObject(obj);
+				delete obj;
+			}
+		}
+	}
+
+    //////////////////////////////////////////
+    // We delete the data of the physical simulation when the program ends
+    void Clear() {
+
+		ClearRbs();
+
+        //delete dynamics world
+        delete this->dynamicsWorld;
+
+        //delete solver
+        delete this->solver;
+
+        //delete broadphase
+        delete this->overlappingPairCache;
+
+        //delete dispatcher
+        delete this->dispatcher;
+
+        delete this->collisionConfiguration;
+
+        delete this->mapTriangles;
+
+        this->bodies.clear();
+    }
+
+private:
+    //////////////////////////////////////////
+    // the rigid body is created from the Collision Shape, added to the dynamics world and to the vector of bodies
+    bulletObject* addRigidBody(ContactType type, btCollisionShape* cShape, glm::vec3 pos, glm::vec3 rot, float m, float friction, float restitution) {
+
+        // we convert the glm vector to a Bullet vector
+        btVector3 position = btVector3(pos.x,pos.y,pos.z);
+
+        // we set a quaternion from the Euler angles passed as parameters
+        btQuaternion rotation;
+        rotation.setEuler(rot.x,rot.y,rot.z);
+
         // We set the initial transformations
         btTransform objTransform;
         objTransform.setIdentity();
@@ -153,6 +238,7 @@ public:
 
 		// we add this Collision Shape to the vector
 		this->bodies.push_back(new bulletObject(body, type, NULL));
+		this->bodies[bodies.size() - 1]->index = bodies.size() - 1;
 
 		// set pointer collision
 		body->setUserPointer(bodies[bodies.size()-1]);
@@ -161,44 +247,4 @@ public:
         // in a standard simulation (e.g., only objects falling), it is not needed to have a reference to a single rigid body, but in some cases (e.g., the application of an impulse), it is needed.
         return bodies[bodies.size() - 1];
     }
-
-	void ClearRbs() {
-		//we remove the rigid bodies from the dynamics world and delete them
-		for (int i = this->dynamicsWorld->getNumCollisionObjects() - 1; i >= 0; i--)
-		{
-			// we remove all the Motion States
-			btCollisionObject* obj = this->dynamicsWorld->getCollisionObjectArray()[i];
-			btRigidBody* body = btRigidBody::upcast(obj);
-			if (body != map) {
-				if (body && body->getMotionState()) {
-					delete body->getMotionState();
-				}
-				this->dynamicsWorld->removeCollisionObject(obj);
-				delete obj;
-			}
-		}
-	}
-
-    //////////////////////////////////////////
-    // We delete the data of the physical simulation when the program ends
-    void Clear() {
-
-		ClearRbs();
-
-        //delete dynamics world
-        delete this->dynamicsWorld;
-
-        //delete solver
-        delete this->solver;
-
-        //delete broadphase
-        delete this->overlappingPairCache;
-
-        //delete dispatcher
-        delete this->dispatcher;
-
-        delete this->collisionConfiguration;
-
-        this->bodies.clear();
-    }
 };
\ No newline at end of file
@@ -0,0 +1,210 @@
+/*
+Frame profiler
+- nestable named scopes (ScopedPass) measuring the CPU time and the GPU time of a part of the frame
+- GPU time is measured with timestamp queries: each scope writes a GL_TIMESTAMP at its begin and at its end
+  (GL_TIME_ELAPSED queries cannot be nested)
+- the queries of the last PROFILER_FRAMES frames are kept in a ring: the results of a frame are read when its slot
+  is reused, some frames later, so the CPU never waits for the GPU. If a result is still not available
+  (the GPU is more than PROFILER_FRAMES frames behind), the GPU times of that frame are dropped
+- nested scopes are named "parent/child"
+- each scope is also a span of the event tracer (tracer.h), when the tracer is enabled
+
+Usage:
+    profiler.BeginFrame();
+    {
+        ScopedPass pass("rain");
+        ...
+    }
+    profiler.EndFrame();
+    // timings of the most recent frame with all the results available
+    const vector<PassTiming>& timings = profiler.Timings();
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <chrono>
+
+#include <glad/glad.h>
+#include <utils/gl_error.h>
+#include <utils/tracer.h>
+
+// frames in flight: the GPU results of a frame are read PROFILER_FRAMES frames later
+#define PROFILER_FRAMES 4
+
+/////////////////// PassTiming struct ///////////////////////
+struct PassTiming {
+    string name;
+    int depth;
+    double cpuMs;
+    // negative if not available
+    double gpuMs;
+};
+
+/////////////////// Profiler class ///////////////////////
+class Profiler {
+public:
+    Profiler() : frame(0), inFrame(false), enabled(true) {}
+
+    // the profiler can be switched off: scopes then cost only a branch
+    void SetEnabled(bool value) { enabled = value; }
+
+    void BeginFrame() {
+        if (!enabled)
+            return;
+        FrameSlot& slot = slots[frame % PROFILER_FRAMES];
+        // the slot is reused: the results of its frame are read first (they are PROFILER_FRAMES frames old)
+        if (slot.pending)
+            collect(slot);
+        slot.scopes.clear();
+        slot.stack.clear();
+        slot.usedQueries = 0;
+        slot.pending = true;
+        inFrame = true;
+    }
+
+    void EndFrame() {
+        if (!enabled || !inFrame)
+            return;
+        // scopes left open are closed here
+        while (!slots[frame % PROFILER_FRAMES].stack.empty())
+            End();
+        inFrame = false;
+        frame++;
+    }
+
+    void Begin(const char* name) {
+        tracer.Begin(name);
+        if (!enabled || !inFrame)
+            return;
+        FrameSlot& slot = slots[frame % PROFILER_FRAMES];
+        Scope scope;
+        scope.name = slot.stack.empty() ? string(name) : slot.scopes[slot.stack.back()].name + "/" + name;
+        scope.depth = (int)slot.stack.size();
+        scope.beginQuery = query(slot);
+        glQueryCounter(slot.queries[scope.beginQuery], GL_TIMESTAMP);
+        glCheckError();
+        scope.cpuBegin = now();
+        slot.stack.push_back(slot.scopes.size());
+        slot.scopes.push_back(scope);
+    }
+
+    void End() {
+        tracer.End();
+        if (!enabled || !inFrame)
+            return;
+        FrameSlot& slot = slots[frame % PROFILER_FRAMES];
+        if (slot.stack.empty())
+            return;
+        Scope& scope = slot.scopes[slot.stack.back()];
+        slot.stack.pop_back();
+        scope.cpuEnd = now();
+        scope.endQuery = query(slot);
+        glQueryCounter(slot.queries[scope.endQuery], GL_TIMESTAMP);
+        glCheckError();
+    }
+
+    // the most recent frame with GPU results (empty in the first PROFILER_FRAMES frames)
+    const vector<PassTiming>& Timings() const { return timings; }
+
+    // total CPU and GPU time of a top level pass in Timings(), or -1 if it is not there
+    double CpuMs(const string& name) const {
+        for (size_t i = 0; i < timings.size(); i++)
+            if (timings[i].name == name) return timings[i].cpuMs;
+        return -1.0;
+    }
+
+    double GpuMs(const string& name) const {
+        for (size_t i = 0; i < timings.size(); i++)
+            if (timings[i].name == name) return timings[i].gpuMs;
+        return -1.0;
+    }
+
+    void Delete() {
+        for (int s = 0; s < PROFILER_FRAMES; s++) {
+            if (!slots[s].queries.empty())
+                glDeleteQueries((GLsizei)slots[s].queries.size(), &slots[s].queries[0]);
+            slots[s].queries.clear();
+            slots[s].pending = false;
+        }
+    }
+
+private:
+    struct Scope {
+        string name;
+        int depth;
+        double cpuBegin, cpuEnd;
+        size_t beginQuery, endQuery;
+    };
+
+    struct FrameSlot {
+        vector<Scope> scopes;
+        // open scopes
+        vector<size_t> stack;
+        // query objects are created when needed, and reused by the next frames of this slot
+        vector<GLuint> queries;
+        size_t usedQueries;
+        bool pending;
+        FrameSlot() : usedQueries(0), pending(false) {}
+    };
+
+    FrameSlot slots[PROFILER_FRAMES];
+    vector<PassTiming> timings;
+    unsigned int frame;
+    bool inFrame, enabled;
+
+    static double now() {
+        return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    size_t query(FrameSlot& slot) {
+        if (slot.usedQueries == slot.queries.size()) {
+            GLuint id;
+            glGenQueries(1, &id);
+            glCheckError();
+            slot.queries.push_back(id);
+        }
+        return slot.usedQueries++;
+    }
+
+    void collect(FrameSlot& slot) {
+        slot.pending = false;
+        timings.clear();
+        // the last query of the frame is the last one written: if it is ready, all the others are ready
+        bool available = false;
+        if (slot.usedQueries > 0) {
+            GLint ready = 0;
+            glGetQueryObjectiv(slot.queries[slot.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &ready);
+            glCheckError();
+            available = ready != 0;
+        }
+        for (size_t i = 0; i < slot.scopes.size(); i++) {
+            const Scope& scope = slot.scopes[i];
+            PassTiming timing;
+            timing.name = scope.name;
+            timing.depth = scope.depth;
+            timing.cpuMs = scope.cpuEnd - scope.cpuBegin;
+            timing.gpuMs = -1.0;
+            if (available) {
+                GLuint64 begin = 0, end = 0;
+                glGetQueryObjectui64v(slot.queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(slot.queries[scope.endQuery], GL_QUERY_RESULT, &end);
+                glCheckError();
+                timing.gpuMs = (end - begin) / 1000000.0;
+            }
+            timings.push_back(timing);
+        }
+    }
+};
+
+// the single instance used by the whole application
+Profiler profiler;
+
+/////////////////// ScopedPass struct ///////////////////////
+// a profiler scope from the constructor to the end of the block
+struct ScopedPass {
+    ScopedPass(const char* name) { profiler.Begin(name); }
+    ~ScopedPass() { profiler.End(); }
+};
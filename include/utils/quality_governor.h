@@ -0,0 +1,141 @@
+/*
+Quality governor
+- keeps the work of a frame near a target time, moving a set of quality knobs (e.g., particles, render scale)
+- each knob has some levels: level 0 is the full quality, higher levels are cheaper. A knob loads the CPU or the GPU
+- the load of a frame is the largest of its CPU time and its GPU time (without the wait for the swap, which depends
+  on the vsync), smoothed over the last frames
+- hysteresis: the quality goes down when the load stays above the target (+10%) for some frames, it goes up when the
+  load stays well below it (-25%) for a longer time, and after each move the governor waits for the effect
+- when the quality goes down, a knob of the busiest processor is moved; when it goes up, the last lowered knob is restored
+- each move is printed, with the knob and its new level
+
+Usage:
+    QualityGovernor governor(16.7);
+    governor.AddKnob("particles", QUALITY_CPU, 4, [](int level) { ... });
+    ...
+    governor.Update(cpuMs, gpuMs);   // at the end of each frame
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <algorithm>
+#include <cstdio>
+
+#include <utils/tracer.h>
+
+// processor loaded by a knob
+#define QUALITY_CPU 0
+#define QUALITY_GPU 1
+
+// load above target * QUALITY_DOWN_RATIO for QUALITY_DOWN_FRAMES frames: lower the quality
+#define QUALITY_DOWN_RATIO 1.1
+#define QUALITY_DOWN_FRAMES 20
+// load below target * QUALITY_UP_RATIO for QUALITY_UP_FRAMES frames: raise the quality
+#define QUALITY_UP_RATIO 0.75
+#define QUALITY_UP_FRAMES 120
+// frames without moves after a move
+#define QUALITY_COOLDOWN_FRAMES 30
+
+/////////////////// QualityGovernor class ///////////////////////
+class QualityGovernor {
+public:
+    QualityGovernor(double targetMs = 1000.0 / 60.0) : targetMs(targetMs), load(0.0), cpuLoad(0.0), gpuLoad(0.0),
+        overFrames(0), underFrames(0), cooldown(QUALITY_COOLDOWN_FRAMES) {}
+
+    void SetTarget(double milliseconds) { targetMs = milliseconds; }
+
+    // knobs are lowered in the order they are added (for each processor): cheap losses of quality first.
+    // apply is called with the new level at each move, and with 0 here
+    void AddKnob(const string& name, int processor, int levels, const function<void(int)>& apply) {
+        Knob knob;
+        knob.name = name;
+        knob.processor = processor;
+        knob.levels = levels;
+        knob.level = 0;
+        knob.apply = apply;
+        knobs.push_back(knob);
+        apply(0);
+    }
+
+    int Level(const string& name) const {
+        for (size_t k = 0; k < knobs.size(); k++)
+            if (knobs[k].name == name) return knobs[k].level;
+        return 0;
+    }
+
+    // CPU and GPU time of the work of the last frame, in ms (gpuMs < 0 if not measured)
+    void Update(double cpuMs, double gpuMs) {
+        // exponential moving average, about 10 frames
+        cpuLoad += (cpuMs - cpuLoad) * 0.1;
+        if (gpuMs >= 0.0)
+            gpuLoad += (gpuMs - gpuLoad) * 0.1;
+        load = max(cpuLoad, gpuLoad);
+        tracer.Counter("governor load us", (long long)(load * 1000.0));
+
+        if (cooldown > 0) {
+            cooldown--;
+            return;
+        }
+        overFrames = load > targetMs * QUALITY_DOWN_RATIO ? overFrames + 1 : 0;
+        underFrames = load < targetMs * QUALITY_UP_RATIO ? underFrames + 1 : 0;
+        if (overFrames >= QUALITY_DOWN_FRAMES)
+            lower();
+        else if (underFrames >= QUALITY_UP_FRAMES)
+            raise();
+    }
+
+private:
+    struct Knob {
+        string name;
+        int processor;
+        int levels;
+        int level;
+        function<void(int)> apply;
+    };
+
+    double targetMs;
+    double load, cpuLoad, gpuLoad;
+    int overFrames, underFrames, cooldown;
+    vector<Knob> knobs;
+    // knobs lowered, in order: the last one is the first raised
+    vector<size_t> lowered;
+
+    void lower() {
+        int busy = gpuLoad > cpuLoad ? QUALITY_GPU : QUALITY_CPU;
+        // first knob of the busy processor which can go down, otherwise any knob which can go down
+        size_t chosen = knobs.size();
+        for (size_t k = 0; k < knobs.size() && chosen == knobs.size(); k++)
+            if (knobs[k].processor == busy && knobs[k].level + 1 < knobs[k].levels)
+                chosen = k;
+        for (size_t k = 0; k < knobs.size() && chosen == knobs.size(); k++)
+            if (knobs[k].level + 1 < knobs[k].levels)
+                chosen = k;
+        if (chosen == knobs.size())
+            return;
+        lowered.push_back(chosen);
+        move(chosen, knobs[chosen].level + 1, busy == QUALITY_GPU ? "GPU" : "CPU");
+    }
+
+    void raise() {
+        if (lowered.empty())
+            return;
+        size_t chosen = lowered.back();
+        lowered.pop_back();
+        move(chosen, knobs[chosen].level - 1, "headroom");
+    }
+
+    void move(size_t k, int level, const char* reason) {
+        Knob& knob = knobs[k];
+        knob.level = level;
+        knob.apply(level);
+        printf("Quality governor: %s -> level %d/%d (load %.2f ms, target %.2f ms, %s)\n",
+            knob.name.c_str(), level, knob.levels - 1, load, targetMs, reason);
+        overFrames = 0;
+        underFrames = 0;
+        cooldown = QUALITY_COOLDOWN_FRAMES;
+    }
+};
@@ -0,0 +1,80 @@
+/*
+Offscreen render target
+- a framebuffer with a RGBA8 color buffer and a 24 bit depth buffer, at a given resolution
+- used instead of the default framebuffer when there is no visible window (headless mode)
+- the content can be saved as a binary PPM image, to check the rendered frames
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <iostream>
+
+#include <glad/glad.h>
+#include <utils/gl_error.h>
+
+/////////////////// RenderTarget class ///////////////////////
+class RenderTarget {
+public:
+    GLuint fbo;
+    int width, height;
+
+    RenderTarget(int width, int height) : width(width), height(height) {
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glCheckError();
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glCheckError();
+
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+        glCheckError();
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            cout << "ERROR::RENDER_TARGET::Framebuffer is not complete" << endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glCheckError();
+    }
+
+    void Bind() {
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glCheckError();
+    }
+
+    // reads back the color buffer and writes it as PPM (rows are flipped: OpenGL starts from the bottom)
+    bool Save(const string& path) {
+        vector<unsigned char> pixels((size_t)width * height * 3);
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, fbo);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+        glCheckError();
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file) {
+            cout << "ERROR::RENDER_TARGET::Cannot write " << path << endl;
+            return false;
+        }
+        fprintf(file, "P6\n%d %d\n255\n", width, height);
+        for (int y = height - 1; y >= 0; y--)
+            fwrite(&pixels[(size_t)y * width * 3], 1, (size_t)width * 3, file);
+        fclose(file);
+        return true;
+    }
+
+    void Delete() {
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        glCheckError();
+    }
+
+private:
+    GLuint color, depth;
+};
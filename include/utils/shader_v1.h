@@ -20,6 +20,7 @@ Universita' degli Studi di Milano
 #include <sstream>
 #include <iostream>
 #include <utils/gl_error.h>
+#include <utils/gl_state.h>
 
 // GL Includes
 #include <glad/glad.h> // Contains all the necessery OpenGL includes
@@ -37,7 +38,9 @@ public:
 
 	}
 
-    Shader(const GLchar* vertexPath, const GLchar* fragmentPath)
+    // fragmentHeaderPath: code shared by several fragment shaders (e.g., transparency_write.glsl), inserted after
+    // the #version line of the fragment shader
+    Shader(const GLchar* vertexPath, const GLchar* fragmentPath, const GLchar* fragmentHeaderPath = NULL)
     {
         // Step 1: we retrieve shaders source code from provided filepaths
         std::string vertexCode;
@@ -68,6 +71,8 @@ public:
         {
             std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
         }
+        if (fragmentHeaderPath != NULL)
+            fragmentCode = insertHeader(fragmentCode, fragmentHeaderPath);
 
         // converto le stringhe in puntatori a char
         const GLchar* vShaderCode = vertexCode.c_str();
@@ -120,15 +125,42 @@ public:
 
     //////////////////////////////////////////
 
-    // We activate the Shader Program as part of the current rendering process
-    void Use() { glUseProgram(this->Program); }
+    // We activate the Shader Program as part of the current rendering process (skipped if it is already active)
+    void Use() const { glState.UseProgram(this->Program); }
 
     // We delete the Shader Program when application closes
-    void Delete() {    glDeleteProgram(this->Program); }
+    void Delete()
+    {
+        glState.ForgetProgram(this->Program);
+        glDeleteProgram(this->Program);
+    }
 
 private:
     //////////////////////////////////////////
 
+    // the code of the header is inserted after the #version line; #line keeps the line numbers of the errors
+    // in the rest of the shader equal to the ones of its file
+    static std::string insertHeader(const std::string& code, const GLchar* headerPath)
+    {
+        std::ifstream headerFile(headerPath);
+        if (!headerFile)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ " << headerPath << std::endl;
+            return code;
+        }
+        std::stringstream headerStream;
+        headerStream << headerFile.rdbuf();
+        size_t version = code.find("#version");
+        size_t lineEnd = version == std::string::npos ? std::string::npos : code.find('\n', version);
+        if (lineEnd == std::string::npos)
+            return code;
+        int nextLine = 2;
+        for (size_t i = 0; i < lineEnd; i++)
+            if (code[i] == '\n')
+                nextLine++;
+        return code.substr(0, lineEnd + 1) + headerStream.str() + "\n#line " + std::to_string(nextLine) + "\n" + code.substr(lineEnd + 1);
+    }
+
     // Check compilation and linking errors
     void checkCompileErrors(GLuint shader, std::string type)
 	{
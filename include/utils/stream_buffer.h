@@ -0,0 +1,166 @@
+/*
+Stream buffer
+- a buffer for data written by the CPU each frame and read by the GPU in the same frame (e.g., per-instance
+  transforms of the particles), without the implicit synchronization of glBufferSubData or of a plain glMapBuffer
+- the buffer is split in STREAM_BUFFER_FRAMES regions, one for each frame in flight: in a frame the allocations are
+  taken one after the other from the region of that frame, mapped with GL_MAP_UNSYNCHRONIZED_BIT. At the end of the
+  frame a fence is placed after the last command reading the region, and the region is reused only when the fence
+  is signaled (STREAM_BUFFER_FRAMES frames later it usually is, so there is no wait)
+- if the fence of the region is not signaled yet (the GPU is more than STREAM_BUFFER_FRAMES frames behind) the
+  whole buffer is orphaned instead of waiting: the driver gives new storage, and frees the old one when the GPU is done
+- without fences (GL < 3.2) the buffer is orphaned each time it is full, and the allocations are appended
+  (unsynchronized) in the storage in use, which is never written twice
+- when a frame needs more than a region, the regions grow (the buffer is orphaned with the new size)
+
+Usage:
+    StreamBuffer stream(4 * 1024 * 1024);
+    GLintptr offset;
+    void* data = stream.Map(size, offset);   // write size bytes in data
+    stream.Unmap();                          // then draw, reading the buffer from offset
+    ...
+    stream.EndFrame();                       // after the last draw of the frame
+*/
+
+#pragma once
+using namespace std;
+
+#include <glad/glad.h>
+#include <iostream>
+
+#include <utils/gl_error.h>
+#include <utils/tracer.h>
+
+// frames which can use the buffer at the same time (CPU frame + frames queued in the driver)
+#define STREAM_BUFFER_FRAMES 3
+// alignment of the allocations (the largest alignment of the vertex attributes)
+#define STREAM_BUFFER_ALIGNMENT 16
+
+/////////////////// StreamBuffer class ///////////////////////
+class StreamBuffer {
+public:
+    GLuint buffer;
+
+    StreamBuffer(GLsizeiptr frameSize, GLenum target = GL_ARRAY_BUFFER) : target(target), regionSize(frameSize),
+        region(0), cursor(0), mapped(false), orphans(0) {
+        useFences = GLAD_GL_VERSION_3_2 != 0;
+        for (int r = 0; r < STREAM_BUFFER_FRAMES; r++)
+            fences[r] = 0;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(target, buffer);
+        glBufferData(target, Capacity(), NULL, GL_STREAM_DRAW);
+        glCheckError();
+    }
+
+    // total size of the storage, in bytes
+    GLsizeiptr Capacity() const { return regionSize * STREAM_BUFFER_FRAMES; }
+
+    // times the storage has been replaced (growth, or GPU too far behind): it should stay low
+    int Orphans() const { return orphans; }
+
+    // maps size bytes for writing, and returns their offset in the buffer. The buffer stays bound to the target
+    void* Map(GLsizeiptr size, GLintptr& offset) {
+        glBindBuffer(target, buffer);
+        if (useFences) {
+            // first allocation of the frame: the region must not be read by the GPU anymore
+            if (cursor == 0 && fences[region] != 0)
+                waitRegion();
+            if (cursor + size > regionSize)
+                grow(cursor + size);
+            offset = region * regionSize + cursor;
+        }
+        else {
+            if (cursor + size > Capacity()) {
+                if (size > regionSize)
+                    regionSize = size;
+                orphan();
+            }
+            offset = cursor;
+        }
+        cursor = align(cursor + size);
+        void* data = glMapBufferRange(target, offset, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        glCheckError();
+        mapped = data != NULL;
+        return data;
+    }
+
+    void Unmap() {
+        if (!mapped)
+            return;
+        glBindBuffer(target, buffer);
+        glUnmapBuffer(target);
+        glCheckError();
+        mapped = false;
+    }
+
+    // to call after the last command reading the allocations of this frame: the next frame uses the next region
+    void EndFrame() {
+        if (!useFences)
+            return;
+        if (cursor > 0) {
+            if (fences[region] != 0)
+                glDeleteSync(fences[region]);
+            fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glCheckError();
+        }
+        region = (region + 1) % STREAM_BUFFER_FRAMES;
+        cursor = 0;
+    }
+
+    void Delete() {
+        deleteFences();
+        glDeleteBuffers(1, &buffer);
+        glCheckError();
+    }
+
+private:
+    GLenum target;
+    GLsizeiptr regionSize;
+    int region;
+    // first free byte of the region (with fences) or of the whole buffer (without fences)
+    GLsizeiptr cursor;
+    bool mapped;
+    bool useFences;
+    GLsync fences[STREAM_BUFFER_FRAMES];
+    int orphans;
+
+    static GLsizeiptr align(GLsizeiptr size) {
+        return (size + STREAM_BUFFER_ALIGNMENT - 1) / STREAM_BUFFER_ALIGNMENT * STREAM_BUFFER_ALIGNMENT;
+    }
+
+    void waitRegion() {
+        GLenum status = glClientWaitSync(fences[region], 0, 0);
+        glDeleteSync(fences[region]);
+        fences[region] = 0;
+        glCheckError();
+        // waiting here would stall the CPU until the GPU catches up: new storage is cheaper
+        if (status == GL_TIMEOUT_EXPIRED)
+            orphan();
+    }
+
+    // the regions become large enough for size bytes (with some margin for the next frames)
+    void grow(GLsizeiptr size) {
+        regionSize = align(size + size / 2);
+        cout << "WARNING::STREAM_BUFFER:: regions grown to " << regionSize << " bytes" << endl;
+        // the allocations already made in this frame stay in the old storage, which is kept until the GPU reads them
+        cursor = 0;
+        orphan();
+    }
+
+    // new storage: the commands already issued keep reading the old one, so no region is in use anymore
+    void orphan() {
+        ScopedTrace trace("stream buffer orphan");
+        glBufferData(target, Capacity(), NULL, GL_STREAM_DRAW);
+        glCheckError();
+        deleteFences();
+        cursor = 0;
+        orphans++;
+    }
+
+    void deleteFences() {
+        for (int r = 0; r < STREAM_BUFFER_FRAMES; r++) {
+            if (fences[r] != 0)
+                glDeleteSync(fences[r]);
+            fences[r] = 0;
+        }
+    }
+};
@@ -1,6 +1,9 @@
 #ifndef TEXTURE_H
 #define TEXTURE_H
 
+#include <utils/gl_state.h>
+#include <utils/texture_cooker.h>
+
 class Texture{
 public:
 	GLuint id;
@@ -8,9 +11,29 @@ public:
 	Texture(const char* path){
 		id = LoadTexture(path);
 	}
+
+	// placeholder of 1x1 grey texel, until the image is loaded in id (see AssetLoader)
+	Texture(){
+		GLubyte grey[3] = { 128, 128, 128 };
+		glGenTextures(1, &id);
+		glCheckError();
+		glState.BindTexture(GL_TEXTURE_2D, id);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+		glCheckError();
+		SetParameters();
+	}
 	
 	GLuint LoadTexture(const char* path) {
 		GLuint textureImage;
+		glGenTextures(1, &textureImage);
+		glCheckError();
+		glState.BindTexture(GL_TEXTURE_2D, textureImage);
+		// the cooked texture (compressed, with its mip levels) is uploaded as it is
+		if (LoadCookedTexture(path, GL_TEXTURE_2D)) {
+			SetParameters();
+			return textureImage;
+		}
+
 		int w, h, channels;
 		unsigned char* image;
 		image = stbi_load(path, &w, &h, &channels, STBI_rgb);
@@ -18,10 +41,6 @@ public:
 		if (image == nullptr)
 			printf("Failed to load texture %s !", path);
 
-		glGenTextures(1, &textureImage);
-		glCheckError();
-		glBindTexture(GL_TEXTURE_2D, textureImage);
-		glCheckError();
 		// 3 channels = RGB ; 4 channel = RGBA
 		if (channels==3) {
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
@@ -32,6 +51,16 @@ public:
 		}
 		glGenerateMipmap(GL_TEXTURE_2D);
 		glCheckError();
+		SetParameters();
+
+		// we free the memory once we have created an OpenGL texture
+		stbi_image_free(image);
+
+		return textureImage;
+	}
+
+	// wrapping and filtering of the bound texture
+	void SetParameters() {
 		// we set how to consider UVs outside [0,1] range
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
 		glCheckError();
@@ -42,13 +71,11 @@ public:
 		glCheckError();
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 		glCheckError();
-
-		// we free the memory once we have created an OpenGL texture
-		stbi_image_free(image);
-
-		return textureImage;
 	}
 	
-	void Delete() { glDeleteTextures(1, &id); }
+	void Delete() {
+		glState.ForgetTexture(id);
+		glDeleteTextures(1, &id);
+	}
 };
 #endif //	TEXTURE_H
\ No newline at end of file
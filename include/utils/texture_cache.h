@@ -0,0 +1,318 @@
+/*
+Texture cache
+- the textures read from files are shared by all their users (the materials of the models, the map texture...): a file
+  is uploaded once for each set of load parameters, and found again by its canonical path (separators, "." and ".."
+  resolved) in a hash map
+- Acquire gives a TextureHandle: the texture is referenced while a copy of the handle exists
+- the textures not referenced anymore stay resident, ready for the next user, until all the textures together take more
+  memory than the budget: then they are deleted, least recently used first. Referenced textures are never deleted
+  (the budget can be exceeded while they are all in use)
+- the memory of a texture is measured on the GPU after its upload (all its levels; RGB texels counted as RGBA)
+- Report() prints the residency: textures and memory, referenced and cached
+
+Usage:
+    textureCache.SetBudget(256 * 1024 * 1024);
+    TextureHandle handle = textureCache.Acquire(path);         // loaded now, or shared with the other users
+    glState.BindTextureUnit(0, GL_TEXTURE_2D, handle.Id());
+    bool load;
+    TextureHandle later = textureCache.Reserve(path, load);     // a placeholder: if load, the caller fills it
+    ... textureCache.Measure(later);                            // (e.g., AssetLoader), then measures it
+*/
+
+#pragma once
+using namespace std;
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <algorithm>
+#include <iostream>
+#include <cstdio>
+
+#include <glad/glad.h>
+#include <stb_image/stb_image.h>
+#include <utils/gl_error.h>
+#include <utils/gl_state.h>
+#include <utils/texture_cooker.h>
+#include <utils/tracer.h>
+
+// default memory budget of the textures, in MB
+#define TEXTURE_CACHE_BUDGET_MB 512
+
+class TextureCache;
+
+struct TextureCacheEntry {
+    string key;
+    GLuint id;
+    int references;
+    size_t bytes;
+    // time of the last Acquire, for the eviction of the least recently used textures
+    unsigned long long lastUse;
+};
+
+/////////////////// TextureHandle class ///////////////////////
+class TextureHandle {
+public:
+    TextureHandle() : cache(NULL), entry(NULL) {}
+    TextureHandle(const TextureHandle& other);
+    TextureHandle& operator=(const TextureHandle& other);
+    ~TextureHandle() { this->Reset(); }
+
+    GLuint Id() const { return this->entry ? this->entry->id : 0; }
+    bool Valid() const { return this->entry != NULL; }
+    // the texture is not referenced by this handle anymore
+    void Reset();
+
+private:
+    friend class TextureCache;
+    TextureCache* cache;
+    TextureCacheEntry* entry;
+
+    TextureHandle(TextureCache* cache, TextureCacheEntry* entry) : cache(cache), entry(entry) {}
+};
+
+/////////////////// TextureCache class ///////////////////////
+class TextureCache {
+public:
+    TextureCache() : budget((size_t)TEXTURE_CACHE_BUDGET_MB * 1024 * 1024), resident(0), clock(0), clearing(false) {}
+
+    void SetBudget(size_t bytes) {
+        this->budget = bytes;
+        this->Trim();
+    }
+
+    // the texture of the file (a cooked version is used if it exists, see texture_cooker.h), loaded if it is not resident
+    TextureHandle Acquire(const string& path, bool mipmaps = true) {
+        bool load;
+        TextureHandle handle = this->Reserve(path, load, mipmaps);
+        if (load) {
+            glState.BindTexture(GL_TEXTURE_2D, handle.Id());
+            loadFile(CanonicalPath(path), mipmaps);
+            this->Measure(handle);
+        }
+        return handle;
+    }
+
+    // the texture of the file; if it is not resident, a 1x1 placeholder is created and load is true: the caller must
+    // define its content (e.g., on the loading threads), then call Measure
+    TextureHandle Reserve(const string& path, bool& load, bool mipmaps = true) {
+        string key = CanonicalPath(path) + (mipmaps ? "|mipmaps" : "|base");
+        lock_guard<mutex> lock(this->entriesMutex);
+        TextureCacheEntry& entry = this->entries[key];
+        entry.lastUse = ++this->clock;
+        load = entry.key.empty();
+        if (load) {
+            entry.key = key;
+            entry.references = 0;
+            entry.bytes = 0;
+            GLubyte grey[3] = { 128, 128, 128 };
+            glGenTextures(1, &entry.id);
+            glState.BindTexture(GL_TEXTURE_2D, entry.id);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0, GL_RGB, GL_UNSIGNED_BYTE, grey);
+            setParameters(mipmaps);
+            glCheckError();
+        }
+        entry.references++;
+        return TextureHandle(this, &entry);
+    }
+
+    // memory of the texture after its content has changed, then the unused textures over the budget are deleted
+    void Measure(const TextureHandle& handle) {
+        if (!handle.Valid())
+            return;
+        size_t bytes = measure(handle.Id());
+        {
+            lock_guard<mutex> lock(this->entriesMutex);
+            this->resident += bytes - handle.entry->bytes;
+            handle.entry->bytes = bytes;
+        }
+        this->Trim();
+        tracer.Counter("texture KB", (long long)(this->ResidentBytes() / 1024));
+    }
+
+    // deletes the textures not referenced, least recently used first, until the resident memory is within the budget
+    void Trim() {
+        lock_guard<mutex> lock(this->entriesMutex);
+        if (this->resident <= this->budget)
+            return;
+        vector<TextureCacheEntry*> unused;
+        for (unordered_map<string, TextureCacheEntry>::iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+            if (it->second.references == 0)
+                unused.push_back(&it->second);
+        sort(unused.begin(), unused.end(), [](const TextureCacheEntry* a, const TextureCacheEntry* b) { return a->lastUse < b->lastUse; });
+        for (size_t i = 0; i < unused.size() && this->resident > this->budget; i++) {
+            this->resident -= unused[i]->bytes;
+            glState.ForgetTexture(unused[i]->id);
+            glDeleteTextures(1, &unused[i]->id);
+            this->entries.erase(unused[i]->key);
+        }
+        glCheckError();
+    }
+
+    size_t ResidentBytes() {
+        lock_guard<mutex> lock(this->entriesMutex);
+        return this->resident;
+    }
+
+    void Report(ostream& out) {
+        lock_guard<mutex> lock(this->entriesMutex);
+        int referenced = 0;
+        size_t referencedBytes = 0;
+        for (unordered_map<string, TextureCacheEntry>::const_iterator it = this->entries.begin(); it != this->entries.end(); ++it)
+            if (it->second.references > 0) {
+                referenced++;
+                referencedBytes += it->second.bytes;
+            }
+        out << "Textures: " << this->entries.size() << " resident (" << this->resident / 1024 << " KB, budget "
+            << this->budget / 1024 << " KB), " << referenced << " referenced (" << referencedBytes / 1024 << " KB), "
+            << this->entries.size() - referenced << " cached" << endl;
+    }
+
+    // all the textures are deleted (at the end of the application: the handles still around become invalid)
+    void Clear() {
+        lock_guard<mutex> lock(this->entriesMutex);
+        for (unordered_map<string, TextureCacheEntry>::iterator it = this->entries.begin(); it != this->entries.end(); ++it) {
+            glState.ForgetTexture(it->second.id);
+            glDeleteTextures(1, &it->second.id);
+            it->second.id = 0;
+        }
+        this->clearing = true;
+        this->resident = 0;
+    }
+
+    // path with '/' separators, without "." and with ".." applied where possible
+    static string CanonicalPath(const string& path) {
+        string normalized = path;
+        replace(normalized.begin(), normalized.end(), '\\', '/');
+        vector<string> parts;
+        size_t start = 0;
+        while (start <= normalized.size()) {
+            size_t end = normalized.find('/', start);
+            if (end == string::npos)
+                end = normalized.size();
+            string part = normalized.substr(start, end - start);
+            if (part == "..") {
+                if (!parts.empty() && parts.back() != ".." && !parts.back().empty())
+                    parts.pop_back();
+                else
+                    parts.push_back(part);
+            }
+            else if (part != "." && !(part.empty() && !parts.empty()))
+                parts.push_back(part);
+            start = end + 1;
+        }
+        string canonical;
+        for (size_t i = 0; i < parts.size(); i++)
+            canonical += (i > 0 ? "/" : "") + parts[i];
+        return canonical;
+    }
+
+private:
+    friend class TextureHandle;
+    // nodes of unordered_map do not move: the handles point to the entries
+    unordered_map<string, TextureCacheEntry> entries;
+    mutex entriesMutex;
+    size_t budget;
+    size_t resident;
+    unsigned long long clock;
+    // after Clear the handles do not touch the entries anymore
+    bool clearing;
+
+    // called by the handles, on any thread: the texture is deleted only by Trim, on the thread of the context
+    void release(TextureCacheEntry* entry) {
+        lock_guard<mutex> lock(this->entriesMutex);
+        entry->references--;
+    }
+
+    void addReference(TextureCacheEntry* entry) {
+        lock_guard<mutex> lock(this->entriesMutex);
+        entry->references++;
+    }
+
+    // the file (or its cooked version) in the bound GL_TEXTURE_2D
+    static void loadFile(const string& path, bool mipmaps) {
+        if (LoadCookedTexture(path, GL_TEXTURE_2D)) {
+            if (!mipmaps)
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            glCheckError();
+            return;
+        }
+        int width, height, channels;
+        if (!stbi_info(path.c_str(), &width, &height, &channels)) {
+            cout << "ERROR::TEXTURE_CACHE:: cannot read " << path << endl;
+            return;
+        }
+        // grey images are expanded to RGB, grey + alpha to RGBA
+        channels = (channels == 2 || channels == 4) ? 4 : 3;
+        unsigned char* image = stbi_load(path.c_str(), &width, &height, &channels, channels);
+        if (image == NULL)
+            return;
+        GLenum format = channels == 4 ? GL_RGBA : GL_RGB;
+        // rows of RGB images are not aligned to 4 bytes
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, image);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        if (mipmaps)
+            glGenerateMipmap(GL_TEXTURE_2D);
+        glCheckError();
+        stbi_image_free(image);
+    }
+
+    static void setParameters(bool mipmaps) {
+        // we set how to consider UVs outside [0,1] range
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        // we set the filtering for minification and magnification
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmaps ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    }
+
+    // bytes of all the levels of the texture
+    static size_t measure(GLuint id) {
+        glState.BindTexture(GL_TEXTURE_2D, id);
+        GLint maxLevel = 1000;
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, &maxLevel);
+        size_t bytes = 0;
+        for (GLint level = 0; level <= maxLevel; level++) {
+            GLint width = 0, height = 0, compressed = GL_FALSE;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_WIDTH, &width);
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_HEIGHT, &height);
+            if (width == 0 || height == 0)
+                break;
+            glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED, &compressed);
+            if (compressed) {
+                GLint size = 0;
+                glGetTexLevelParameteriv(GL_TEXTURE_2D, level, GL_TEXTURE_COMPRESSED_IMAGE_SIZE, &size);
+                bytes += (size_t)size;
+            }
+            else
+                bytes += (size_t)width * height * 4;
+        }
+        glCheckError();
+        return bytes;
+    }
+};
+
+TextureCache textureCache;
+
+TextureHandle::TextureHandle(const TextureHandle& other) : cache(other.cache), entry(other.entry) {
+    if (this->entry)
+        this->cache->addReference(this->entry);
+}
+
+TextureHandle& TextureHandle::operator=(const TextureHandle& other) {
+    if (other.entry)
+        other.cache->addReference(other.entry);
+    this->Reset();
+    this->cache = other.cache;
+    this->entry = other.entry;
+    return *this;
+}
+
+void TextureHandle::Reset() {
+    if (this->entry && !this->cache->clearing)
+        this->cache->release(this->entry);
+    this->cache = NULL;
+    this->entry = NULL;
+}
@@ -0,0 +1,442 @@
+/*
+Texture cooker
+- offline conversion of an image (any format read by stb_image) into a block compressed texture with its whole
+  mip chain, stored in a DDS file: BC1 (DXT1, 4 bits per texel) for opaque images, BC3 (DXT5, 8 bits per texel)
+  for images with alpha. Compared to RGBA8 the texture takes 1/8 (BC1) or 1/4 (BC3) of the memory and of the bandwidth
+- the mip levels are computed with a box filter on the decoded image, then each level is compressed
+  (blocks: van Waveren - "Real-Time DXT Compression", bounding box of the colors with an inset)
+- at run time the cooked levels are uploaded as they are (glCompressedTexImage2D): no decoding, no glGenerateMipmap.
+  The loaders look for the cooked file next to the source image (same name, .dds extension), and use the source
+  image if it is missing or if the GPU does not support S3TC
+- the cooked file stores the size and the modification time of the source image (in the reserved fields of the
+  header): if the image has changed, the cooked file is stale and it is ignored until the next --cook-textures
+
+Usage:
+    CookTexture("textures/sky/posx.jpg", CookedPath("textures/sky/posx.jpg"), false);   // e.g., --cook-textures
+    ...
+    glState.BindTexture(GL_TEXTURE_2D, id);
+    if (!LoadCookedTexture(path, GL_TEXTURE_2D)) { ... decode path with stb_image ... }
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+#include <cstdint>
+#include <iostream>
+#include <algorithm>
+#include <sys/stat.h>
+
+#include <glad/glad.h>
+#include <stb_image/stb_image.h>
+
+#include <utils/gl_error.h>
+#include <utils/tracer.h>
+
+// S3TC formats (EXT_texture_compression_s3tc: supported by all the desktop GPUs, but not part of the core profile)
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT1_EXT 0x83F1
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// DDS header values used by the cooked files
+#define DDS_MAGIC 0x20534444            // "DDS "
+#define DDS_FOURCC_DXT1 0x31545844      // "DXT1"
+#define DDS_FOURCC_DXT5 0x35545844      // "DXT5"
+#define DDSD_CAPS 0x1
+#define DDSD_HEIGHT 0x2
+#define DDSD_WIDTH 0x4
+#define DDSD_PIXELFORMAT 0x1000
+#define DDSD_MIPMAPCOUNT 0x20000
+#define DDSD_LINEARSIZE 0x80000
+#define DDPF_FOURCC 0x4
+#define DDSCAPS_COMPLEX 0x8
+#define DDSCAPS_TEXTURE 0x1000
+#define DDSCAPS_MIPMAP 0x400000
+// reserved1[0] of the cooked files: the next fields are the size (reserved1[1..2]) and the modification time
+// (reserved1[3..4]) of the source image, low 32 bits first
+#define DDS_COOKER_TAG 0x4B4F4F43       // "COOK"
+
+/////////////////// DDSHeader struct ///////////////////////
+// the header after the magic number (DirectX 9 layout, 124 bytes)
+struct DDSHeader {
+    unsigned int size;
+    unsigned int flags;
+    unsigned int height;
+    unsigned int width;
+    unsigned int linearSize;
+    unsigned int depth;
+    unsigned int mipMapCount;
+    unsigned int reserved1[11];
+    // pixel format
+    unsigned int pfSize;
+    unsigned int pfFlags;
+    unsigned int pfFourCC;
+    unsigned int pfRGBBitCount;
+    unsigned int pfMasks[4];
+    unsigned int caps;
+    unsigned int caps2;
+    unsigned int caps3;
+    unsigned int caps4;
+    unsigned int reserved2;
+};
+
+/////////////////// CookedTexture struct ///////////////////////
+struct CookedTexture {
+    GLenum format;
+    int width, height;
+    // compressed blocks of each mip level, from the largest
+    vector<vector<unsigned char> > levels;
+};
+
+// file of the cooked texture of a source image: same name, .dds extension
+string CookedPath(const string& source) {
+    size_t dot = source.find_last_of('.');
+    size_t slash = source.find_last_of("/\\");
+    if (dot == string::npos || (slash != string::npos && dot < slash))
+        return source + ".dds";
+    return source.substr(0, dot) + ".dds";
+}
+
+// bytes of a mip level of width x height texels (blocks of 4x4 texels)
+size_t CompressedLevelSize(GLenum format, int width, int height) {
+    size_t blockBytes = format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16;
+    return (size_t)((max(width, 1) + 3) / 4) * ((max(height, 1) + 3) / 4) * blockBytes;
+}
+
+namespace texture_cooker {
+
+// largest texture side of the context, read with the check of CompressedTexturesSupported (0 before it, and no cooked
+// texture is accepted): the cooked files are read on the loader threads, which cannot query the context
+inline GLint& maxTextureSize() {
+    static GLint size = 0;
+    return size;
+}
+
+}
+
+// true if the current context can sample S3TC textures (checked once)
+bool CompressedTexturesSupported() {
+    static int supported = -1;
+    if (supported < 0) {
+        supported = 0;
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint e = 0; e < count && !supported; e++) {
+            const char* name = (const char*)glGetStringi(GL_EXTENSIONS, e);
+            if (name != NULL && strcmp(name, "GL_EXT_texture_compression_s3tc") == 0)
+                supported = 1;
+        }
+        glGetIntegerv(GL_MAX_TEXTURE_SIZE, &texture_cooker::maxTextureSize());
+        glCheckError();
+        if (!supported)
+            cout << "WARNING::TEXTURE_COOKER:: S3TC not supported, cooked textures are not used" << endl;
+    }
+    return supported == 1;
+}
+
+/////////////////// block compression ///////////////////////
+namespace texture_cooker {
+
+inline unsigned short to565(const unsigned char* c) {
+    return (unsigned short)(((c[0] >> 3) << 11) | ((c[1] >> 2) << 5) | (c[2] >> 3));
+}
+
+inline void from565(unsigned short v, unsigned char* c) {
+    c[0] = (unsigned char)(((v >> 11) & 31) * 255 / 31);
+    c[1] = (unsigned char)(((v >> 5) & 63) * 255 / 63);
+    c[2] = (unsigned char)((v & 31) * 255 / 31);
+}
+
+// block of 4x4 RGBA texels starting at (x, y): the texels outside the image repeat the last row/column
+inline void fetchBlock(const vector<unsigned char>& image, int width, int height, int x, int y, unsigned char block[16][4]) {
+    for (int j = 0; j < 4; j++)
+        for (int i = 0; i < 4; i++) {
+            const unsigned char* texel = &image[4 * ((size_t)min(y + j, height - 1) * width + min(x + i, width - 1))];
+            memcpy(block[4 * j + i], texel, 4);
+        }
+}
+
+// BC1 color block (4 colors mode)
+inline void compressColor(const unsigned char block[16][4], unsigned char* out) {
+    unsigned char lo[3] = { 255, 255, 255 }, hi[3] = { 0, 0, 0 };
+    for (int t = 0; t < 16; t++)
+        for (int c = 0; c < 3; c++) {
+            lo[c] = min(lo[c], block[t][c]);
+            hi[c] = max(hi[c], block[t][c]);
+        }
+    // the endpoints are moved inside the bounding box, so the interpolated colors cover it better
+    for (int c = 0; c < 3; c++) {
+        int inset = (hi[c] - lo[c]) >> 4;
+        lo[c] = (unsigned char)min(lo[c] + inset, 255);
+        hi[c] = (unsigned char)max(hi[c] - inset, 0);
+    }
+    unsigned short c0 = to565(hi), c1 = to565(lo);
+    // c0 > c1 selects the 4 colors mode
+    if (c0 < c1)
+        swap(c0, c1);
+    unsigned char palette[4][3];
+    from565(c0, palette[0]);
+    from565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (unsigned char)((2 * palette[0][c] + palette[1][c]) / 3);
+        palette[3][c] = (unsigned char)((palette[0][c] + 2 * palette[1][c]) / 3);
+    }
+    unsigned int indices = 0;
+    if (c0 != c1) {
+        for (int t = 0; t < 16; t++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+                int distance = 0;
+                for (int c = 0; c < 3; c++)
+                    distance += (block[t][c] - palette[p][c]) * (block[t][c] - palette[p][c]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (unsigned int)best << (2 * t);
+        }
+    }
+    out[0] = (unsigned char)(c0 & 255);
+    out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 255);
+    out[3] = (unsigned char)(c1 >> 8);
+    for (int b = 0; b < 4; b++)
+        out[4 + b] = (unsigned char)((indices >> (8 * b)) & 255);
+}
+
+// BC3 alpha block (8 values mode)
+inline void compressAlpha(const unsigned char block[16][4], unsigned char* out) {
+    unsigned char lo = 255, hi = 0;
+    for (int t = 0; t < 16; t++) {
+        lo = min(lo, block[t][3]);
+        hi = max(hi, block[t][3]);
+    }
+    int palette[8];
+    palette[0] = hi;
+    palette[1] = lo;
+    for (int p = 1; p < 7; p++)
+        palette[p + 1] = ((7 - p) * hi + p * lo) / 7;
+    unsigned long long indices = 0;
+    if (hi != lo) {
+        for (int t = 0; t < 16; t++) {
+            int best = 0, bestDistance = 256;
+            for (int p = 0; p < 8; p++) {
+                int distance = abs(block[t][3] - palette[p]);
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= (unsigned long long)best << (3 * t);
+        }
+    }
+    out[0] = hi;
+    out[1] = lo;
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = (unsigned char)((indices >> (8 * b)) & 255);
+}
+
+inline void compressLevel(const vector<unsigned char>& image, int width, int height, bool alpha, vector<unsigned char>& out) {
+    size_t blockBytes = alpha ? 16 : 8;
+    out.resize(CompressedLevelSize(alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT, width, height));
+    unsigned char block[16][4];
+    unsigned char* dst = &out[0];
+    for (int y = 0; y < height; y += 4)
+        for (int x = 0; x < width; x += 4) {
+            fetchBlock(image, width, height, x, y, block);
+            if (alpha)
+                compressAlpha(block, dst);
+            compressColor(block, dst + blockBytes - 8);
+            dst += blockBytes;
+        }
+}
+
+// next mip level: average of 2x2 texels (the last row/column of odd sizes is repeated)
+inline void downsample(const vector<unsigned char>& image, int width, int height, vector<unsigned char>& out) {
+    int w = max(width / 2, 1), h = max(height / 2, 1);
+    out.resize((size_t)w * h * 4);
+    for (int y = 0; y < h; y++)
+        for (int x = 0; x < w; x++) {
+            int x0 = min(2 * x, width - 1), x1 = min(2 * x + 1, width - 1);
+            int y0 = min(2 * y, height - 1), y1 = min(2 * y + 1, height - 1);
+            for (int c = 0; c < 4; c++) {
+                int sum = image[4 * ((size_t)y0 * width + x0) + c] + image[4 * ((size_t)y0 * width + x1) + c]
+                        + image[4 * ((size_t)y1 * width + x0) + c] + image[4 * ((size_t)y1 * width + x1) + c];
+                out[4 * ((size_t)y * w + x) + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+}
+
+}
+
+namespace texture_cooker {
+
+// size and modification time of the source image, as stored in the reserved fields of the header
+inline bool sourceStamp(const string& path, unsigned int stamp[4]) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0)
+        return false;
+    unsigned long long size = (unsigned long long)info.st_size, time = (unsigned long long)info.st_mtime;
+    stamp[0] = (unsigned int)(size & 0xFFFFFFFF);
+    stamp[1] = (unsigned int)(size >> 32);
+    stamp[2] = (unsigned int)(time & 0xFFFFFFFF);
+    stamp[3] = (unsigned int)(time >> 32);
+    return true;
+}
+
+}
+
+// compresses the source image (with its mip chain, if mipmaps) and writes it in destination
+bool CookTexture(const string& source, const string& destination, bool mipmaps) {
+    ScopedTrace trace("cook texture");
+    int width, height, channels;
+    unsigned char* pixels = stbi_load(source.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+    if (pixels == NULL) {
+        cout << "ERROR::TEXTURE_COOKER:: cannot read " << source << endl;
+        return false;
+    }
+    vector<unsigned char> image(pixels, pixels + (size_t)width * height * 4);
+    stbi_image_free(pixels);
+
+    bool alpha = channels == 2 || channels == 4;
+    CookedTexture cooked;
+    cooked.format = alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+    cooked.width = width;
+    cooked.height = height;
+    int w = width, h = height;
+    vector<unsigned char> next;
+    while (true) {
+        cooked.levels.push_back(vector<unsigned char>());
+        texture_cooker::compressLevel(image, w, h, alpha, cooked.levels.back());
+        if (!mipmaps || (w == 1 && h == 1))
+            break;
+        texture_cooker::downsample(image, w, h, next);
+        image.swap(next);
+        w = max(w / 2, 1);
+        h = max(h / 2, 1);
+    }
+
+    FILE* file = fopen(destination.c_str(), "wb");
+    if (!file) {
+        cout << "ERROR::TEXTURE_COOKER:: cannot write " << destination << endl;
+        return false;
+    }
+    DDSHeader header;
+    memset(&header, 0, sizeof(header));
+    header.size = sizeof(DDSHeader);
+    header.flags = DDSD_CAPS | DDSD_HEIGHT | DDSD_WIDTH | DDSD_PIXELFORMAT | DDSD_LINEARSIZE | DDSD_MIPMAPCOUNT;
+    header.width = width;
+    header.height = height;
+    header.linearSize = (unsigned int)cooked.levels[0].size();
+    header.mipMapCount = (unsigned int)cooked.levels.size();
+    header.pfSize = 32;
+    header.pfFlags = DDPF_FOURCC;
+    header.pfFourCC = alpha ? DDS_FOURCC_DXT5 : DDS_FOURCC_DXT1;
+    header.caps = DDSCAPS_TEXTURE | (cooked.levels.size() > 1 ? DDSCAPS_COMPLEX | DDSCAPS_MIPMAP : 0);
+    if (texture_cooker::sourceStamp(source, &header.reserved1[1]))
+        header.reserved1[0] = DDS_COOKER_TAG;
+    unsigned int magic = DDS_MAGIC;
+    fwrite(&magic, sizeof(magic), 1, file);
+    fwrite(&header, sizeof(header), 1, file);
+    size_t bytes = 0;
+    for (size_t l = 0; l < cooked.levels.size(); l++) {
+        fwrite(&cooked.levels[l][0], 1, cooked.levels[l].size(), file);
+        bytes += cooked.levels[l].size();
+    }
+    bool written = ferror(file) == 0;
+    fclose(file);
+    printf("Cooked %s: %dx%d, %d levels, %s, %zu KB (RGBA8 level 0: %zu KB)\n", destination.c_str(), width, height,
+        (int)cooked.levels.size(), alpha ? "BC3" : "BC1", bytes / 1024, (size_t)width * height * 4 / 1024);
+    return written;
+}
+
+// reads the cooked texture of the source image (only the DXT1/DXT5 files written by CookTexture are accepted).
+// A cooked file older than the source image (or written without its stamp) is ignored, as a file whose size or
+// levels the GPU cannot take or the file does not hold
+bool ReadCookedTexture(const string& source, CookedTexture& cooked) {
+    string path = CookedPath(source);
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    unsigned int magic = 0;
+    DDSHeader header;
+    bool valid = fread(&magic, sizeof(magic), 1, file) == 1 && fread(&header, sizeof(header), 1, file) == 1
+        && magic == DDS_MAGIC && header.size == sizeof(DDSHeader) && (header.pfFlags & DDPF_FOURCC)
+        && (header.pfFourCC == DDS_FOURCC_DXT1 || header.pfFourCC == DDS_FOURCC_DXT5);
+    unsigned int stamp[4];
+    if (valid && (header.reserved1[0] != DDS_COOKER_TAG || !texture_cooker::sourceStamp(source, stamp)
+            || memcmp(stamp, &header.reserved1[1], sizeof(stamp)) != 0)) {
+        fclose(file);
+        cout << "WARNING::TEXTURE_COOKER:: " << path << " does not match " << source << " (changed after the cooking): run --cook-textures again" << endl;
+        return false;
+    }
+    if (valid) {
+        cooked.format = header.pfFourCC == DDS_FOURCC_DXT1 ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        cooked.width = header.width;
+        cooked.height = header.height;
+        // the header sizes the arrays: check it against the GPU and the rest of the file first
+        unsigned int levels = (header.flags & DDSD_MIPMAPCOUNT) && header.mipMapCount > 0 ? header.mipMapCount : 1;
+        unsigned int maxLevels = 1;
+        while ((max(header.width, header.height) >> maxLevels) > 0)
+            maxLevels++;
+        GLint maxSize = texture_cooker::maxTextureSize();
+        valid = header.width > 0 && header.height > 0 && levels <= maxLevels
+            && header.width <= (unsigned int)max(maxSize, 0) && header.height <= (unsigned int)max(maxSize, 0);
+        long start = valid ? ftell(file) : -1;
+        valid = valid && start >= 0 && fseek(file, 0, SEEK_END) == 0;
+        long end = valid ? ftell(file) : -1;
+        valid = valid && end >= start && fseek(file, start, SEEK_SET) == 0;
+        uint64_t bytes = 0;
+        for (unsigned int l = 0, w = header.width, h = header.height; l < levels && valid; l++) {
+            bytes += CompressedLevelSize(cooked.format, (int)w, (int)h);
+            w = max(w / 2, 1u);
+            h = max(h / 2, 1u);
+        }
+        valid = valid && bytes <= (uint64_t)(end - start);
+        if (valid)
+            cooked.levels.resize(levels);
+        int w = cooked.width, h = cooked.height;
+        for (size_t l = 0; l < cooked.levels.size() && valid; l++) {
+            cooked.levels[l].resize(CompressedLevelSize(cooked.format, w, h));
+            valid = fread(&cooked.levels[l][0], 1, cooked.levels[l].size(), file) == cooked.levels[l].size();
+            w = max(w / 2, 1);
+            h = max(h / 2, 1);
+        }
+    }
+    fclose(file);
+    if (!valid) {
+        cooked.levels.clear();
+        cout << "WARNING::TEXTURE_COOKER:: " << path << " is not a valid cooked texture" << endl;
+    }
+    return valid;
+}
+
+// uploads all the levels in target (GL_TEXTURE_2D or a face of a cube map), whose texture must be bound.
+// The levels after the last one are excluded from sampling (GL_TEXTURE_MAX_LEVEL, on the bound texture)
+void UploadCookedTexture(const CookedTexture& cooked, GLenum target, GLenum textureTarget) {
+    int w = cooked.width, h = cooked.height;
+    for (size_t l = 0; l < cooked.levels.size(); l++) {
+        glCompressedTexImage2D(target, (GLint)l, cooked.format, w, h, 0, (GLsizei)cooked.levels[l].size(), &cooked.levels[l][0]);
+        w = max(w / 2, 1);
+        h = max(h / 2, 1);
+    }
+    glTexParameteri(textureTarget, GL_TEXTURE_MAX_LEVEL, (GLint)cooked.levels.size() - 1);
+    glCheckError();
+}
+
+// uploads the cooked version of the source image, if it exists and it can be used. The texture must be bound
+bool LoadCookedTexture(const string& source, GLenum target, GLenum textureTarget = GL_TEXTURE_2D) {
+    if (!CompressedTexturesSupported())
+        return false;
+    CookedTexture cooked;
+    if (!ReadCookedTexture(source, cooked))
+        return false;
+    UploadCookedTexture(cooked, target, textureTarget);
+    return true;
+}
@@ -0,0 +1,250 @@
+/*
+Event tracer
+- records spans (begin/end), counters and frame markers, with a timestamp in microseconds, on any thread
+- each thread writes in its own buffer, created the first time the thread records an event: recording takes
+  no lock (only the creation of the buffer does), and only the owner thread writes in a buffer
+- the events are written as Chrome trace JSON, which can be opened in chrome://tracing or in ui.perfetto.dev
+- when the tracer is disabled (the default) each call costs only the check of a flag
+
+The names of the events are not copied: they must be string literals (or strings living until the trace is written).
+When a buffer is full, the next events of that thread are dropped (and counted). In ring mode the buffers are
+circular instead: each thread keeps only its most recent events, and the tracer can stay enabled for the whole run
+(e.g., for the flight recorder, which writes only the events around a slow frame). Each slot of a buffer has a
+sequence number (a seqlock): the writer marks the slot as busy while it fills it, and the reader keeps a copied event
+only if the slot held that same event, complete, before and after the copy.
+
+Usage:
+    tracer.Enable();
+    tracer.SetThreadName("main");
+    {
+        ScopedTrace trace("load");
+        ...
+    }
+    tracer.Counter("particles", count);
+    tracer.Frame(frame);
+    tracer.Write("trace.json");
+*/
+
+#pragma once
+using namespace std;
+
+#include <vector>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <climits>
+#include <cstdio>
+#include <iostream>
+
+// default number of events each thread can record
+#define TRACE_EVENTS_PER_THREAD (1 << 20)
+
+/////////////////// TraceEvent struct ///////////////////////
+struct TraceEvent {
+    const char* name;
+    // 'B' = begin of a span, 'E' = end of a span, 'C' = counter, 'F' = frame marker
+    char phase;
+    // microseconds since the tracer was enabled
+    long long time;
+    // value of a counter, or index of a frame
+    long long value;
+};
+
+/////////////////// TraceSlot struct ///////////////////////
+// an event in the buffer of a thread. The fields are atomic (relaxed): the writer and a reader can touch the same slot,
+// and sequence tells the reader if the copy is valid
+struct TraceSlot {
+    // 2 * index + 2 when the slot holds the complete event index, odd while it is being written, 0 if never written
+    atomic<size_t> sequence;
+    atomic<const char*> name;
+    atomic<char> phase;
+    atomic<long long> time;
+    atomic<long long> value;
+
+    TraceSlot() : sequence(0), name(""), phase(0), time(0), value(0) {}
+};
+
+/////////////////// Tracer class ///////////////////////
+class Tracer {
+public:
+    Tracer() : enabled(false), capacity(TRACE_EVENTS_PER_THREAD), ring(false), nextThread(0), start(chrono::steady_clock::now()) {}
+
+    ~Tracer() {
+        for (size_t b = 0; b < buffers.size(); b++)
+            delete buffers[b];
+    }
+
+    // events recorded before Enable() are ignored; the time of the events starts from here.
+    // The mode and the size of the buffers must be chosen before any thread records an event
+    void Enable(size_t eventsPerThread = TRACE_EVENTS_PER_THREAD, bool ringMode = false) {
+        capacity = eventsPerThread;
+        ring = ringMode;
+        start = chrono::steady_clock::now();
+        enabled.store(true, memory_order_release);
+    }
+
+    void Disable() { enabled.store(false, memory_order_release); }
+
+    bool Enabled() const { return enabled.load(memory_order_relaxed); }
+
+    // name shown for the calling thread in the timeline
+    void SetThreadName(const string& name) {
+        if (!Enabled())
+            return;
+        Buffer* buffer = threadBuffer();
+        lock_guard<mutex> lock(buffersMutex);
+        buffer->name = name;
+    }
+
+    void Begin(const char* name) { record(name, 'B', 0); }
+    void End() { record("", 'E', 0); }
+    void Counter(const char* name, long long value) { record(name, 'C', value); }
+    void Frame(long long index) { record("frame", 'F', index); }
+
+    // current time of the trace, in microseconds
+    long long Now() const {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+
+    // writes the events of all the threads with time in [from, to] (default: all of them).
+    // In ring mode the other threads can keep recording: the events they overwrite (or are still writing) during the
+    // copy are skipped
+    bool Write(const string& path, long long from = LLONG_MIN, long long to = LLONG_MAX) {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file) {
+            cout << "ERROR::TRACER::Cannot write " << path << endl;
+            return false;
+        }
+        lock_guard<mutex> lock(buffersMutex);
+        fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+        bool first = true;
+        size_t dropped = 0;
+        for (size_t b = 0; b < buffers.size(); b++) {
+            Buffer* buffer = buffers[b];
+            if (!buffer->name.empty()) {
+                fprintf(file, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": \"%s\"}}",
+                    first ? "" : ",", buffer->id, buffer->name.c_str());
+                first = false;
+            }
+            size_t size = buffer->size;
+            size_t count = buffer->count.load(memory_order_acquire);
+            size_t oldest = (ring && count > size) ? count - size : 0;
+            TraceEvent event;
+            for (size_t e = oldest; e < count && (ring || e < size); e++) {
+                if (!readEvent(buffer->slots[e % size], e, event))
+                    continue;
+                if (event.time < from || event.time > to)
+                    continue;
+                writeEvent(file, event, buffer->id, first);
+                first = false;
+            }
+            if (!ring && count > size)
+                dropped += count - size;
+        }
+        fprintf(file, "\n]}\n");
+        fclose(file);
+        if (dropped > 0)
+            cout << "WARNING::TRACER::" << dropped << " events dropped (buffers full)" << endl;
+        return true;
+    }
+
+private:
+    struct Buffer {
+        unsigned int id;
+        string name;
+        TraceSlot* slots;
+        size_t size;
+        // events recorded (also the dropped ones): written only by the owner thread
+        atomic<size_t> count;
+
+        ~Buffer() { delete[] slots; }
+    };
+
+    atomic<bool> enabled;
+    size_t capacity;
+    bool ring;
+    mutex buffersMutex;
+    vector<Buffer*> buffers;
+    unsigned int nextThread;
+    chrono::steady_clock::time_point start;
+
+    Buffer* threadBuffer() {
+        // the buffers are owned by the tracer: they outlive their threads, so their events are kept
+        static thread_local Buffer* buffer = NULL;
+        if (buffer == NULL) {
+            buffer = new Buffer();
+            buffer->slots = new TraceSlot[capacity];
+            buffer->size = capacity;
+            buffer->count.store(0, memory_order_relaxed);
+            lock_guard<mutex> lock(buffersMutex);
+            buffer->id = nextThread++;
+            buffers.push_back(buffer);
+        }
+        return buffer;
+    }
+
+    void record(const char* name, char phase, long long value) {
+        if (!enabled.load(memory_order_relaxed))
+            return;
+        Buffer* buffer = threadBuffer();
+        size_t index = buffer->count.load(memory_order_relaxed);
+        if (ring || index < buffer->size) {
+            TraceSlot& slot = buffer->slots[index % buffer->size];
+            // the slot is busy until the last store: a reader copying it meanwhile discards the copy
+            slot.sequence.store(2 * index + 1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_release);
+            slot.name.store(name, memory_order_relaxed);
+            slot.phase.store(phase, memory_order_relaxed);
+            slot.time.store(Now(), memory_order_relaxed);
+            slot.value.store(value, memory_order_relaxed);
+            slot.sequence.store(2 * index + 2, memory_order_release);
+        }
+        // the event is visible to the reader only after it is complete
+        buffer->count.store(index + 1, memory_order_release);
+    }
+
+    // copy of the event index from its slot: false if the slot holds another event, or it changed during the copy
+    static bool readEvent(const TraceSlot& slot, size_t index, TraceEvent& event) {
+        if (slot.sequence.load(memory_order_acquire) != 2 * index + 2)
+            return false;
+        event.name = slot.name.load(memory_order_relaxed);
+        event.phase = slot.phase.load(memory_order_relaxed);
+        event.time = slot.time.load(memory_order_relaxed);
+        event.value = slot.value.load(memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        return slot.sequence.load(memory_order_relaxed) == 2 * index + 2;
+    }
+
+    static void writeEvent(FILE* file, const TraceEvent& event, unsigned int thread, bool first) {
+        const char* separator = first ? "" : ",";
+        switch (event.phase) {
+            case 'B':
+                fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %lld, \"pid\": 1, \"tid\": %u}", separator, event.name, event.time, thread);
+                break;
+            case 'E':
+                fprintf(file, "%s\n{\"ph\": \"E\", \"ts\": %lld, \"pid\": 1, \"tid\": %u}", separator, event.time, thread);
+                break;
+            case 'C':
+                fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"C\", \"ts\": %lld, \"pid\": 1, \"tid\": %u, \"args\": {\"value\": %lld}}",
+                    separator, event.name, event.time, thread, event.value);
+                break;
+            // frame markers are global instant events, drawn as lines across all the threads
+            case 'F':
+                fprintf(file, "%s\n{\"name\": \"%s\", \"ph\": \"i\", \"s\": \"g\", \"ts\": %lld, \"pid\": 1, \"tid\": %u, \"args\": {\"frame\": %lld}}",
+                    separator, event.name, event.time, thread, event.value);
+                break;
+        }
+    }
+};
+
+// the single instance used by the whole application
+Tracer tracer;
+
+/////////////////// ScopedTrace struct ///////////////////////
+// a span from the constructor to the end of the block
+struct ScopedTrace {
+    ScopedTrace(const char* name) { tracer.Begin(name); }
+    ~ScopedTrace() { tracer.End(); }
+};
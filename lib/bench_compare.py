@@ -0,0 +1,56 @@
+# Compares two benchmark reports (see include/utils/benchmark.h) and flags the regressions.
+# usage: python bench_compare.py baseline.json current.json [threshold_percent]
+# The exit code is 1 if at least one value is worse than the baseline by more than the threshold (default 5%).
+import json
+import sys
+
+# values smaller than this (ms) are too noisy to be compared
+MIN_MS = 0.05
+
+
+def load(path):
+    with open(path, "r") as f:
+        report = json.load(f)
+    return report, {s["name"]: s for s in report["scenarios"]}
+
+
+def compare(name, old, new, threshold):
+    if old is None or new is None or max(old, new) < MIN_MS:
+        return False
+    change = (new - old) / old * 100.0 if old > 0 else 0.0
+    regression = change > threshold
+    print("  %-28s %10.3f %10.3f %+8.1f%%%s" % (name, old, new, change, "  REGRESSION" if regression else ""))
+    return regression
+
+
+def main():
+    if len(sys.argv) < 3:
+        print("usage: python bench_compare.py baseline.json current.json [threshold_percent]")
+        return 2
+    threshold = float(sys.argv[3]) if len(sys.argv) > 3 else 5.0
+    baseline_report, baseline = load(sys.argv[1])
+    current_report, current = load(sys.argv[2])
+    if baseline_report["resolution"] != current_report["resolution"]:
+        print("WARNING: different resolutions", baseline_report["resolution"], current_report["resolution"])
+
+    regressions = 0
+    for name, new in current.items():
+        old = baseline.get(name)
+        if old is None:
+            print("%s: not in the baseline" % name)
+            continue
+        print("%s%s" % (name, " " * (30 - len(name)) + "  baseline    current"))
+        for stat in ["mean", "p50", "p95", "p99", "max"]:
+            regressions += compare("frame_ms." + stat, old["frame_ms"][stat], new["frame_ms"][stat], threshold)
+        for stage, times in sorted(new["passes"].items()):
+            old_times = old["passes"].get(stage, {})
+            regressions += compare(stage + ".cpu_ms", old_times.get("cpu_ms"), times["cpu_ms"], threshold)
+            regressions += compare(stage + ".gpu_ms", old_times.get("gpu_ms"), times["gpu_ms"], threshold)
+        regressions += compare("draw_calls.mean", old["draw_calls"]["mean"], new["draw_calls"]["mean"], threshold)
+
+    print("%d regression(s) over %.1f%%" % (regressions, threshold))
+    return 1 if regressions > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
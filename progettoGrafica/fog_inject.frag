@@ -0,0 +1,113 @@
+/*
+fog_inject.frag: density and in-scattered light of the froxels of a slice of the fog volume.
+The froxel is sampled at a jittered depth, and blended with the result of the previous frame
+at the same world position (temporal reprojection).
+*/
+
+#version 330 core
+
+// scattering (rgb) and extinction (a) of the froxel
+out vec4 colorFrag;
+
+in vec2 interp_UV;
+
+// scattering of the previous frame
+uniform sampler3D history;
+uniform float historyWeight;
+uniform mat4 previousViewProjectionMatrix;
+
+// grid size and slice distribution
+uniform vec3 volumeSize;
+uniform float volumeNear;
+uniform float volumeFar;
+uniform int slice;
+// position of the sample inside the slice, in [0,1)
+uniform float jitter;
+
+uniform mat4 inverseViewMatrix;
+// projection[0][0] and projection[1][1]
+uniform vec2 projectionScale;
+
+// the light incidence direction of the directional light
+uniform vec3 lightVector;
+// multiplier of the fog density
+uniform float density;
+uniform float time;
+
+// fog variables: fogColor is the light coming from the sky, sunColor the one coming from the directional light
+const vec3 fogColor = vec3(0.5, 0.5, 0.5);
+const vec3 sunColor = vec3(0.15, 0.05, 0.0);
+// uniform density everywhere, and additional density in the valley around the volcano (below valleyHeight)
+const float globalDensity = 0.004;
+const float valleyDensity = 0.025;
+const float valleyHeight = -20.0;
+const float heightFalloff = 0.08;
+// anisotropy of the Henyey-Greenstein phase function
+const float anisotropy = 0.3;
+const vec3 windVelocity = vec3(1.5, 0.0, 0.5);
+
+const float PI = 3.14159265359;
+
+// view space depth of a (continuous) slice coordinate
+float slice_depth(float s) {
+    return volumeNear * pow(volumeFar / volumeNear, s / volumeSize.z);
+}
+
+// continuous slice coordinate of a view space depth
+float depth_slice(float z) {
+    return volumeSize.z * log(max(z, volumeNear) / volumeNear) / log(volumeFar / volumeNear);
+}
+
+float hash(vec3 p) {
+    p = fract(p * 0.3183099 + 0.1);
+    p *= 17.0;
+    return fract(p.x * p.y * p.z * (p.x + p.y + p.z));
+}
+
+// value noise, to break the fog in patches
+float noise(vec3 x) {
+    vec3 i = floor(x);
+    vec3 f = fract(x);
+    f = f * f * (3.0 - 2.0 * f);
+    return mix(mix(mix(hash(i + vec3(0, 0, 0)), hash(i + vec3(1, 0, 0)), f.x),
+                   mix(hash(i + vec3(0, 1, 0)), hash(i + vec3(1, 1, 0)), f.x), f.y),
+               mix(mix(hash(i + vec3(0, 0, 1)), hash(i + vec3(1, 0, 1)), f.x),
+                   mix(hash(i + vec3(0, 1, 1)), hash(i + vec3(1, 1, 1)), f.x), f.y), f.z);
+}
+
+float fog_density(vec3 p) {
+    float valley = exp(-max(p.y - valleyHeight, 0.0) * heightFalloff);
+    float patches = 0.5 + noise(p * 0.05 + windVelocity * time * 0.05);
+    return density * (globalDensity + valleyDensity * valley * patches);
+}
+
+float phase(float cosTheta) {
+    float g2 = anisotropy * anisotropy;
+    return (1.0 - g2) / (4.0 * PI * pow(1.0 + g2 - 2.0 * anisotropy * cosTheta, 1.5));
+}
+
+void main()
+{
+    // world position of the sample
+    float z = slice_depth(float(slice) + jitter);
+    vec2 ndc = interp_UV * 2.0 - 1.0;
+    vec3 viewPos = vec3(ndc.x * z / projectionScale.x, ndc.y * z / projectionScale.y, -z);
+    vec3 worldPos = (inverseViewMatrix * vec4(viewPos, 1.0)).xyz;
+    vec3 eyePosition = inverseViewMatrix[3].xyz;
+
+    float sigma = fog_density(worldPos);
+    vec3 rayDir = normalize(worldPos - eyePosition);
+    // light scattered towards the camera (the phase function is normalized, so the sky light is scaled by 4 PI)
+    vec3 light = fogColor + sunColor * 4.0 * PI * phase(dot(rayDir, normalize(lightVector)));
+    vec4 current = vec4(light * sigma, sigma);
+
+    // reprojection: the same world position in the previous frame
+    vec4 previousClip = previousViewProjectionMatrix * vec4(worldPos, 1.0);
+    if (historyWeight > 0.0 && previousClip.w > 0.0) {
+        vec3 uvw = vec3(previousClip.xy / previousClip.w * 0.5 + 0.5, depth_slice(previousClip.w) / volumeSize.z);
+        if (all(greaterThanEqual(uvw, vec3(0.0))) && all(lessThanEqual(uvw, vec3(1.0)))) {
+            current = mix(current, texture(history, uvw), historyWeight);
+        }
+    }
+    colorFrag = current;
+}
@@ -0,0 +1,48 @@
+/*
+fog_integrate.frag: integration of the fog volume from the camera to the far side of each froxel.
+The slices are integrated front to back, one per draw: each one adds its scattering to the result of the previous
+slice, so each froxel reads a single integrated value and a single scattering value.
+The scattering of each slice is integrated analytically, assuming constant density inside the slice.
+Reference: Hillaire - "Physically Based and Unified Volumetric Rendering in Frostbite"
+*/
+
+#version 330 core
+
+// in-scattered light (rgb) and transmittance (a): the slice of the volume, and the copy read by the next slice
+layout(location = 0) out vec4 colorFrag;
+layout(location = 1) out vec4 accumulatedFrag;
+
+// scattering (rgb) and extinction (a) of the froxels
+uniform sampler3D scattering;
+// in-scattered light and transmittance up to the previous slice (not read by the first slice)
+uniform sampler2D previous;
+
+// grid size and slice distribution
+uniform vec3 volumeSize;
+uniform float volumeNear;
+uniform float volumeFar;
+uniform int slice;
+
+float slice_depth(float s) {
+    return volumeNear * pow(volumeFar / volumeNear, s / volumeSize.z);
+}
+
+void main()
+{
+    ivec2 froxel = ivec2(gl_FragCoord.xy);
+    vec4 integrated = vec4(0.0, 0.0, 0.0, 1.0);
+    // the first slice starts at the camera
+    float previousDepth = 0.0;
+    if (slice > 0) {
+        integrated = texelFetch(previous, froxel, 0);
+        previousDepth = slice_depth(float(slice));
+    }
+    float depth = slice_depth(float(slice + 1));
+    vec4 s = texelFetch(scattering, ivec3(froxel, slice), 0);
+    float sigma = max(s.a, 0.00001);
+    float sliceTransmittance = exp(-sigma * (depth - previousDepth));
+    integrated.rgb += integrated.a * s.rgb * (1.0 - sliceTransmittance) / sigma;
+    integrated.a *= sliceTransmittance;
+    colorFrag = integrated;
+    accumulatedFrag = integrated;
+}
@@ -0,0 +1,61 @@
+/*
+fog_pass.frag: fog applied once per pixel, after the scene has been rendered in a framebuffer.
+The view space depth of the pixel is reconstructed from the depth buffer, and used to read the
+in-scattered light and the transmittance from the integrated fog volume (see fog_volume.h).
+The scene can be rendered at a lower resolution, in a corner of the framebuffer: it is scaled up here.
+*/
+
+#version 330 core
+
+// output shader variable
+out vec4 colorFrag;
+
+in vec2 interp_UV;
+
+// color and depth of the rendered scene
+uniform sampler2D sceneColor;
+uniform sampler2D sceneDepth;
+// in-scattered light (rgb) and transmittance (a) from the camera to each froxel
+uniform sampler3D fogVolume;
+
+uniform mat4 inverseProjectionMatrix;
+
+// part of the framebuffer covered by the scene, and largest coordinate which does not filter outside of it
+uniform vec2 uvScale;
+uniform vec2 uvMax;
+// false: the scene is only scaled up
+uniform bool applyFog;
+
+// grid size and slice distribution
+uniform vec3 volumeSize;
+uniform float volumeNear;
+uniform float volumeFar;
+
+// continuous slice coordinate of a view space depth
+float depth_slice(float z) {
+    return volumeSize.z * log(max(z, volumeNear) / volumeNear) / log(volumeFar / volumeNear);
+}
+
+void main()
+{
+    vec2 sceneUV = min(interp_UV * uvScale, uvMax);
+    vec4 scene = texture(sceneColor, sceneUV);
+    if (!applyFog) {
+        colorFrag = vec4(scene.rgb, 1.0);
+        return;
+    }
+    float depth = texture(sceneDepth, sceneUV).r;
+    // nothing has been written in the depth buffer: it's the sky, which is not fogged
+    if (depth >= 1.0) {
+        colorFrag = vec4(scene.rgb, 1.0);
+        return;
+    }
+
+    vec4 ndc = vec4(interp_UV * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 mvPosition = inverseProjectionMatrix * ndc;
+    float z = -mvPosition.z / mvPosition.w;
+    // froxel k stores the fog up to the far side of the slice, at the center of the texel
+    vec4 fog = texture(fogVolume, vec3(interp_UV, (depth_slice(z) - 0.5) / volumeSize.z));
+
+    colorFrag = vec4(scene.rgb * fog.a + fog.rgb, 1.0);
+}
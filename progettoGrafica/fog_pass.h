@@ -0,0 +1,206 @@
+#ifndef FOG_PASS_H
+#define FOG_PASS_H
+
+#include <utils/gl_error.h>
+#include <utils/gl_state.h>
+#include <utils/profiler.h>
+
+#include <utils/shader_v1.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "fog_volume.h"
+
+// Fog as a post processing pass: when the fog is active the scene is rendered in a framebuffer,
+// then a full screen triangle applies the fog to each pixel, reading the fog volume at the depth of the pixel.
+// The material shaders do not know anything about the fog.
+// The same pass renders the scene at a lower internal resolution (render scale < 1): the scene is rendered in a
+// corner of the framebuffer, and the full screen triangle scales it up to the output.
+class FogPass {
+private:
+	Shader *shader;
+	GLuint fbo;
+	GLuint colorTexture;
+	GLuint depthTexture;
+	GLuint vao;
+	// framebuffer where the final image goes: the screen, or an offscreen target in headless mode
+	GLuint output;
+	int width, height;
+	// the scene is rendered in the framebuffer, and the fog is applied
+	bool rendering, fogging;
+	// the scene is always rendered in the framebuffer (e.g., other passes need its depth texture)
+	bool alwaysRendering;
+	float renderScale;
+	GLint inverseProjectionLocation, uvScaleLocation, uvMaxLocation, applyFogLocation;
+	void create_targets();
+public:
+	FogVolume volume;
+
+	FogPass(int width, int height);
+	void SetOutput(GLuint framebuffer);
+	// fraction in (0, 1] of the output resolution used to render the scene
+	void SetRenderScale(float scale);
+	// if true the scene goes to the framebuffer of the pass also without fog, at full resolution
+	void SetAlwaysRendering(bool always);
+	// framebuffer of the scene, and its depth texture
+	GLuint Framebuffer() const { return fbo; }
+	GLuint DepthTexture() const { return depthTexture; }
+	// to call before the scene is rendered: if the fog is active the scene is redirected to the framebuffer
+	void Begin(bool active);
+	// to call after the scene is rendered: if the scene is in the framebuffer, the fog volume is updated
+	// and the fogged image is drawn on the screen. density is a multiplier of the fog density
+	void End(glm::mat4 &projection, glm::mat4 &view, glm::vec3 lightVector, float density, float time);
+	void Delete();
+};
+
+FogPass::FogPass(int width, int height){
+	this->width = width;
+	this->height = height;
+	this->rendering = false;
+	this->fogging = false;
+	this->alwaysRendering = false;
+	this->renderScale = 1.0f;
+	this->output = 0;
+	create_targets();
+
+	// the full screen triangle is generated in the vertex shader, but a VAO must be bound to draw
+	glGenVertexArrays(1, &vao);
+	glCheckError();
+
+	//setup shader
+	shader = new Shader("../progettoGrafica/fog_pass.vert", "../progettoGrafica/fog_pass.frag");
+	shader->Use();
+	glUniform1i(glGetUniformLocation(shader->Program, "sceneColor"), 0);
+	glCheckError();
+	glUniform1i(glGetUniformLocation(shader->Program, "sceneDepth"), 1);
+	glCheckError();
+	glUniform1i(glGetUniformLocation(shader->Program, "fogVolume"), 2);
+	glCheckError();
+	glUniform3f(glGetUniformLocation(shader->Program, "volumeSize"), FOG_VOLUME_WIDTH, FOG_VOLUME_HEIGHT, FOG_VOLUME_DEPTH);
+	glUniform1f(glGetUniformLocation(shader->Program, "volumeNear"), FOG_VOLUME_NEAR);
+	glUniform1f(glGetUniformLocation(shader->Program, "volumeFar"), FOG_VOLUME_FAR);
+	glCheckError();
+	inverseProjectionLocation = glGetUniformLocation(shader->Program, "inverseProjectionMatrix");
+	uvScaleLocation = glGetUniformLocation(shader->Program, "uvScale");
+	uvMaxLocation = glGetUniformLocation(shader->Program, "uvMax");
+	applyFogLocation = glGetUniformLocation(shader->Program, "applyFog");
+	glCheckError();
+}
+
+void FogPass::create_targets(){
+	// color of the scene
+	glGenTextures(1, &colorTexture);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, colorTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glCheckError();
+	// linear filter for the scaling up (at full resolution each pixel reads the center of its texel)
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCheckError();
+
+	// depth of the scene, read by the fog shader
+	glGenTextures(1, &depthTexture);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, depthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glCheckError();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCheckError();
+
+	glGenFramebuffers(1, &fbo);
+	glCheckError();
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glCheckError();
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTexture, 0);
+	glCheckError();
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthTexture, 0);
+	glCheckError();
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::FOG_PASS::Framebuffer is not complete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glCheckError();
+}
+
+void FogPass::SetOutput(GLuint framebuffer){
+	output = framebuffer;
+}
+
+void FogPass::SetRenderScale(float scale){
+	renderScale = glm::clamp(scale, 0.1f, 1.0f);
+}
+
+void FogPass::SetAlwaysRendering(bool always){
+	alwaysRendering = always;
+}
+
+void FogPass::Begin(bool active){
+	// the content of the volume is too old to be reprojected
+	if (active && !fogging)
+		volume.ResetHistory();
+	fogging = active;
+	// without fog, at full resolution, the scene is rendered directly on the output, so there is no additional cost
+	rendering = fogging || alwaysRendering || renderScale < 1.0f;
+	glBindFramebuffer(GL_FRAMEBUFFER, rendering ? fbo : output);
+	glCheckError();
+	glViewport(0, 0, (GLsizei)(width * renderScale), (GLsizei)(height * renderScale));
+	glCheckError();
+}
+
+void FogPass::End(glm::mat4 &projection, glm::mat4 &view, glm::vec3 lightVector, float density, float time){
+	if (!rendering)
+		return;
+	if (fogging) {
+		ScopedPass pass("volume");
+		volume.Update(projection, view, lightVector, density, time);
+	}
+	ScopedPass pass("composite");
+	glBindFramebuffer(GL_FRAMEBUFFER, output);
+	glCheckError();
+	glViewport(0, 0, width, height);
+	glCheckError();
+
+	shader->Use();
+	glm::mat4 inverseProjection = glm::inverse(projection);
+	glUniformMatrix4fv(inverseProjectionLocation, 1, GL_FALSE, glm::value_ptr(inverseProjection));
+	// the scene covers only a corner of the framebuffer: the texels outside it are never read
+	GLfloat scaledWidth = (GLsizei)(width * renderScale), scaledHeight = (GLsizei)(height * renderScale);
+	glUniform2f(uvScaleLocation, scaledWidth / width, scaledHeight / height);
+	glUniform2f(uvMaxLocation, (scaledWidth - 0.5f) / width, (scaledHeight - 0.5f) / height);
+	glUniform1i(applyFogLocation, fogging);
+	glCheckError();
+
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, colorTexture);
+	glState.BindTextureUnit(1, GL_TEXTURE_2D, depthTexture);
+	glState.BindTextureUnit(2, GL_TEXTURE_3D, volume.integrated);
+	// every pixel is overwritten: no depth test and no depth write
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glState.BindVertexArray(vao);
+	glState.DrawArrays(GL_TRIANGLES, 0, 3);
+	glCheckError();
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	glCheckError();
+}
+
+void FogPass::Delete(){
+	glDeleteFramebuffers(1, &fbo);
+	glState.ForgetTexture(colorTexture);
+	glState.ForgetTexture(depthTexture);
+	glDeleteTextures(1, &colorTexture);
+	glDeleteTextures(1, &depthTexture);
+	glState.ForgetVertexArray(vao);
+	glDeleteVertexArrays(1, &vao);
+	glCheckError();
+	volume.Delete();
+	shader->Delete();
+	delete shader;
+}
+
+#endif // FOG_PASS_H
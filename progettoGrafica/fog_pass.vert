@@ -0,0 +1,16 @@
+/*
+fog_pass.vert: full screen triangle for the fog post processing pass.
+No vertex buffer is needed: the 3 vertices are generated from gl_VertexID.
+*/
+
+#version 330 core
+
+// UV coordinates of the pixel in the scene textures
+out vec2 interp_UV;
+
+void main(){
+  // vertices (0,0), (2,0), (0,2): the triangle covers the whole screen
+  vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+  interp_UV = p;
+  gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
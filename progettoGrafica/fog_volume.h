@@ -0,0 +1,230 @@
+#ifndef FOG_VOLUME_H
+#define FOG_VOLUME_H
+
+#include <utils/gl_error.h>
+#include <utils/gl_state.h>
+
+#include <utils/shader_v1.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+// resolution of the froxel grid (frustum aligned voxels): it does not depend on the screen resolution
+#define FOG_VOLUME_WIDTH 160
+#define FOG_VOLUME_HEIGHT 90
+#define FOG_VOLUME_DEPTH 64
+// range covered by the slices: the slices are distributed exponentially, so they are thinner near the camera
+#define FOG_VOLUME_NEAR 1.0f
+#define FOG_VOLUME_FAR 400.0f
+// weight of the previous frame in the temporal reprojection
+#define FOG_VOLUME_HISTORY_WEIGHT 0.9f
+
+// Volumetric fog on a froxel grid. Each frame:
+// 1) inject: density and in-scattered light are computed at a (jittered) point of each froxel and blended
+//    with the value of the previous frame, reprojected with the previous view-projection matrix
+// 2) integrate: each froxel stores the in-scattered light and the transmittance from the camera to its far side.
+//    The slices are integrated front to back: each one reads the result of the previous one from a 2D copy, since
+//    a slice of the volume cannot be read while another slice of it is the render target
+// The result is a 3D texture: fogging a pixel costs a single lookup.
+class FogVolume {
+private:
+	Shader *injectShader, *integrateShader;
+	GLuint fbo, integrateFbo;
+	GLuint vao;
+	// scattering (rgb) and extinction (a): the current one and the one of the previous frame
+	GLuint scattering[2];
+	int current;
+	// copies of the last integrated slice, written and read in turn (ping-pong)
+	GLuint accumulated[2];
+	bool historyValid;
+	unsigned int frameIndex;
+	glm::mat4 previousViewProjection;
+	GLint injectSliceLocation, injectJitterLocation, injectInverseViewLocation, injectPreviousLocation, injectHistoryWeightLocation;
+	GLint injectProjectionScaleLocation, injectLightLocation, injectDensityLocation, injectTimeLocation;
+	GLint integrateSliceLocation;
+	GLuint create_texture();
+	GLuint create_slice_texture();
+	void set_volume_uniforms(Shader *shader);
+public:
+	// in-scattered light (rgb) and transmittance (a) from the camera to each froxel
+	GLuint integrated;
+
+	FogVolume();
+	// the next Update() does not use the previous frame (e.g., after the fog has been disabled for some frames)
+	void ResetHistory();
+	// density is a multiplier of the fog density (e.g., the fog thickens while it rains)
+	void Update(glm::mat4 &projection, glm::mat4 &view, glm::vec3 lightVector, float density, float time);
+	void Delete();
+};
+
+FogVolume::FogVolume(){
+	scattering[0] = create_texture();
+	scattering[1] = create_texture();
+	integrated = create_texture();
+	accumulated[0] = create_slice_texture();
+	accumulated[1] = create_slice_texture();
+	current = 0;
+	frameIndex = 0;
+	historyValid = false;
+
+	glGenFramebuffers(1, &fbo);
+	glGenFramebuffers(1, &integrateFbo);
+	glCheckError();
+	// the integration writes each slice to the volume and to a copy for the next slice
+	glBindFramebuffer(GL_FRAMEBUFFER, integrateFbo);
+	GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glCheckError();
+	glGenVertexArrays(1, &vao);
+	glCheckError();
+
+	// both passes draw a full screen triangle for each slice
+	injectShader = new Shader("../progettoGrafica/fog_pass.vert", "../progettoGrafica/fog_inject.frag");
+	set_volume_uniforms(injectShader);
+	glUniform1i(glGetUniformLocation(injectShader->Program, "history"), 0);
+	glCheckError();
+	injectSliceLocation = glGetUniformLocation(injectShader->Program, "slice");
+	injectJitterLocation = glGetUniformLocation(injectShader->Program, "jitter");
+	injectInverseViewLocation = glGetUniformLocation(injectShader->Program, "inverseViewMatrix");
+	injectPreviousLocation = glGetUniformLocation(injectShader->Program, "previousViewProjectionMatrix");
+	injectHistoryWeightLocation = glGetUniformLocation(injectShader->Program, "historyWeight");
+	injectProjectionScaleLocation = glGetUniformLocation(injectShader->Program, "projectionScale");
+	injectLightLocation = glGetUniformLocation(injectShader->Program, "lightVector");
+	injectDensityLocation = glGetUniformLocation(injectShader->Program, "density");
+	injectTimeLocation = glGetUniformLocation(injectShader->Program, "time");
+	glCheckError();
+
+	integrateShader = new Shader("../progettoGrafica/fog_pass.vert", "../progettoGrafica/fog_integrate.frag");
+	set_volume_uniforms(integrateShader);
+	glUniform1i(glGetUniformLocation(integrateShader->Program, "scattering"), 0);
+	glUniform1i(glGetUniformLocation(integrateShader->Program, "previous"), 1);
+	glCheckError();
+	integrateSliceLocation = glGetUniformLocation(integrateShader->Program, "slice");
+	glCheckError();
+}
+
+GLuint FogVolume::create_texture(){
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_3D, texture);
+	glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA16F, FOG_VOLUME_WIDTH, FOG_VOLUME_HEIGHT, FOG_VOLUME_DEPTH, 0, GL_RGBA, GL_FLOAT, NULL);
+	glCheckError();
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	glCheckError();
+	return texture;
+}
+
+// one slice of the integration: it is only fetched, and kept in full precision since the slices add up in it
+GLuint FogVolume::create_slice_texture(){
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, FOG_VOLUME_WIDTH, FOG_VOLUME_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+	glCheckError();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCheckError();
+	return texture;
+}
+
+// size and slice distribution of the grid, shared by the two passes and by the fog pass
+void FogVolume::set_volume_uniforms(Shader *shader){
+	shader->Use();
+	glUniform3f(glGetUniformLocation(shader->Program, "volumeSize"), FOG_VOLUME_WIDTH, FOG_VOLUME_HEIGHT, FOG_VOLUME_DEPTH);
+	glUniform1f(glGetUniformLocation(shader->Program, "volumeNear"), FOG_VOLUME_NEAR);
+	glUniform1f(glGetUniformLocation(shader->Program, "volumeFar"), FOG_VOLUME_FAR);
+	glCheckError();
+}
+
+void FogVolume::ResetHistory(){
+	historyValid = false;
+}
+
+void FogVolume::Update(glm::mat4 &projection, glm::mat4 &view, glm::vec3 lightVector, float density, float time){
+	// the froxels are sampled at a different depth in each frame, so the reprojection accumulates more samples
+	static const float jitterSequence[8] = { 0.5f, 0.25f, 0.75f, 0.125f, 0.625f, 0.375f, 0.875f, 0.0625f };
+	int history = current;
+	current = 1 - current;
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, FOG_VOLUME_WIDTH, FOG_VOLUME_HEIGHT);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glCheckError();
+	glState.BindVertexArray(vao);
+
+	// 1) injection
+	glm::mat4 inverseView = glm::inverse(view);
+	injectShader->Use();
+	glUniformMatrix4fv(injectInverseViewLocation, 1, GL_FALSE, glm::value_ptr(inverseView));
+	glUniformMatrix4fv(injectPreviousLocation, 1, GL_FALSE, glm::value_ptr(previousViewProjection));
+	glUniform1f(injectHistoryWeightLocation, historyValid ? FOG_VOLUME_HISTORY_WEIGHT : 0.0f);
+	glUniform2f(injectProjectionScaleLocation, projection[0][0], projection[1][1]);
+	glUniform3fv(injectLightLocation, 1, glm::value_ptr(lightVector));
+	glUniform1f(injectDensityLocation, density);
+	glUniform1f(injectTimeLocation, time);
+	glUniform1f(injectJitterLocation, jitterSequence[frameIndex % 8]);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_3D, scattering[history]);
+	for (int slice = 0; slice < FOG_VOLUME_DEPTH; slice++) {
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, scattering[current], 0, slice);
+		glUniform1i(injectSliceLocation, slice);
+		glState.DrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glCheckError();
+
+	// 2) integration from the camera, one slice after the other
+	glBindFramebuffer(GL_FRAMEBUFFER, integrateFbo);
+	integrateShader->Use();
+	glState.BindTextureUnit(0, GL_TEXTURE_3D, scattering[current]);
+	for (int slice = 0; slice < FOG_VOLUME_DEPTH; slice++) {
+		// slice reads the copy written by slice - 1 and writes the other one
+		glState.BindTextureUnit(1, GL_TEXTURE_2D, accumulated[(slice + 1) % 2]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, integrated, 0, slice);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, accumulated[slice % 2], 0);
+		glUniform1i(integrateSliceLocation, slice);
+		glState.DrawArrays(GL_TRIANGLES, 0, 3);
+	}
+	glCheckError();
+
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	glCheckError();
+
+	previousViewProjection = projection * view;
+	historyValid = true;
+	frameIndex++;
+}
+
+void FogVolume::Delete(){
+	glState.ForgetTexture(scattering[0]);
+	glState.ForgetTexture(scattering[1]);
+	glState.ForgetTexture(integrated);
+	glState.ForgetTexture(accumulated[0]);
+	glState.ForgetTexture(accumulated[1]);
+	glDeleteTextures(2, scattering);
+	glDeleteTextures(1, &integrated);
+	glDeleteTextures(2, accumulated);
+	glDeleteFramebuffers(1, &fbo);
+	glDeleteFramebuffers(1, &integrateFbo);
+	glState.ForgetVertexArray(vao);
+	glDeleteVertexArrays(1, &vao);
+	glCheckError();
+	injectShader->Delete();
+	integrateShader->Delete();
+	delete injectShader;
+	delete integrateShader;
+}
+
+#endif // FOG_VOLUME_H
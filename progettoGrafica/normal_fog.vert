@@ -47,9 +47,6 @@ out vec3 vViewPosition;
 out vec2 interp_UV;
 
 out vec4 mvPosition;
-out float distVertex;
-out vec3 worldPos;
-out vec3 worldNormal;
 
 void main(){
 
@@ -71,10 +68,4 @@ void main(){
 
   // I assign the values to a variable with "out" qualifier so to use the per-fragment interpolated values in the Fragment shader
   interp_UV = UV;
-
-	// range based FOV
-	distVertex = abs(mvPosition.z);
-
-  worldPos = (modelMatrix * vec4(position, 1.0)).xyz;
-	worldNormal = normalize(mat3(modelMatrix) * normal);
 }
@@ -0,0 +1,195 @@
+#ifndef OPTIONS_H
+#define OPTIONS_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+
+// Command line options. Without options the application runs as before: a window, interactive camera and weather.
+// With --headless the scene is rendered in a hidden window, in an offscreen framebuffer, for a fixed number
+// of frames with a fixed time step, so two runs render the same frames (e.g., on a machine without a GPU, with Mesa llvmpipe).
+struct Options {
+	bool headless;
+	// resolution of the window (or of the offscreen framebuffer)
+	int width, height;
+	// number of frames to render (0 = until the window is closed)
+	int frames;
+	// time step of the simulation in seconds (0 = real time)
+	float fixedStep;
+	// folder for the frame dumps (empty = no dumps), and a dump every dumpEvery frames
+	std::string dumpPath;
+	int dumpEvery;
+	// subsystems
+	bool terrain, sky, rain, snow, fog;
+	// camera path to record, or to play (from a file or a standard path)
+	std::string recordFile, playFile, pathName;
+	// during the playback, each frame advances exactly one step of the path
+	bool timeLocked;
+	// benchmark scenario to run ("all" for the whole suite, empty = no benchmark), the JSON report,
+	// and the frames rendered at the beginning of each scenario without measuring them
+	std::string benchmark, reportFile;
+	int warmup;
+	// Chrome trace JSON of the run (empty = no trace)
+	std::string traceFile;
+	// flight recorder: frames longer than spikeBudget ms (0 = never) dump the trace around them in spikeFolder
+	float spikeBudget;
+	std::string spikeFolder;
+	// quality governor: particles, physics rate, level of detail and render scale follow the frame time target (ms)
+	bool governor;
+	float frameTarget;
+	// particles drawn with the weighted blended transparency (false: sorted, with alpha blending)
+	bool orderIndependent;
+	// particles drawn with one instanced call for each system (false: a draw call for each particle)
+	bool instancing;
+	// compress the textures of the scene (and the images in cookFiles) in .dds files next to them, then exit
+	bool cookTextures;
+	std::vector<std::string> cookFiles;
+	// memory of the textures in MB: the textures not used anymore are deleted above it (see texture_cache.h)
+	int textureBudget;
+	// print the frames rendered in each second (the measurements are made by --benchmark)
+	bool showFps;
+
+	Options() : headless(false), width(800), height(600), frames(0), fixedStep(0.0f), dumpEvery(1),
+		terrain(true), sky(true), rain(false), snow(false), fog(false), timeLocked(false),
+		reportFile("benchmark.json"), warmup(120), spikeBudget(100.0f), spikeFolder("."),
+		governor(true), frameTarget(1000.0f / 60.0f), orderIndependent(true), instancing(true), cookTextures(false),
+		textureBudget(512), showFps(false) {}
+};
+
+void PrintUsage(const char* program){
+	std::cout << "usage: " << program << " [options]" << std::endl
+		<< "  --help              print this message" << std::endl
+		<< "  --headless          render offscreen in a hidden window (implies --fixed-step 1/60 and --frames 600)" << std::endl
+		<< "  --size W H          resolution (default 800 600)" << std::endl
+		<< "  --frames N          number of frames to render, then exit" << std::endl
+		<< "  --fixed-step S      simulation time step in seconds, instead of the real time" << std::endl
+		<< "  --dump DIR          save the rendered frames in DIR as PPM images" << std::endl
+		<< "  --dump-every N      save a frame every N frames (default 1)" << std::endl
+		<< "  --rain | --snow     start with rain or snow" << std::endl
+		<< "  --fog               start with fog" << std::endl
+		<< "  --no-terrain        do not render the map" << std::endl
+		<< "  --no-sky            do not render the skymap" << std::endl
+		<< "  --record FILE       record the camera path and the weather changes in FILE" << std::endl
+		<< "  --play FILE         move the camera along a recorded path, then exit" << std::endl
+		<< "  --path NAME         move the camera along a standard path (orbit, flyover, valley), then exit" << std::endl
+		<< "  --time-locked       during the playback, render exactly one frame per step of the path" << std::endl
+		<< "  --benchmark NAME    run a benchmark scenario (clear, rain2.5k, rain25k, rain250k, snow, fog, rain_fog," << std::endl
+		<< "                      weather_toggle) or all of them (all). --frames is the number of measured frames" << std::endl
+		<< "                      for each scenario (default 600), the camera follows the orbit path if no path is given" << std::endl
+		<< "  --report FILE       JSON report of the benchmark (default benchmark.json)" << std::endl
+		<< "  --warmup N          frames rendered before measuring each scenario (default 120)" << std::endl
+		<< "  --trace FILE        write a timeline of the run in FILE (Chrome trace JSON, see chrome://tracing or ui.perfetto.dev)" << std::endl
+		<< "  --spike-budget MS   frames longer than MS milliseconds write the trace of the seconds around them" << std::endl
+		<< "                      (default 100, 0 = never)" << std::endl
+		<< "  --spike-dir DIR     folder of the traces written for slow frames (default .)" << std::endl
+		<< "  --frame-target MS   frame time kept by lowering or raising the quality (default 16.7)." << std::endl
+		<< "                      With a fixed step the quality is not changed, unless a target is given" << std::endl
+		<< "  --no-governor       keep the full quality" << std::endl
+		<< "  --sorted-particles  sort the particles and draw them with alpha blending, instead of the" << std::endl
+		<< "                      order independent transparency" << std::endl
+		<< "  --no-instancing     draw each particle with its own draw call" << std::endl
+		<< "  --cook-textures     compress the textures of the scene (with their mip levels) in .dds files, read" << std::endl
+		<< "                      at the next runs instead of the images, and exit" << std::endl
+		<< "  --cook IMAGE        compress IMAGE too (e.g., a texture of a model). Implies --cook-textures" << std::endl
+		<< "  --texture-budget MB memory kept for the textures: the unused ones are deleted above it (default 512)" << std::endl
+		<< "  --show-fps          print the frames per second on the console" << std::endl;
+}
+
+// returns false (after printing the usage) if the arguments are not valid
+bool ParseOptions(int argc, char** argv, Options &options){
+	bool framesSet = false, stepSet = false, targetSet = false;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		// number of values following the option
+		int values = (arg == "--size") ? 2 : (arg == "--frames" || arg == "--fixed-step" || arg == "--dump" || arg == "--dump-every"
+			|| arg == "--record" || arg == "--play" || arg == "--path" || arg == "--benchmark" || arg == "--report" || arg == "--warmup"
+			|| arg == "--trace" || arg == "--spike-budget" || arg == "--spike-dir"
+			|| arg == "--frame-target" || arg == "--cook" || arg == "--texture-budget") ? 1 : 0;
+		if (i + values >= argc) {
+			std::cout << "Missing value for " << arg << std::endl;
+			PrintUsage(argv[0]);
+			return false;
+		}
+		if (arg == "--help") {
+			PrintUsage(argv[0]);
+			return false;
+		}
+		else if (arg == "--headless") options.headless = true;
+		else if (arg == "--size") { options.width = atoi(argv[i + 1]); options.height = atoi(argv[i + 2]); }
+		else if (arg == "--frames") { options.frames = atoi(argv[i + 1]); framesSet = true; }
+		else if (arg == "--fixed-step") { options.fixedStep = (float)atof(argv[i + 1]); stepSet = true; }
+		else if (arg == "--dump") options.dumpPath = argv[i + 1];
+		else if (arg == "--dump-every") options.dumpEvery = atoi(argv[i + 1]);
+		else if (arg == "--rain") { options.rain = true; options.snow = false; }
+		else if (arg == "--snow") { options.snow = true; options.rain = false; }
+		else if (arg == "--fog") options.fog = true;
+		else if (arg == "--no-terrain") options.terrain = false;
+		else if (arg == "--no-sky") options.sky = false;
+		else if (arg == "--record") options.recordFile = argv[i + 1];
+		else if (arg == "--play") options.playFile = argv[i + 1];
+		else if (arg == "--path") options.pathName = argv[i + 1];
+		else if (arg == "--time-locked") options.timeLocked = true;
+		else if (arg == "--benchmark") options.benchmark = argv[i + 1];
+		else if (arg == "--report") options.reportFile = argv[i + 1];
+		else if (arg == "--warmup") options.warmup = atoi(argv[i + 1]);
+		else if (arg == "--trace") options.traceFile = argv[i + 1];
+		else if (arg == "--spike-budget") options.spikeBudget = (float)atof(argv[i + 1]);
+		else if (arg == "--spike-dir") options.spikeFolder = argv[i + 1];
+		else if (arg == "--frame-target") { options.frameTarget = (float)atof(argv[i + 1]); targetSet = true; }
+		else if (arg == "--no-governor") options.governor = false;
+		else if (arg == "--sorted-particles") options.orderIndependent = false;
+		else if (arg == "--no-instancing") options.instancing = false;
+		else if (arg == "--cook-textures") options.cookTextures = true;
+		else if (arg == "--cook") { options.cookFiles.push_back(argv[i + 1]); options.cookTextures = true; }
+		else if (arg == "--texture-budget") options.textureBudget = atoi(argv[i + 1]);
+		else if (arg == "--show-fps") options.showFps = true;
+		else {
+			std::cout << "Unknown option " << arg << std::endl;
+			PrintUsage(argv[0]);
+			return false;
+		}
+		i += values;
+	}
+	if (options.width <= 0 || options.height <= 0 || options.frames < 0 || options.fixedStep < 0.0f || options.dumpEvery <= 0 || options.warmup < 0
+		|| options.spikeBudget < 0.0f || options.frameTarget <= 0.0f || options.textureBudget < 0) {
+		std::cout << "Invalid option value" << std::endl;
+		PrintUsage(argv[0]);
+		return false;
+	}
+	int paths = !options.recordFile.empty() + !options.playFile.empty() + !options.pathName.empty();
+	if (paths > 1) {
+		std::cout << "Only one of --record, --play and --path can be used" << std::endl;
+		PrintUsage(argv[0]);
+		return false;
+	}
+	if (options.timeLocked && options.playFile.empty() && options.pathName.empty()) {
+		std::cout << "--time-locked needs --play or --path" << std::endl;
+		PrintUsage(argv[0]);
+		return false;
+	}
+	// a benchmark must be reproducible: fixed step, and the same views for each scenario
+	if (!options.benchmark.empty()) {
+		if (!options.recordFile.empty()) {
+			std::cout << "--record cannot be used with --benchmark" << std::endl;
+			PrintUsage(argv[0]);
+			return false;
+		}
+		if (!framesSet) options.frames = 600;
+		if (!stepSet) options.fixedStep = 1.0f / 60.0f;
+		if (options.playFile.empty() && options.pathName.empty()) options.pathName = "orbit";
+	}
+	// a headless run must end, and must be reproducible
+	if (options.headless) {
+		// the playback of a path ends with the path
+		if (!framesSet && options.playFile.empty() && options.pathName.empty()) options.frames = 600;
+		if (!stepSet) options.fixedStep = 1.0f / 60.0f;
+	}
+	// with a fixed step the quality must not depend on the machine, unless a target is requested
+	if (options.fixedStep > 0.0f && !targetSet)
+		options.governor = false;
+	return true;
+}
+
+#endif // OPTIONS_H
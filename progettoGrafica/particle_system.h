@@ -8,11 +8,16 @@
 #include <glad/glad.h>
 #include <utils/particle.h>
 #include <utils/plane.h>
+#include <utils/profiler.h>
+#include <utils/stream_buffer.h>
 
 #include <glm/gtx/string_cast.hpp>
 
 #define LIFETIME 5.0f
 
+// time source of the particle systems, in seconds: the headless mode replaces it with the simulation time
+double (*particleClock)() = glfwGetTime;
+
 class ParticleSystem {
 private:
 	double lastTime, delta;
@@ -21,14 +26,33 @@ private:
 	std::vector<Particle> particlesContainer;
 	Camera* camera;
 	int maxParticles, lastUsedParticle;
+	// new particles per second
+	float emissionRate;
+	// fraction of the pool and of the emission rate used (1 = all): lowered to reduce the cost of the
+	// simulation without reallocating the pool
+	float quality;
+	// time available to spawn the particles of a frame, in ms (0 = no limit): the first spawn of a
+	// particle creates its rigid body, so filling a big pool at once would stall the frame
+	float spawnBudget;
 	float modelRotation, minRandomRotation, widthRandomRotationDegree;
 	glm::vec3 randomRotationAxes;
 	bool isEnabledRandomRotation;
 	glm::vec3 rotationAxes, scaleVec;
 	GLint modelID, normalID;
 	Physics *physic;
+	// the particles are drawn in the weighted blended transparency pass (no sorting, the pass sets the blending)
+	bool orderIndependent;
+	GLint transparencyID;
+	// the transforms of the particles are written here each frame, and all the particles are drawn with one
+	// instanced call (NULL: a draw call for each particle, with the transforms as uniforms)
+	StreamBuffer *instanceStream;
+	GLint instancedID;
+	// release of the rigid bodies in progress, and next particle to release
+	bool releasing;
+	int releaseCursor;
 	
 	void Render();
+	InstanceTransform Transform(const Particle &p, const glm::mat4 &view);
 	int FindUnusedParticle();
 	void SortParticles();
 	void SetupParticles();
@@ -39,6 +63,8 @@ public:
 	glm::vec4 particleColor;
 	FixedYPlane *spawnPlane;
 	glm::vec3 direction;
+	// particles simulated in the last Update()
+	int aliveParticles;
 	
 	ParticleSystem();
 	ParticleSystem(int maxP, Camera* camera, Shader *shader, Model *model, FixedYPlane *plane, Physics *physic);
@@ -47,37 +73,78 @@ public:
 	void SetDirection(glm::vec3 direction);
 	void SetParticleRotation(float minDegree, float maxDegree, glm::vec3 axes);
 	void EnableParticleRotation(bool enabled);
+	void SetEmissionRate(float particlesPerSecond);
+	void SetSpawnBudget(float milliseconds);
+	// scale in (0, 1] of the number of particles alive at the same time and of the emission rate
+	void SetQuality(float scale);
+	// true: the particles are drawn between TransparencyPass::Begin and End, in any order
+	void SetOrderIndependent(bool enabled);
+	// buffer for the per-instance transforms (shared by all the systems, see StreamBuffer)
+	void SetInstanceStream(StreamBuffer *stream);
+	// changes the number of particles: the rigid bodies must have been released (see ReleaseBodies)
+	void SetMaxParticles(int maxP);
 	void Update();
-	void RemoveRigidBody() {
-		for (int i = 0; i < maxParticles; i++) {
-			particlesContainer[i].rb = NULL;
-			particlesContainer[i].alive = false;
-		}
-	}
+	// removal of the rigid bodies of the particles from the simulation, a few at a time: after BeginRelease,
+	// each call of ReleaseBodies removes at most count bodies, and returns true when all of them are removed.
+	// CancelRelease stops it (e.g., the system is enabled again before the end): the remaining bodies are reused
+	void BeginRelease();
+	bool ReleaseBodies(int count);
+	void CancelRelease();
 };
 
-void ParticleSystem::Render(){
+InstanceTransform ParticleSystem::Transform(const Particle &p, const glm::mat4 &view){
+	InstanceTransform transform;
 	glm::mat4 modelMatrix;
-	glm::mat3 normalMatrix;
+	modelMatrix = glm::translate(modelMatrix, p.pos);
+	modelMatrix = glm::rotate(modelMatrix, glm::radians(modelRotation), rotationAxes);
+	if(isEnabledRandomRotation){
+		modelMatrix = glm::rotate(modelMatrix, glm::radians(p.rotationDegree), randomRotationAxes);
+	}
+	modelMatrix = glm::scale(modelMatrix, scaleVec);
+	transform.modelMatrix = modelMatrix;
+	transform.normalMatrix = glm::inverseTranspose(glm::mat3(view*modelMatrix));
+	return transform;
+}
+
+void ParticleSystem::Render(){
+	glm::mat4 view = camera->GetViewMatrix();
+	if (instanceStream != NULL) {
+		if (aliveParticles == 0)
+			return;
+		// the transforms are written in the order of the particles (sorted, when needed): the instances are
+		// drawn in this order, so the blending gives the same result as a draw call for each particle
+		GLintptr offset;
+		InstanceTransform *instances = (InstanceTransform*)instanceStream->Map(aliveParticles * sizeof(InstanceTransform), offset);
+		if (instances == NULL)
+			return;
+		int count = 0;
+		for(int i = 0; i < maxParticles && count < aliveParticles; i++) {
+			Particle &p = particlesContainer[i];
+			if(p.toDraw){
+				p.toDraw = false;
+				instances[count++] = Transform(p, view);
+			}
+		}
+		instanceStream->Unmap();
+		glUniform1i(instancedID, 1);
+		glCheckError();
+		model->DrawInstanced(*shader, instanceStream->buffer, offset, count);
+		glUniform1i(instancedID, 0);
+		glCheckError();
+		return;
+	}
 	for(int i = 0; i < maxParticles; i++) {
 		Particle &p = particlesContainer[i];
 		if(p.toDraw){
 			p.toDraw = false;
-			modelMatrix = glm::translate(modelMatrix, p.pos);
-			modelMatrix = glm::rotate(modelMatrix, glm::radians(modelRotation), rotationAxes);
-			if(isEnabledRandomRotation){
-				modelMatrix = glm::rotate(modelMatrix, glm::radians(p.rotationDegree), randomRotationAxes);
-			}
-			modelMatrix = glm::scale(modelMatrix, scaleVec);
-			normalMatrix = glm::inverseTranspose(glm::mat3(camera->GetViewMatrix()*modelMatrix));
+			InstanceTransform transform = Transform(p, view);
 			
-			glUniformMatrix4fv(glGetUniformLocation(shader->Program, "modelMatrix"), 1, GL_FALSE, glm::value_ptr(modelMatrix));
+			glUniformMatrix4fv(modelID, 1, GL_FALSE, glm::value_ptr(transform.modelMatrix));
 			glCheckError();
-			glUniformMatrix3fv(glGetUniformLocation(shader->Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(normalMatrix));
+			glUniformMatrix3fv(normalID, 1, GL_FALSE, glm::value_ptr(transform.normalMatrix));
 			glCheckError();
 			
 			model->Draw(*shader);
-			modelMatrix = glm::mat4(1.0f);
 		}
 	}
 }
@@ -116,18 +183,27 @@ void ParticleSystem::SortParticles(){
 }
 	
 void ParticleSystem::SetupParticles(){
-	double currentTime = glfwGetTime();
+	double currentTime = particleClock();
 	delta = currentTime - lastTime;
 	
-	// Generate 10 new particule each millisecond,
+	// Generate emissionRate new particles each second (10 each millisecond by default),
 	// but limit this to 16 ms (60 fps), or if you have 1 long frame (1sec),
 	// newparticles will be huge and the next frame even longer.
-	int newparticles = (int)(delta*10000.0);
-	if (newparticles > (int)(0.016f*10000.0))
-		newparticles = (int)(0.016f*10000.0);
+	float rate = emissionRate * quality;
+	int newparticles = (int)(delta*rate);
+	if (newparticles > (int)(0.016f*rate))
+		newparticles = (int)(0.016f*rate);
+	// the particles alive in the last update count for the limit of the quality
+	int particleLimit = (int)(maxParticles * quality);
+	if (newparticles > particleLimit - aliveParticles)
+		newparticles = particleLimit - aliveParticles;
 	
 	//spawn particles
+	double spawnStart = glfwGetTime();
 	for(int i=0; i<newparticles; i++){
+		// out of time: the remaining particles of this frame are not spawned
+		if (spawnBudget > 0.0f && i % 64 == 63 && (glfwGetTime() - spawnStart) * 1000.0 > spawnBudget)
+			break;
 		int particleIndex = FindUnusedParticle();
 		if (particleIndex == -1) return;
 		Particle &p = particlesContainer[particleIndex];
@@ -162,17 +238,33 @@ void ParticleSystem::UpdateParticles(){
 			p.pos = glm::vec3(rbPos[0], rbPos[1], rbPos[2]);
 			p.cameraDistance = glm::length( p.pos - camera->Position );
 			p.toDraw = true;
+			particlesCount++;
 		}
 	}
+	aliveParticles = particlesCount;
 	lastTime = currentTime;
-	SortParticles();
+	// alpha blending needs the particles from back to front; the weighted blended transparency does not
+	if (!orderIndependent)
+		SortParticles();
 }
 
 void ParticleSystem::DrawParticles(){
+	// other passes (e.g., the sky) can be drawn between the map and the particles
+	shader->Use();
 	//set particle color
 	GLint colorID = glGetUniformLocation(shader->Program, "particleColor");
 	glUniform4fv(colorID, 1, glm::value_ptr(this->particleColor));
 	glCheckError();
+
+	// the transparency pass sets its own blending: the shader writes the weighted outputs
+	if (orderIndependent) {
+		glUniform1i(transparencyID, 1);
+		glCheckError();
+		Render();
+		glUniform1i(transparencyID, 0);
+		glCheckError();
+		return;
+	}
 	
 	//enable color blending
 	GLfloat old_blend_value;
@@ -205,10 +297,20 @@ ParticleSystem::ParticleSystem(int maxP, Camera* camera, Shader *shader, Model *
 	
 	direction = glm::vec3(0,0,0);		//no initial movement
 	lastUsedParticle = 0;
-	lastTime = glfwGetTime();
+	lastTime = particleClock();
 	modelID = glGetUniformLocation(shader->Program, "modelMatrix");
 	normalID = glGetUniformLocation(shader->Program, "normalMatrix");
+	transparencyID = glGetUniformLocation(shader->Program, "transparencyPass");
+	instancedID = glGetUniformLocation(shader->Program, "instanced");
+	instanceStream = NULL;
+	orderIndependent = false;
 	isEnabledRandomRotation = false;
+	emissionRate = 10000.0f;
+	spawnBudget = 0.0f;
+	quality = 1.0f;
+	aliveParticles = 0;
+	releasing = false;
+	releaseCursor = 0;
 	
 	for(int i=0; i < maxParticles; i++){
 		Particle p;
@@ -242,9 +344,74 @@ void ParticleSystem::EnableParticleRotation(bool enabled){
 	this->isEnabledRandomRotation = enabled;
 }
 
+void ParticleSystem::SetEmissionRate(float particlesPerSecond){
+	this->emissionRate = particlesPerSecond;
+}
+
+void ParticleSystem::SetSpawnBudget(float milliseconds){
+	this->spawnBudget = milliseconds;
+}
+
+void ParticleSystem::SetOrderIndependent(bool enabled){
+	this->orderIndependent = enabled;
+}
+
+void ParticleSystem::SetInstanceStream(StreamBuffer *stream){
+	this->instanceStream = stream;
+}
+
+void ParticleSystem::SetQuality(float scale){
+	this->quality = glm::clamp(scale, 0.0f, 1.0f);
+}
+
+void ParticleSystem::SetMaxParticles(int maxP){
+	this->maxParticles = maxP;
+	this->lastUsedParticle = 0;
+	this->aliveParticles = 0;
+	Particle p;
+	p.rb = NULL;
+	particlesContainer.assign(maxP, p);
+}
+
+void ParticleSystem::BeginRelease(){
+	releasing = true;
+	releaseCursor = 0;
+}
+
+bool ParticleSystem::ReleaseBodies(int count){
+	if (!releasing)
+		return true;
+	int released = 0;
+	for (; releaseCursor < maxParticles && released < count; releaseCursor++) {
+		Particle &p = particlesContainer[releaseCursor];
+		p.alive = false;
+		if (p.rb != NULL) {
+			physic->RemoveRigidBody((bulletObject*)p.rb->getUserPointer());
+			p.rb = NULL;
+			released++;
+		}
+	}
+	if (releaseCursor < maxParticles)
+		return false;
+	releasing = false;
+	aliveParticles = 0;
+	return true;
+}
+
+void ParticleSystem::CancelRelease(){
+	releasing = false;
+}
+
 void ParticleSystem::Update(){
-	SetupParticles();
-	UpdateParticles();
+	{
+		ScopedPass pass("spawn");
+		SetupParticles();
+	}
+	{
+		ScopedPass pass("simulate");
+		UpdateParticles();
+	}
+	ScopedPass pass("draw");
 	DrawParticles();
 }
 
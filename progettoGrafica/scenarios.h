@@ -0,0 +1,50 @@
+#ifndef SCENARIOS_H
+#define SCENARIOS_H
+
+#include <string>
+#include <vector>
+
+// number of rain particles of the application
+#define DEFAULT_RAIN_PARTICLES 2500
+
+// A benchmark scenario: the weather during the run, and the number of rain particles.
+// All the scenarios follow the same camera path, so they render the same views.
+struct Scenario {
+	std::string name;
+	bool rain, snow, fog;
+	int rainParticles;
+	// the weather is changed every second (rain, snow, fog, clear...), to measure the cost of the transitions
+	bool toggleWeather;
+};
+
+Scenario MakeScenario(const char* name, bool rain, bool snow, bool fog, int rainParticles = DEFAULT_RAIN_PARTICLES, bool toggleWeather = false){
+	Scenario scenario;
+	scenario.name = name;
+	scenario.rain = rain;
+	scenario.snow = snow;
+	scenario.fog = fog;
+	scenario.rainParticles = rainParticles;
+	scenario.toggleWeather = toggleWeather;
+	return scenario;
+}
+
+// scenarios with the given name ("all" for the whole suite). Returns false if the name is not known
+bool FindScenarios(const std::string &name, std::vector<Scenario> &scenarios){
+	std::vector<Scenario> all;
+	all.push_back(MakeScenario("clear", false, false, false));
+	all.push_back(MakeScenario("rain2.5k", true, false, false, 2500));
+	all.push_back(MakeScenario("rain25k", true, false, false, 25000));
+	all.push_back(MakeScenario("rain250k", true, false, false, 250000));
+	all.push_back(MakeScenario("snow", false, true, false));
+	all.push_back(MakeScenario("fog", false, false, true));
+	all.push_back(MakeScenario("rain_fog", true, false, true));
+	all.push_back(MakeScenario("weather_toggle", false, false, false, DEFAULT_RAIN_PARTICLES, true));
+
+	scenarios.clear();
+	for (size_t i = 0; i < all.size(); i++)
+		if (name == "all" || name == all[i].name)
+			scenarios.push_back(all[i]);
+	return !scenarios.empty();
+}
+
+#endif // SCENARIOS_H
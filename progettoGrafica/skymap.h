@@ -4,6 +4,7 @@
 #include <string>
 
 #include <utils/gl_error.h>
+#include <utils/gl_state.h>
 
 #include <utils/camera.h>
 #include <utils/shader_v1.h>
@@ -60,8 +61,12 @@ class SkyMap {
 private:
 	Shader *shader;
 	glm::mat4 projectionMatrix;
+	GLint viewLocation;
 	void create_cube_map(const char* front, const char* back, const char* top, const char* bottom, const char* left, const char* right);
 	bool load_cube_map_side(GLuint texture, GLenum side_target, const char* file_name);
+	void setup(Camera *camera, glm::mat4 &projection);
+	// filtering and wrapping of the bound cube map
+	void set_parameters();
 public:
 	GLuint vbo;
 	GLuint vao;
@@ -70,11 +75,32 @@ public:
 	
 	SkyMap(Camera *camera, glm::mat4 &projection,
 	const char* front, const char* back, const char* top, const char* bottom, const char* left, const char* right);
+	// the faces are 1 texel of the given color, until the images are loaded in tex_cube (see AssetLoader)
+	SkyMap(Camera *camera, glm::mat4 &projection, glm::vec3 color);
 	void Update();
 };
 
 SkyMap::SkyMap(Camera *camera, glm::mat4 &projection,
 	const char* front, const char* back, const char* top, const char* bottom, const char* left, const char* right){
+	setup(camera, projection);
+	//create cubemap
+	create_cube_map(front, back, top, bottom, left, right);
+}
+
+SkyMap::SkyMap(Camera *camera, glm::mat4 &projection, glm::vec3 color){
+	setup(camera, projection);
+	GLubyte texel[4] = { (GLubyte)(color.r * 255.0f), (GLubyte)(color.g * 255.0f), (GLubyte)(color.b * 255.0f), 255 };
+	glState.ActiveTexture(GL_TEXTURE0);
+	glGenTextures(1, &tex_cube);
+	glCheckError();
+	glState.BindTexture(GL_TEXTURE_CUBE_MAP, tex_cube);
+	for (int side = 0; side < 6; side++)
+		glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + side, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+	glCheckError();
+	set_parameters();
+}
+
+void SkyMap::setup(Camera *camera, glm::mat4 &projection){
 	this->camera = camera;
 	this->projectionMatrix = projection;
 	//setup vbo
@@ -87,8 +113,7 @@ SkyMap::SkyMap(Camera *camera, glm::mat4 &projection,
 	//setup vao
 	glGenVertexArrays(1, &vao);
 	glCheckError();
-	glBindVertexArray(vao);
-	glCheckError();
+	glState.BindVertexArray(vao);
 	glEnableVertexAttribArray(0);
 	glCheckError();
 	glBindBuffer(GL_ARRAY_BUFFER, vbo);
@@ -99,21 +124,19 @@ SkyMap::SkyMap(Camera *camera, glm::mat4 &projection,
 	shader = new Shader("../progettoGrafica/skymap.vert","../progettoGrafica/skymap.frag");
 	shader->Use();
 	
-	//create cubemap
-	create_cube_map(front, back, top, bottom, left, right);
-	
 	//setup vertex shader
 	GLuint p_pos = glGetUniformLocation(shader->Program, "P");
 	glCheckError();
 	glUniformMatrix4fv(p_pos, 1 , GL_FALSE, glm::value_ptr(projectionMatrix));
 	glCheckError();
+	viewLocation = glGetUniformLocation(shader->Program, "V");
+	glCheckError();
 	
 }
 
 void SkyMap::create_cube_map(const char* front, const char* back, const char* top, const char* bottom, const char* left, const char* right){
 	// generate a cube-map texture to hold all the sides
-	glActiveTexture(GL_TEXTURE0);
-	glCheckError();
+	glState.ActiveTexture(GL_TEXTURE0);
 	glGenTextures(1, &tex_cube);
 	glCheckError();
 
@@ -124,6 +147,10 @@ void SkyMap::create_cube_map(const char* front, const char* back, const char* to
 	load_cube_map_side(tex_cube, GL_TEXTURE_CUBE_MAP_NEGATIVE_Y, bottom);
 	load_cube_map_side(tex_cube, GL_TEXTURE_CUBE_MAP_NEGATIVE_X, left);
 	load_cube_map_side(tex_cube, GL_TEXTURE_CUBE_MAP_POSITIVE_X, right);
+	set_parameters();
+}
+
+void SkyMap::set_parameters(){
 	// format cube map texture
 	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glCheckError();
@@ -138,8 +165,10 @@ void SkyMap::create_cube_map(const char* front, const char* back, const char* to
 }
 
 bool SkyMap::load_cube_map_side(GLuint texture, GLenum side_target, const char* file_name){
-	glBindTexture(GL_TEXTURE_CUBE_MAP, texture);
-	glCheckError();
+	glState.BindTexture(GL_TEXTURE_CUBE_MAP, texture);
+	// the cooked face (compressed) is uploaded as it is
+	if (LoadCookedTexture(file_name, side_target, GL_TEXTURE_CUBE_MAP))
+		return true;
 
 	int x, y, n;
 	int force_channels = 4;
@@ -166,20 +195,14 @@ bool SkyMap::load_cube_map_side(GLuint texture, GLenum side_target, const char*
 void SkyMap::Update(){
 	shader->Use();
 	glm::mat4 view = camera->GetViewMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(shader->Program, "V"), 1 , GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(viewLocation, 1 , GL_FALSE, glm::value_ptr(view));
 	glCheckError();
 	
 	glDepthMask(GL_FALSE);
 	glCheckError();
-	glUseProgram(shader->Program);
-	glCheckError();
-	glActiveTexture(GL_TEXTURE0);
-	glCheckError();
-	glBindTexture(GL_TEXTURE_CUBE_MAP, tex_cube);
-	glCheckError();
-	glBindVertexArray(vao);
-	glCheckError();
-	glDrawArrays(GL_TRIANGLES, 0, 36);
+	glState.BindTextureUnit(0, GL_TEXTURE_CUBE_MAP, tex_cube);
+	glState.BindVertexArray(vao);
+	glState.DrawArrays(GL_TRIANGLES, 0, 36);
 	glCheckError();
 	glDepthMask(GL_TRUE);
 }
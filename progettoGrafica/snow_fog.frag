@@ -13,7 +13,9 @@ Universita' degli Studi di Milano
 #version 330 core
 
 // output shader variable
-out vec4 colorFrag;
+layout(location = 0) out vec4 colorFrag;
+// second target of the transparency pass (see transparency_pass.h): sum of the weights
+layout(location = 1) out vec4 weightFrag;
 
 // light incidence direction (calculated in vertex shader, interpolated by rasterization)
 in vec3 lightDir;
@@ -22,8 +24,8 @@ in vec3 vNormal;
 // vector from fragment to camera (in view coordinate)
 in vec3 vViewPosition;
 
-// model matrix
-uniform mat4 modelMatrix;
+// model matrix (of the instance, when the particles are drawn instanced)
+flat in mat4 vModelMatrix;
 // view matrix
 uniform mat4 viewMatrix;
 
@@ -32,7 +34,6 @@ in vec2 interp_UV;
 
 //variables for wet effect
 in vec4 mvPosition;
-in vec3 worldPos;
 in vec3 worldNormal;
 in vec4 localVertexPosition;
 
@@ -42,25 +43,19 @@ uniform float repeat;
 // texture sampler
 uniform sampler2D tex;
 
-//fog variables
-uniform int fogActive;
-uniform vec3 eyePosition;
-
 //particles and textures variables
 uniform vec4 particleColor; //color of the particle to render
 uniform int hasTexture;     //if true, output color is particleColor
-
-
-// fog variables
-const vec3 DiffuseLight = vec3(0.15, 0.05, 0.0);
-const vec3 RimColor  = vec3(0.2, 0.2, 0.2);
-const vec3 fogColor = vec3(0.5,0.5,0.5);
-in float distVertex;
+uniform bool transparencyPass; //if true, particles are accumulated for the weighted blended transparency
 
 //snow effect constants
 uniform vec3 snowDirection;
 uniform float snowLevel;    //range between [-1, 1]
 float snowMixValue = 0.2;
+//the snow line is perturbed with the baked noise (see noise_texture.h), so it is not a flat cut on the slopes
+uniform sampler3D noiseVolume;
+uniform float noiseVolumePeriod;
+float snowLineNoise = 0.3;
 
 //all credits goes to: https://github.com/hughsk/glsl-hemisphere-light
 vec3 hemisphere_light(vec3 normal, vec3 sky, vec3 ground,
@@ -77,14 +72,15 @@ vec3 hemisphere_light(vec3 normal, vec3 sky, vec3 ground,
   return mix(ground, sky, weight);
 }
 
-
 void main()
 {
     //hasTexture == 0 => it's a particle
     vec4 surfaceColor;
     float alpha;
     //check if i need to draw snow on the map
-    bool enoughSnow = dot(normalize(worldNormal), snowDirection) >= snowLevel;
+    // the noise volume has 2 octaves: values in [0, 0.75), centered on 0.375
+    float snowNoise = texture(noiseVolume, localVertexPosition.xyz / noiseVolumePeriod).a - 0.375;
+    bool enoughSnow = dot(normalize(worldNormal), snowDirection) + snowNoise * snowLineNoise >= snowLevel;
     //hasTexture == 0 => rendering particle
     if (hasTexture == 0) {
         surfaceColor = particleColor;
@@ -108,42 +104,14 @@ void main()
     vec3 illuminatedColor;
     if(hasTexture == 0 ){
         //for the particle (and low level snow), we use hemisphere lighting
-        illuminatedColor = hemisphere_light(vNormal, surfaceColor.xyz, surfaceColor.xyz, lightDir, modelMatrix, viewMatrix, vViewPosition);
+        illuminatedColor = hemisphere_light(vNormal, surfaceColor.xyz, surfaceColor.xyz, lightDir, vModelMatrix, viewMatrix, vViewPosition);
     }else{
         //for texture, we use snow effect
         illuminatedColor = surfaceColor.rgb;
     }
     //finally set output color variable
     colorFrag = vec4(illuminatedColor, alpha);
-    //if fog is enabled, we draw fog (not working with snow)
-    if (fogActive == 1) {
-        vec3 texColor = colorFrag.rgb;
-
-        //get light an view directions
-        vec3 Lfog = normalize(lightDir - worldPos);
-        vec3 Vfog = normalize(eyePosition - worldPos);
-
-        //diffuse lighting
-        vec3 diffuse = DiffuseLight * max(0, dot(Lfog, worldNormal));
-        
-        //rim lighting
-        float rim = 1 - max(dot(Vfog, worldNormal), 0.0);
-        rim = smoothstep(0.6, 1.0, rim);
-        vec3 finalRim = RimColor * vec3(rim, rim, rim);
-
-
-        //get all lights and texture
-        vec3 finalColor = finalRim + diffuse + texColor;
-
-        vec3 c = vec3(0,0,0);
-
-        float be = 0.025 * smoothstep(0.0, 6.0, 10.0 - mvPosition.y);
-        float bi = 0.035 * smoothstep(0.0, 80, 10.0 - mvPosition.y);
-        float ext =  exp(-distVertex * be);
-        float insc = exp(-distVertex * bi);
-
-        c = finalColor * ext + fogColor * (1 - insc);
-
-        colorFrag = vec4(c, 1);
-    }
+    // write_transparent is in transparency_write.glsl
+    if (hasTexture == 0 && transparencyPass)
+        write_transparent(illuminatedColor, alpha, length(vViewPosition), colorFrag, weightFrag);
 }
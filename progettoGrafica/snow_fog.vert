@@ -29,6 +29,14 @@ uniform mat4 projectionMatrix;
 // normals transformation matrix (= transpose of the inverse of the model-view matrix)
 uniform mat3 normalMatrix;
 
+// instanced drawing (particles): the two matrices above are read per instance from these attributes
+uniform bool instanced;
+layout (location = 5) in mat4 instanceModelMatrix;
+layout (location = 9) in mat3 instanceNormalMatrix;
+
+// model matrix of the instance, for the lighting in the fragment shader
+flat out mat4 vModelMatrix;
+
 // the light incidence direction of the directional light (passed as uniform)
 uniform vec3 lightVector;
 
@@ -47,30 +55,29 @@ out vec3 vViewPosition;
 out vec2 interp_UV;
 
 out vec4 mvPosition;
-out vec3 worldPos;
 out vec3 worldNormal;
 
 //output variables needed from wet code
 out vec4 localVertexPosition;
 
-//for fog
-out float distVertex;
-
 //inverse, used by wet code
 mat4 inverseP = inverse(projectionMatrix);
 mat4 inverseV = inverse(viewMatrix);
 
 void main(){
 
+  mat4 model = instanced ? instanceModelMatrix : modelMatrix;
+  vModelMatrix = model;
+
   // vertex position in ModelView coordinate (see the last line for the application of projection)
   // when I need to use coordinates in camera coordinates, I need to split the application of model and view transformations from the projection transformations
-  mvPosition = viewMatrix * modelMatrix * vec4( position, 1.0 );
+  mvPosition = viewMatrix * model * vec4( position, 1.0 );
 
   // view direction, negated to have vector from the vertex to the camera
   vViewPosition = -mvPosition.xyz;
 
   // transformations are applied to the normal
-  vNormal = normalize( normalMatrix * normal );
+  vNormal = normalize( (instanced ? instanceNormalMatrix : normalMatrix) * normal );
 
   // we consider a directional light. The direction of light has been passed as an uniform. We apply the view transformation in order to have the direction in camera coordinates
   lightDir = vec3(viewMatrix  * vec4(lightVector, 0.0));
@@ -81,12 +88,8 @@ void main(){
   // I assign the values to a variable with "out" qualifier so to use the per-fragment interpolated values in the Fragment shader
   interp_UV = UV;
 
-  // range based FOV
-	distVertex = abs(mvPosition.z);
-
   //local space vertex position and normal, needed from "wet effect"
   localVertexPosition = vec4(position,1.0) * inverseV * inverseP;
 
-  worldPos = (modelMatrix * vec4(position, 1.0)).xyz;
-	worldNormal = normalize(mat3(modelMatrix) * normal);
+  worldNormal = normalize(mat3(model) * normal);
 }
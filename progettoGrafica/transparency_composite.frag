@@ -0,0 +1,26 @@
+/*
+transparency_composite.frag: the transparent surfaces accumulated by the weighted blended transparency pass
+(see transparency_pass.h) are resolved and blended over the opaque scene.
+*/
+
+#version 330 core
+
+// output shader variable: blended with (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA)
+out vec4 colorFrag;
+
+// sum of the weighted colors (rgb) and product of (1 - alpha) of all the surfaces (a)
+uniform sampler2D accumulation;
+// sum of the weights
+uniform sampler2D weights;
+
+void main()
+{
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    vec4 accumulated = texelFetch(accumulation, pixel, 0);
+    float revealage = accumulated.a;
+    // no transparent surface on this pixel
+    if (revealage >= 1.0)
+        discard;
+    float weight = texelFetch(weights, pixel, 0).r;
+    colorFrag = vec4(accumulated.rgb / max(weight, 1e-5), 1.0 - revealage);
+}
@@ -0,0 +1,133 @@
+#ifndef TRANSPARENCY_PASS_H
+#define TRANSPARENCY_PASS_H
+
+#include <utils/gl_error.h>
+#include <utils/gl_state.h>
+
+#include <utils/shader_v1.h>
+
+// Weighted blended order independent transparency (McGuire, Bavoil - "Weighted Blended Order-Independent Transparency").
+// The particles of all the systems are drawn in any order in a framebuffer with two targets:
+// - accumulation (RGBA16F): rgb = sum of color * weight, a = product of (1 - alpha)
+// - weights (R16F): sum of the weights
+// The weight decreases with the distance, so near surfaces count more. The depth buffer of the opaque scene is
+// attached too (test only, no write), so hidden particles are discarded. A full screen pass then blends the
+// average color over the scene, with the coverage of all the surfaces.
+// GL 3.3 has no blend function per draw buffer: the same separate function (rgb: ONE, ONE; alpha: ZERO,
+// ONE_MINUS_SRC_ALPHA) is used for both targets, and the alpha of the weights target is not used.
+class TransparencyPass {
+private:
+	Shader *shader;
+	GLuint fbo;
+	GLuint accumulationTexture;
+	GLuint weightTexture;
+	GLuint vao;
+	// framebuffer of the opaque scene (with its depth texture), where the transparent surfaces are blended
+	GLuint sceneFramebuffer;
+	int width, height;
+	GLuint create_target(GLenum format, GLenum components);
+public:
+	TransparencyPass(int width, int height, GLuint sceneFramebuffer, GLuint sceneDepth);
+	// to call before the transparent surfaces are drawn (the shaders must write the weighted outputs)
+	void Begin();
+	// to call after the transparent surfaces are drawn: they are blended over the scene
+	void End();
+	void Delete();
+};
+
+TransparencyPass::TransparencyPass(int width, int height, GLuint sceneFramebuffer, GLuint sceneDepth){
+	this->width = width;
+	this->height = height;
+	this->sceneFramebuffer = sceneFramebuffer;
+
+	accumulationTexture = create_target(GL_RGBA16F, GL_RGBA);
+	weightTexture = create_target(GL_R16F, GL_RED);
+	glGenFramebuffers(1, &fbo);
+	glCheckError();
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, accumulationTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, weightTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, sceneDepth, 0);
+	glCheckError();
+	GLenum buffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, buffers);
+	glCheckError();
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		std::cout << "ERROR::TRANSPARENCY_PASS::Framebuffer is not complete" << std::endl;
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glCheckError();
+
+	// the full screen triangle is generated in the vertex shader, but a VAO must be bound to draw
+	glGenVertexArrays(1, &vao);
+	glCheckError();
+
+	shader = new Shader("../progettoGrafica/fog_pass.vert", "../progettoGrafica/transparency_composite.frag");
+	shader->Use();
+	glUniform1i(glGetUniformLocation(shader->Program, "accumulation"), 0);
+	glUniform1i(glGetUniformLocation(shader->Program, "weights"), 1);
+	glCheckError();
+}
+
+GLuint TransparencyPass::create_target(GLenum format, GLenum components){
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, components, GL_FLOAT, NULL);
+	glCheckError();
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glCheckError();
+	return texture;
+}
+
+void TransparencyPass::Begin(){
+	// the viewport of the scene (which can be scaled) is kept
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glCheckError();
+	GLfloat clearAccumulation[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	GLfloat clearWeight[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	glClearBufferfv(GL_COLOR, 0, clearAccumulation);
+	glClearBufferfv(GL_COLOR, 1, clearWeight);
+	glCheckError();
+
+	// depth test against the opaque scene, without writing: the transparent surfaces do not hide each other
+	glDepthMask(GL_FALSE);
+	glEnable(GL_BLEND);
+	glBlendFuncSeparate(GL_ONE, GL_ONE, GL_ZERO, GL_ONE_MINUS_SRC_ALPHA);
+	glCheckError();
+}
+
+void TransparencyPass::End(){
+	glBindFramebuffer(GL_FRAMEBUFFER, sceneFramebuffer);
+	glCheckError();
+	shader->Use();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, accumulationTexture);
+	glState.BindTextureUnit(1, GL_TEXTURE_2D, weightTexture);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	glDisable(GL_DEPTH_TEST);
+	glState.BindVertexArray(vao);
+	glState.DrawArrays(GL_TRIANGLES, 0, 3);
+	glCheckError();
+	glEnable(GL_DEPTH_TEST);
+	glDisable(GL_BLEND);
+	glDepthMask(GL_TRUE);
+	glCheckError();
+}
+
+void TransparencyPass::Delete(){
+	glDeleteFramebuffers(1, &fbo);
+	glState.ForgetTexture(accumulationTexture);
+	glState.ForgetTexture(weightTexture);
+	glDeleteTextures(1, &accumulationTexture);
+	glDeleteTextures(1, &weightTexture);
+	glState.ForgetVertexArray(vao);
+	glDeleteVertexArrays(1, &vao);
+	glCheckError();
+	shader->Delete();
+	delete shader;
+}
+
+#endif // TRANSPARENCY_PASS_H
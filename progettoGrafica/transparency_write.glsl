@@ -0,0 +1,13 @@
+/*
+transparency_write.glsl: output of the transparency pass (see transparency_pass.h), shared by the shaders of the particles.
+It is not a complete shader: the Shader class inserts it after the #version line of the fragment shaders that ask for it.
+
+Weighted blended order independent transparency (McGuire, Bavoil - "Weighted Blended Order-Independent Transparency"):
+the color is accumulated with a weight decreasing with the distance z from the camera, the coverage (alpha) is multiplied
+*/
+
+void write_transparent(vec3 color, float alpha, float z, out vec4 accumulation, out vec4 weightSum) {
+    float weight = alpha * clamp(10.0 / (1e-5 + pow(z / 5.0, 2.0) + pow(z / 200.0, 6.0)), 1e-2, 3e3);
+    accumulation = vec4(color * weight, alpha);
+    weightSum = vec4(weight);
+}
@@ -13,7 +13,9 @@ Universita' degli Studi di Milano
 #version 330 core
 
 // output shader variable
-out vec4 colorFrag;
+layout(location = 0) out vec4 colorFrag;
+// second target of the transparency pass (see transparency_pass.h): sum of the weights
+layout(location = 1) out vec4 weightFrag;
 
 // light incidence direction (calculated in vertex shader, interpolated by rasterization)
 in vec3 lightDir;
@@ -22,8 +24,8 @@ in vec3 vNormal;
 // vector from fragment to camera (in view coordinate)
 in vec3 vViewPosition;
 
-// model matrix
-uniform mat4 modelMatrix;
+// model matrix (of the instance, when the particles are drawn instanced)
+flat in mat4 vModelMatrix;
 // view matrix
 uniform mat4 viewMatrix;
 
@@ -32,8 +34,6 @@ in vec2 interp_UV;
 
 //variables for wet effect
 in vec4 mvPosition;
-in vec3 worldPos;
-in vec3 worldNormal;
 in vec4 localVertexPosition;
 
 // texture repetitions
@@ -42,20 +42,11 @@ uniform float repeat;
 // texture sampler
 uniform sampler2D tex;
 
-// check fog
-uniform int fogActive;
-uniform vec3 eyePosition;
-
 uniform vec4 particleColor; //color of the particle to render
 uniform int hasTexture;     //if true, output color is particleColor
+uniform bool transparencyPass; //if true, particles are accumulated for the weighted blended transparency
 vec4 skyColor = vec4(0.0);
 
-// fog variables
-const vec3 DiffuseLight = vec3(0.15, 0.05, 0.0);
-const vec3 RimColor  = vec3(0.2, 0.2, 0.2);
-const vec3 fogColor = vec3(0.5,0.5,0.5);
-in float distVertex;
-
 //wet effect
 uniform float wetLevel;    //range between [-1, 1]
 
@@ -74,45 +65,18 @@ vec3 hemisphere_light(vec3 normal, vec3 sky, vec3 ground,
   return mix(ground, sky, weight);
 }
 
-float basicNoise(vec2 co){
-    return 0.5 + 0.5 * fract(sin(dot(co.xy ,vec2(12.9898,78.233))) * 43758.5453);
-}
-
-//3D Value Noise generator by Morgan McGuire @morgan3d
-//https://www.shadertoy.com/view/4dS3Wd
-float hash(float n) { return fract(sin(n) * 1e4); }
-float hash(vec2 p) { return fract(1e4 * sin(17.0 * p.x + p.y * 0.1) * (0.1 + abs(sin(p.y * 13.0 + p.x)))); }
-
-float noise(vec3 x) {
-	const vec3 step = vec3(110, 241, 171);
+//baked noise (see noise_texture.h): rgb = gradient, a = value; the plane has white noise in b
+uniform sampler3D noiseVolume;
+uniform float noiseVolumePeriod;
+uniform sampler2D noisePlane;
+uniform float noisePlanePeriod;
 
-	vec3 i = floor(x);
-	vec3 f = fract(x);
-
-	// For performance, compute the base input to a 1D hash from the integer part of the argument and the
-	// incremental change to the 1D based on the 3D -> 1D wrapping
-    float n = dot(i, step);
-
-	vec3 u = f * f * (3.0 - 2.0 * f);
-	return mix(mix(mix( hash(n + dot(step, vec3(0, 0, 0))), hash(n + dot(step, vec3(1, 0, 0))), u.x),
-		   mix( hash(n + dot(step, vec3(0, 1, 0))), hash(n + dot(step, vec3(1, 1, 0))), u.x), u.y),
-	       mix(mix( hash(n + dot(step, vec3(0, 0, 1))), hash(n + dot(step, vec3(1, 0, 1))), u.x),
-		   mix( hash(n + dot(step, vec3(0, 1, 1))), hash(n + dot(step, vec3(1, 1, 1))), u.x), u.y), u.z);
-}
-
-//Fractional Brownian Motion
-#define NUM_OCTAVES 2
-
-float fnoise(vec3 x) {
-	float v = 0.0;
-	float a = 0.5;
-	vec3 shift = vec3(100);
-	for (int i = 0; i < NUM_OCTAVES; ++i) {
-		v += a * noise(x);
-		x = x * 2.0 + shift;
-		a *= 0.5;
-	}
-	return v;
+//white noise, a value per noise unit: the sparkle of the specular highlight, in [0.5, 1) as the hash it replaces
+float basicNoise(vec2 co){
+    ivec2 size = textureSize(noisePlane, 0);
+    ivec2 texel = ivec2(floor(co / noisePlanePeriod * vec2(size))) % size;
+    // the texture repeats: negative remainders wrap to the other side
+    return 0.5 + 0.5 * texelFetch(noisePlane, texel + size * ivec2(lessThan(texel, ivec2(0))), 0).b;
 }
 
 //credits:https://github.com/sayakbiswas/wet-surface-glsl
@@ -129,19 +93,9 @@ vec3 wet_effect(vec3 materialDiffuseColor){
     vec3 n = normalize(vNormal);
     vec3 l = normalize(lightDir);
 
-    //Generating a bump map from noise
-    float inz = fnoise(localVertexPosition.xyz) * 0.5 + 0.5;
-    float E = 0.001;
-
-    vec3 px = localVertexPosition.xyz;
-    px.x += E;
-    vec3 py = localVertexPosition.xyz;
-    py.y += E;
-    vec3 pz = localVertexPosition.xyz;
-    pz.z += E;
-
-    vec3 bump = vec3(fnoise(px)*0.5+0.5, fnoise(py)*0.5+0.5, fnoise(pz)*0.5+0.5);
-    vec3 pN = vec3((bump.x-inz)/E, (bump.y-inz)/E, (bump.z-inz)/E);
+    //Generating a bump map from noise: the gradient of the bump (noise * 0.5 + 0.5) is baked with the noise
+    vec4 bump = texture(noiseVolume, localVertexPosition.xyz / noiseVolumePeriod);
+    vec3 pN = bump.rgb * 0.5;
 
     n = normalize(n - pN);
 
@@ -169,7 +123,6 @@ vec3 wet_effect(vec3 materialDiffuseColor){
     return color;
 }
 
-
 void main()
 {
     vec4 surfaceColor;
@@ -186,52 +139,24 @@ void main()
     float alpha;
     //hasTexture == 0 => rendering a particle. Calculate hemisphere lighting
     if(hasTexture == 0){
-        illuminatedColor = hemisphere_light(vNormal, surfaceColor.xyz, surfaceColor.xyz, lightDir, modelMatrix, viewMatrix, vViewPosition);
+        illuminatedColor = hemisphere_light(vNormal, surfaceColor.xyz, surfaceColor.xyz, lightDir, vModelMatrix, viewMatrix, vViewPosition);
         alpha = particleColor.w;
     }
     //hasTexture == 1 => rendering map. Mix hemisphere light and wet effect
     else{
         if (wetLevel <= 0.0){
             //still saturated to dry
-            illuminatedColor = hemisphere_light(vNormal, skyColor.xyz, surfaceColor.xyz, lightDir, modelMatrix, viewMatrix, vViewPosition);
+            illuminatedColor = hemisphere_light(vNormal, skyColor.xyz, surfaceColor.xyz, lightDir, vModelMatrix, viewMatrix, vViewPosition);
         }else{
             //the final color is the "lerp" between dry and wet, using "wetLevel" as weight
-            vec3 hl = hemisphere_light(vNormal, skyColor.xyz, surfaceColor.xyz, lightDir, modelMatrix, viewMatrix, vViewPosition);
-            //vec3 wet = wet_effect(surfaceColor.xyz);
-            vec3 wet = mix(hl, vec3(0), wetLevel);
+            vec3 hl = hemisphere_light(vNormal, skyColor.xyz, surfaceColor.xyz, lightDir, vModelMatrix, viewMatrix, vViewPosition);
+            vec3 wet = wet_effect(surfaceColor.xyz);
             illuminatedColor = mix(hl, wet, wetLevel);
         }
         alpha = 1.0;
     }
     colorFrag = vec4(illuminatedColor, alpha);
-    if (fogActive == 1) {
-        vec3 texColor = colorFrag.rgb;
-
-        //get light an view directions
-        vec3 Lfog = normalize(lightDir - worldPos);
-        vec3 Vfog = normalize(eyePosition - worldPos);
-
-        //diffuse lighting
-        vec3 diffuse = DiffuseLight * max(0, dot(Lfog, worldNormal));
-        
-        //rim lighting
-        float rim = 1 - max(dot(Vfog, worldNormal), 0.0);
-        rim = smoothstep(0.6, 1.0, rim);
-        vec3 finalRim = RimColor * vec3(rim, rim, rim);
-
-
-        //get all lights and texture
-        vec3 finalColor = finalRim + diffuse + texColor;
-
-        vec3 c = vec3(0,0,0);
-
-        float be = 0.025 * smoothstep(0.0, 6.0, 10.0 - mvPosition.y);
-        float bi = 0.035 * smoothstep(0.0, 80, 10.0 - mvPosition.y);
-        float ext =  exp(-distVertex * be);
-        float insc = exp(-distVertex * bi);
-
-        c = finalColor * ext + fogColor * (1 - insc);
-
-        colorFrag = vec4(c, alpha);
-    }
+    // write_transparent is in transparency_write.glsl
+    if (hasTexture == 0 && transparencyPass)
+        write_transparent(illuminatedColor, alpha, length(vViewPosition), colorFrag, weightFrag);
 }
@@ -62,9 +62,29 @@ Z
 #include <stb_image/stb_image.h>
 
 //particle system classes
-#include <utils/texture.h>
+#include <utils/noise_texture.h>
 #include "particle_system.h"
 #include "skymap.h"
+#include "fog_pass.h"
+#include "transparency_pass.h"
+#include "options.h"
+#include <utils/render_target.h>
+#include <utils/camera_path.h>
+#include <utils/benchmark.h>
+#include <utils/profiler.h>
+#include <utils/tracer.h>
+#include <utils/flight_recorder.h>
+#include <utils/command_queue.h>
+#include <utils/quality_governor.h>
+#include <utils/stream_buffer.h>
+#include <utils/asset_loader.h>
+#include "scenarios.h"
+
+// the same check after our headers: none of them may include windows.h (e.g., mapped_file.h keeps it in mapped_file.cpp),
+// or APIENTRY would be defined again
+#ifdef _WINDOWS_
+#error windows.h was included!
+#endif
 
 // dimensions of application's window
 GLuint screenWidth = 800, screenHeight = 600;
@@ -87,6 +107,20 @@ void SetupShader(Shader &shader);
 
 void ChangeShader();
 
+// weather changes, from the keyboard or from the command line
+void ToggleRain();
+void ToggleSnow();
+void ToggleFog();
+
+// benchmark: weather and particles of a scenario
+void ApplyScenario(const Scenario &scenario);
+
+// queues the removal of the rigid bodies of a particle system
+void ReleaseParticles(ParticleSystem &system);
+
+// compression of the textures of the scene (--cook-textures)
+bool CookTextures();
+
 
 // we initialize an array of booleans for each keybord key
 bool keys[1024];
@@ -105,7 +139,13 @@ GLboolean wireframe = GL_FALSE;
 
 glm::mat4 view;
 
-Texture *texture;
+TextureHandle mapTexture;
+
+// baked noise for the wet bump and the snow line (3D, in object space), and for the wet highlights (2D)
+NoiseTexture *noiseVolume, *noisePlane;
+// texture units of the noise: the last slots of the height maps (see Material in mesh_v2.h), not used by our models
+#define NOISE_VOLUME_UNIT 14
+#define NOISE_PLANE_UNIT 15
 
 // we create a camera. We pass the initial position as a paramenter to the constructor. The last boolean tells that we want a camera "anchored" to the ground
 Camera camera(glm::vec3(0.0f, 0.0f, 7.0f), GL_FALSE);
@@ -122,6 +162,27 @@ glm::mat4 projection;
 glm::vec3 posMap = glm::vec3(0.0f, -30.0f, 0.0f);
 glm::vec3 rotMap = glm::vec3(0.0f, 1.0f, 0.0f);
 glm::vec3 scaleMap = glm::vec3(0.0005f, 0.0005f, 0.0005f);
+// the map is split in MAP_TILES_PER_SIDE x MAP_TILES_PER_SIDE tiles for frustum culling
+#define MAP_TILES_PER_SIDE 16
+// simplified levels of each tile, and largest error on screen (in pixels) allowed when choosing the level of a tile
+#define MAP_LOD_LEVELS 4
+#define MAP_LOD_PIXEL_ERROR 2.0f
+// cells per side used to simplify the map for the physics simulation
+#define MAP_COLLISION_CELLS 256
+// steps per second of the physics simulation
+#define PHYSICS_RATE 60.0f
+
+// quality settings, lowered by the quality governor when the frames take too long
+QualityGovernor governor;
+float renderScale = 1.0f;
+float lodPixelError = MAP_LOD_PIXEL_ERROR;
+float physicsRate = PHYSICS_RATE;
+float particleQuality = 1.0f;
+// levels of each knob of the governor (the first is the full quality)
+const float RENDER_SCALE_LEVELS[] = { 1.0f, 0.85f, 0.7f, 0.6f, 0.5f };
+const float LOD_PIXEL_ERROR_LEVELS[] = { MAP_LOD_PIXEL_ERROR, 3.0f, 4.0f, 6.0f, 8.0f };
+const float PHYSICS_RATE_LEVELS[] = { PHYSICS_RATE, 45.0f, 30.0f };
+const float PARTICLE_QUALITY_LEVELS[] = { 1.0f, 0.75f, 0.5f, 0.35f, 0.25f };
 
 // boolean to handle show particle systems
 #define RAIN_B 0
@@ -131,6 +192,56 @@ std::vector<bool> particleBools;
 // fog checker
 bool isFogActive = false;
 
+// command line options
+Options options;
+// offscreen framebuffer used in headless mode
+RenderTarget *offscreen = NULL;
+// 1x1 framebuffer where the shaders are used once before they are needed (nothing drawn there is visible)
+RenderTarget *warmTarget = NULL;
+// time of the simulation, advanced by a fixed step (if requested) instead of the real time
+double simulationTime = 0.0;
+double SimulationTime() { return simulationTime; }
+
+// camera path being recorded or played
+CameraPath cameraPath;
+bool recordingPath = false, playingPath = false;
+// events of the camera path: weather changes (as the 1/2/3 keys)
+#define EVENT_TOGGLE_RAIN 1
+#define EVENT_TOGGLE_SNOW 2
+#define EVENT_TOGGLE_FOG 3
+// benchmark scenarios and their results
+std::vector<Scenario> scenarios;
+size_t scenarioIndex = 0;
+Benchmark benchmark;
+bool benchmarking = false;
+
+// time of each frame (in ms) available to the queued jobs, and rigid bodies of the particles removed by each job step:
+// the teardown of a weather is spread over several frames
+#define FRAME_JOBS_BUDGET 2.0
+#define PARTICLE_RELEASE_BATCH 256
+// time of each frame (in ms) available to spawn particles (only in real time: fixed step runs must be reproducible)
+#define PARTICLE_SPAWN_BUDGET 4.0f
+// bytes of per-instance data uploaded in a frame (the stream buffer grows if a frame needs more)
+#define INSTANCE_STREAM_BYTES (4 * DEFAULT_RAIN_PARTICLES * sizeof(InstanceTransform))
+
+// textures of the scene (--cook-textures writes their compressed versions, used when they exist)
+#define MAP_TEXTURE "../progettoGrafica/textures/maps/volcano_diff.png"
+const char* skyFaces[6] = {
+	"../progettoGrafica/textures/sky/negz.jpg",
+	"../progettoGrafica/textures/sky/posz.jpg",
+	"../progettoGrafica/textures/sky/posy.jpg",
+	"../progettoGrafica/textures/sky/negy.jpg",
+	"../progettoGrafica/textures/sky/negx.jpg",
+	"../progettoGrafica/textures/sky/posx.jpg"
+};
+
+// bytes of the assets uploaded to the GPU in a frame, while they are loading
+#define ASSET_UPLOAD_BUDGET (8 * 1024 * 1024)
+
+// volcano area covered by the standard camera paths
+#define PATH_CENTER glm::vec3(0.0f, -30.0f, 0.0f)
+#define PATH_RADIUS 110.0f
+
 // instance of the physics class
 Physics bulletSimulation;
 
@@ -143,8 +254,50 @@ ParticleSystem snow, rain;
 float snowAmount, rainAmount;
 
 /////////////////// MAIN function ///////////////////////
-int main()
+int main(int argc, char** argv)
 {
+	if (!ParseOptions(argc, argv, options))
+		return -1;
+	// offline step: no window is needed
+	if (options.cookTextures)
+		return CookTextures() ? 0 : -1;
+	screenWidth = options.width;
+	screenHeight = options.height;
+	// the trace starts here, so it includes the loading. Without a trace, the flight recorder keeps only the last seconds
+	if (!options.traceFile.empty())
+		tracer.Enable();
+	flightRecorder.Start(options.spikeBudget, options.spikeFolder);
+	tracer.SetThreadName("main");
+
+	// camera path
+	if (!options.playFile.empty()) {
+		if (!cameraPath.Load(options.playFile))
+			return -1;
+		playingPath = true;
+	}
+	else if (!options.pathName.empty()) {
+		if (!CameraPath::Standard(options.pathName, PATH_CENTER, PATH_RADIUS, cameraPath)) {
+			std::cout << "Unknown camera path " << options.pathName << std::endl;
+			return -1;
+		}
+		playingPath = true;
+	}
+	else if (!options.recordFile.empty())
+		recordingPath = true;
+	if (!options.benchmark.empty()) {
+		if (!FindScenarios(options.benchmark, scenarios)) {
+			std::cout << "Unknown benchmark scenario " << options.benchmark << std::endl;
+			return -1;
+		}
+		benchmarking = true;
+	}
+	// time locked playback: one frame for each key of the path
+	if (options.timeLocked) {
+		options.fixedStep = cameraPath.step;
+		if (options.frames == 0)
+			options.frames = (int)cameraPath.keys.size();
+	}
+
 	// Initialization of OpenGL context using GLFW
 	glfwInit();
 	// We set OpenGL specifications required for this application
@@ -159,6 +312,9 @@ int main()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	// we set if the window is resizable
 	glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+	// in headless mode the window is only used to get a context: it is never shown
+	if (options.headless)
+		glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
 
 	// we create the application's window
 	GLFWwindow* window = glfwCreateWindow(screenWidth, screenHeight, "Piergigli-Quadrelli progetto", nullptr, nullptr);
@@ -170,12 +326,14 @@ int main()
 	}
 	glfwMakeContextCurrent(window);
 
-	// we put in relation the window and the callbacks
-	glfwSetKeyCallback(window, key_callback);
-	glfwSetCursorPosCallback(window, mouse_callback);
+	if (!options.headless) {
+		// we put in relation the window and the callbacks
+		glfwSetKeyCallback(window, key_callback);
+		glfwSetCursorPosCallback(window, mouse_callback);
 
-	// we disable the mouse cursor
-	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		// we disable the mouse cursor
+		glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+	}
 
 	// GLAD tries to load the context set by GLFW
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -186,8 +344,10 @@ int main()
 
 
 	// we define the viewport dimensions
-	int width, height;
-	glfwGetFramebufferSize(window, &width, &height);
+	// in headless mode, the size of the offscreen framebuffer
+	int width = options.width, height = options.height;
+	if (!options.headless)
+		glfwGetFramebufferSize(window, &width, &height);
 	glViewport(0, 0, width, height);
 
 	// we enable Z test
@@ -199,9 +359,9 @@ int main()
 	//setup shader
 	normalShader = Shader("../progettoGrafica/normal_fog.vert", "../progettoGrafica/normal_fog.frag");
 	glCheckError();
-	rainShader = Shader("../progettoGrafica/wet_fog.vert", "../progettoGrafica/wet_fog.frag");
+	rainShader = Shader("../progettoGrafica/wet_fog.vert", "../progettoGrafica/wet_fog.frag", "../progettoGrafica/transparency_write.glsl");
 	glCheckError();
-	snowShader = Shader("../progettoGrafica/snow_fog.vert", "../progettoGrafica/snow_fog.frag");
+	snowShader = Shader("../progettoGrafica/snow_fog.vert", "../progettoGrafica/snow_fog.frag", "../progettoGrafica/transparency_write.glsl");
 	glCheckError();
 	currentShader = &normalShader;
 
@@ -211,12 +371,70 @@ int main()
 	glUniform4fv(glGetUniformLocation(normalShader.Program,"particleColor"), 1, glm::value_ptr(glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)));
 	glCheckError();
 
-	texture = new Texture("../progettoGrafica/textures/maps/volcano_diff.png");
+	// the assets are read and decoded on worker threads, and uploaded a few at a time by the rendering loop:
+	// the first frames show placeholders (grey map texture, sky of the clear color, no models)
+	AssetLoader loader;
+	loader.Start();
+	textureCache.SetBudget((size_t)options.textureBudget * 1024 * 1024);
+	mapTexture = loader.LoadTexture(MAP_TEXTURE);
+	glCheckError();
+
+	// noise textures: baked at the first run, then read from the cache files
+	NoiseSettings volumeSettings = { 64, 3, 16, 2, 1 };
+	noiseVolume = new NoiseTexture(volumeSettings, "../progettoGrafica/textures/noise_volume.cache");
+	NoiseSettings planeSettings = { 256, 2, 256, 1, 2 };
+	noisePlane = new NoiseTexture(planeSettings, "../progettoGrafica/textures/noise_plane.cache");
+	glCheckError();
+	rainShader.Use();
+	glUniform1i(glGetUniformLocation(rainShader.Program, "noiseVolume"), NOISE_VOLUME_UNIT);
+	glUniform1f(glGetUniformLocation(rainShader.Program, "noiseVolumePeriod"), (float)volumeSettings.period);
+	glUniform1i(glGetUniformLocation(rainShader.Program, "noisePlane"), NOISE_PLANE_UNIT);
+	glUniform1f(glGetUniformLocation(rainShader.Program, "noisePlanePeriod"), (float)planeSettings.period);
+	glCheckError();
+	snowShader.Use();
+	glUniform1i(glGetUniformLocation(snowShader.Program, "noiseVolume"), NOISE_VOLUME_UNIT);
+	glUniform1f(glGetUniformLocation(snowShader.Program, "noiseVolumePeriod"), (float)volumeSettings.period);
 	glCheckError();
 
-	Model envModel("../progettoGrafica/models/volcano.obj");
-	Model rainDropModel("../progettoGrafica/models/raindrop.obj");
-	Model snowFlakeModel("../progettoGrafica/models/snowflake.obj");
+	// the map is split in tiles, culled against the view frustum and rendered with a level of detail depending on the distance
+	Model envModel(MAP_TILES_PER_SIDE, MAP_LOD_LEVELS);
+	Model rainDropModel;
+	Model snowFlakeModel;
+	// rigid body of the map: a simplified version of the rendered surface (the triangles follow the terrain, so no offset
+	// is needed), clustered from the shared geometry on the loading thread and freed when the simulation is cleared
+	CollisionMesh* mapCollision = NULL;
+	loader.LoadModel(envModel, "../progettoGrafica/models/volcano.obj", [&](const shared_ptr<MeshAsset>& asset) {
+		mapCollision = new CollisionMesh(asset, MAP_COLLISION_CELLS);
+	}, [&]() {
+		bulletSimulation.createRigidBody(mapCollision,
+			posMap, glm::vec3(0.0f, 0.0f, 0.0f), 0.0, 0.0, scaleMap);
+		// the weather shaders are used once with the map, so the driver compiles them before the first
+		// weather change. They draw in warmTarget, and their draw calls are not counted in the frame
+		Shader* weatherShaders[2] = { &rainShader, &snowShader };
+		for (int s = 0; s < 2; s++) {
+			Shader* shader = weatherShaders[s];
+			commandQueue.PushJob([shader, &envModel]() {
+				ScopedTrace trace("warm shader");
+				if (warmTarget == NULL)
+					warmTarget = new RenderTarget(1, 1);
+				GLint framebuffer, viewport[4];
+				glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+				glGetIntegerv(GL_VIEWPORT, viewport);
+				unsigned int drawCalls = glState.drawCalls;
+				warmTarget->Bind();
+				glViewport(0, 0, 1, 1);
+				SetupShader(*shader);
+				RenderObjects(*shader, envModel);
+				glState.drawCalls = drawCalls;
+				glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+				glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+				glCheckError();
+				return true;
+			});
+		}
+	});
+	loader.LoadModel(rainDropModel, "../progettoGrafica/models/raindrop.obj");
+	loader.LoadModel(snowFlakeModel, "../progettoGrafica/models/snowflake.obj");
 
 
 	// Projection matrix: FOV angle, aspect ratio, near and far planes
@@ -230,7 +448,7 @@ int main()
 	FixedYPlane snowPlane(min, max, 150);	//min, maxe and y values
 
 											//Create and setup the rain particle system
-	rain = ParticleSystem(2500, &camera, &rainShader, &rainDropModel, &rainPlane, &bulletSimulation);
+	rain = ParticleSystem(DEFAULT_RAIN_PARTICLES, &camera, &rainShader, &rainDropModel, &rainPlane, &bulletSimulation);
 	rain.SetRotationAndScale(-90.0f, glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(0.0009f, 0.0009f, 0.002f));
 	rain.SetColor(glm::vec4(1.0f, 1.0f, 1.0f, 0.01f)); //avg color of the sky
 	rain.SetDirection(glm::vec3(0.0f, -1.0f, 0.0f));
@@ -244,57 +462,175 @@ int main()
 	snow.EnableParticleRotation(true);
 	snow.SetParticleRotation(0.0f, 180.0f, glm::vec3(0.0f, 1.0f, 0.0f));
 
+	if (options.fixedStep <= 0.0f) {
+		rain.SetSpawnBudget(PARTICLE_SPAWN_BUDGET);
+		snow.SetSpawnBudget(PARTICLE_SPAWN_BUDGET);
+	}
+
 	//setup booleans for particle systems
 	particleBools.push_back(false);	//RAIN_B
 	particleBools.push_back(false);	//SNOW_B
 
 	//setup skymap 
-	SkyMap skymap(&camera, projection,
-		&"../progettoGrafica/textures/sky/negz.jpg"[0],  //front 
-		&"../progettoGrafica/textures/sky/posz.jpg"[0],  //back 
-		&"../progettoGrafica/textures/sky/posy.jpg"[0],  //top 
-		&"../progettoGrafica/textures/sky/negy.jpg"[0],  //bottom 
-		&"../progettoGrafica/textures/sky/negx.jpg"[0],  //left 
-		&"../progettoGrafica/textures/sky/posx.jpg"[0]  //right 
-	);
+	SkyMap skymap(&camera, projection, glm::vec3(131 / 255.0f, 158 / 255.0f, 169 / 255.0f));
+	// faces in the order of the cube map targets: right, left, top, bottom, back, front
+	std::vector<std::string> cubeFaces;
+	cubeFaces.push_back(skyFaces[5]);
+	cubeFaces.push_back(skyFaces[4]);
+	cubeFaces.push_back(skyFaces[2]);
+	cubeFaces.push_back(skyFaces[3]);
+	cubeFaces.push_back(skyFaces[1]);
+	cubeFaces.push_back(skyFaces[0]);
+	loader.LoadCubeMap(skymap.tex_cube, cubeFaces);
 
 	glCheckError();
 
-	// added rigidbody map
-	bulletObject* mapBullet = bulletSimulation.createRigidBody(MAP, "../progettoGrafica/models/volcano.obj",
-		glm::vec3(posMap.x, posMap.y-22, posMap.z), 0.0f, glm::vec3(0.0f, 0.0f, 0.0f), 0, 0.0, 0.0, scaleMap);
+	// fog is applied in a post processing pass, on the depth buffer of the rendered scene
+	FogPass fogPass(width, height);
+	if (options.headless) {
+		offscreen = new RenderTarget(width, height);
+		fogPass.SetOutput(offscreen->fbo);
+	}
+
+	// the transforms of the particles are streamed to the GPU each frame, and each system is drawn with one call
+	StreamBuffer *instanceStream = NULL;
+	if (options.instancing) {
+		instanceStream = new StreamBuffer(INSTANCE_STREAM_BYTES);
+		rain.SetInstanceStream(instanceStream);
+		snow.SetInstanceStream(instanceStream);
+	}
+
+	// the particles of both systems are drawn in any order, with the depth buffer of the scene in the fog pass
+	TransparencyPass *transparency = NULL;
+	if (options.orderIndependent) {
+		fogPass.SetAlwaysRendering(true);
+		transparency = new TransparencyPass(width, height, fogPass.Framebuffer(), fogPass.DepthTexture());
+		rain.SetOrderIndependent(true);
+		snow.SetOrderIndependent(true);
+	}
+
+	// knobs of the quality governor, in the order they are lowered: first the changes less visible
+	if (options.governor) {
+		governor.SetTarget(options.frameTarget);
+		governor.AddKnob("physics rate", QUALITY_CPU, 3, [](int level) { physicsRate = PHYSICS_RATE_LEVELS[level]; });
+		governor.AddKnob("particles", QUALITY_CPU, 5, [](int level) {
+			particleQuality = PARTICLE_QUALITY_LEVELS[level];
+			rain.SetQuality(particleQuality);
+			snow.SetQuality(particleQuality);
+		});
+		governor.AddKnob("map LOD", QUALITY_GPU, 5, [](int level) { lodPixelError = LOD_PIXEL_ERROR_LEVELS[level]; });
+		governor.AddKnob("render scale", QUALITY_GPU, 5, [&fogPass](int level) {
+			renderScale = RENDER_SCALE_LEVELS[level];
+			fogPass.SetRenderScale(renderScale);
+		});
+	}
+
+	// runs with a fixed step must be reproducible: the first frame has all the assets
+	if (options.fixedStep > 0.0f)
+		loader.Finish();
 	// added callback to check collision
 	gContactAddedCallback = ContactAddedCallbackBullet;
 
+	// initial weather from the command line, or from the first benchmark scenario
+	if (benchmarking) {
+		ApplyScenario(scenarios[0]);
+		benchmark.BeginScenario(scenarios[0].name);
+	}
+	else {
+		if (options.rain) ToggleRain();
+		if (options.snow) ToggleSnow();
+		if (options.fog) ToggleFog();
+	}
+	// with a fixed step, the particles follow the simulation time
+	if (options.fixedStep > 0.0f)
+		particleClock = SimulationTime;
+
 	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
 	int nbFrames = 0;
+	int frame = 0;
+	// frames of the run (of each scenario, for a benchmark): 0 = no limit
+	int frameLimit = benchmarking ? options.warmup + options.frames : options.frames;
 	double lastTime = glfwGetTime();
+	// time of the last camera path events applied: events at time 0 are applied in the first frame
+	GLfloat lastPathTime = -1.0f;
+	std::vector<GLuint> pathEvents;
+	// the simulation time starts with the rendering loop, after the loading
+	double startTime = glfwGetTime();
 	// Rendering loop: this code is executed at each frame
-	while (!glfwWindowShouldClose(window))
+	while (!glfwWindowShouldClose(window) && (frameLimit == 0 || frame < frameLimit))
 	{
+		// statistics of the frame, for the benchmark
+		FrameStats frameStats;
+		double frameStart = glfwGetTime();
+		glState.ResetCounters();
+		tracer.Frame(frame);
+		profiler.BeginFrame();
+		profiler.Begin("setup");
+
 		// we determine the time passed from the beginning
 		// and we calculate time difference between current frame rendering and the previous one
-		GLfloat currentFrame = glfwGetTime();
+		if (options.fixedStep > 0.0f)
+			simulationTime = frame * (double)options.fixedStep;
+		else
+			simulationTime = glfwGetTime() - startTime;
+		GLfloat currentFrame = simulationTime;
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
-		// Measure speed
-		double currentTime = currentFrame;
-		nbFrames++;
-		if (currentTime - lastTime >= 1.0) { // If last prinf() was more than 1 sec ago
-			// printf and reset timer
-			std::cout << "fps:" << double(nbFrames) << endl;
-			nbFrames = 0;
-			lastTime += 1.0;
+		// Measure speed (only a console hint: the measurements are made by the benchmark runner)
+		if (options.showFps) {
+			double currentTime = glfwGetTime();
+			nbFrames++;
+			if (currentTime - lastTime >= 1.0) { // If last prinf() was more than 1 sec ago
+				// printf and reset timer
+				std::cout << "fps:" << double(nbFrames) << endl;
+				nbFrames = 0;
+				lastTime += 1.0;
+			}
 		}
 
 		// Check is an I/O event is happening
+		tracer.Begin("events");
 		glfwPollEvents();
-		// we apply FPS camera movements
-		apply_camera_movements();
+		tracer.End();
+		// the camera follows the path, if there is one; otherwise we apply FPS camera movements
+		if (playingPath) {
+			// the application ends with the path
+			if (currentFrame > cameraPath.Duration() && frameLimit == 0)
+				break;
+			cameraPath.Evaluate(currentFrame, camera);
+			cameraPath.EventsBetween(lastPathTime, currentFrame, pathEvents);
+			for (size_t e = 0; e < pathEvents.size(); e++) {
+				if (pathEvents[e] == EVENT_TOGGLE_RAIN) commandQueue.Push(ToggleRain);
+				else if (pathEvents[e] == EVENT_TOGGLE_SNOW) commandQueue.Push(ToggleSnow);
+				else if (pathEvents[e] == EVENT_TOGGLE_FOG) commandQueue.Push(ToggleFog);
+			}
+			lastPathTime = currentFrame;
+		}
+		else
+			apply_camera_movements();
+		// the transition scenario changes the weather every second: rain, snow, snow and fog, clear
+		if (benchmarking && scenarios[scenarioIndex].toggleWeather && frame > 0 && (int)currentFrame != (int)(currentFrame - deltaTime)) {
+			switch ((int)currentFrame % 4) {
+				case 1: commandQueue.Push(ToggleRain); break;
+				case 2: commandQueue.Push(ToggleSnow); break;
+				case 3: commandQueue.Push(ToggleFog); break;
+				case 0: commandQueue.Push(ToggleSnow); commandQueue.Push(ToggleFog); break;
+			}
+		}
+		// the state changes requested in this frame are applied here, and the queued jobs get their part of the frame
+		commandQueue.Execute(FRAME_JOBS_BUDGET);
+		// the assets decoded by the loading threads
+		if (loader.Pending() > 0)
+			loader.Update(ASSET_UPLOAD_BUDGET);
+		if (recordingPath)
+			cameraPath.Record(currentFrame, camera);
 		// View matrix (=camera): position, view direction, camera "up" vector
 		view = camera.GetViewMatrix();
 
+		// if the fog is active the scene is rendered in the framebuffer of the fog pass
+		fogPass.Begin(isFogActive);
+
 		// we "clear" the frame and z buffer
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 		glCheckError();
@@ -320,29 +656,154 @@ int main()
 			glCheckError();
 		}
 
+		profiler.End();
+
 		//render map
-		RenderObjects(*currentShader, envModel);
+		if (options.terrain) {
+			ScopedPass pass("terrain");
+			RenderObjects(*currentShader, envModel);
+		}
 
-		if (particleBools[RAIN_B]) rain.Update();
-		if (particleBools[SNOW_B]) snow.Update();
+		//render sky: before the particles, which are blended over it
+		if (options.sky) {
+			ScopedPass pass("sky");
+			skymap.Update();
+		}
 
-		//render sky
-		skymap.Update();
+		bool particles = particleBools[RAIN_B] || particleBools[SNOW_B];
+		if (transparency != NULL && particles)
+			transparency->Begin();
+		if (particleBools[RAIN_B]) {
+			ScopedPass pass("rain");
+			rain.Update();
+		}
+		if (particleBools[SNOW_B]) {
+			ScopedPass pass("snow");
+			snow.Update();
+		}
+		if (transparency != NULL && particles) {
+			ScopedPass pass("transparency");
+			transparency->End();
+		}
 
-		glfwSwapBuffers(window);
+		//apply fog to the rendered scene: it thickens while it rains
+		profiler.Begin("fog");
+		float fogDensity = particleBools[RAIN_B] ? 1.0f + 2.0f * (rainAmount + 0.3f) : 1.0f;
+		fogPass.End(projection, view, lightDir0, fogDensity, currentFrame);
+		profiler.End();
+
+		// the regions of the stream buffer written in this frame are reused when the GPU has read them
+		if (instanceStream != NULL)
+			instanceStream->EndFrame();
+
+		profiler.Begin("present");
+		if (options.headless) {
+			// there is no swap to wait for: we wait for the GPU, so each frame includes its rendering
+			glFinish();
+			if (!options.dumpPath.empty() && frame % options.dumpEvery == 0) {
+				char name[32];
+				snprintf(name, sizeof(name), "/frame_%05d.ppm", frame);
+				offscreen->Save(options.dumpPath + name);
+			}
+		}
+		else
+			glfwSwapBuffers(window);
+		profiler.End();
 
 		// next check step of physic simulator
-		bulletSimulation.dynamicsWorld->stepSimulation(deltaTime);
+		profiler.Begin("physics");
+		bulletSimulation.dynamicsWorld->stepSimulation(deltaTime, 1, 1.0f / physicsRate);
+		profiler.End();
+		profiler.EndFrame();
+
+		// the work of the frame, without the wait for the swap, drives the quality
+		if (options.governor && !profiler.Timings().empty()) {
+			const std::vector<PassTiming>& timings = profiler.Timings();
+			double cpuMs = 0.0, gpuMs = 0.0;
+			for (size_t t = 0; t < timings.size(); t++) {
+				if (timings[t].depth > 0 || timings[t].name == "present")
+					continue;
+				cpuMs += timings[t].cpuMs;
+				gpuMs += std::max(timings[t].gpuMs, 0.0);
+			}
+			governor.Update(cpuMs, gpuMs);
+		}
+
+		if (tracer.Enabled()) {
+			tracer.Counter("particles", (particleBools[RAIN_B] ? rain.aliveParticles : 0) + (particleBools[SNOW_B] ? snow.aliveParticles : 0));
+			tracer.Counter("contacts", bulletSimulation.dynamicsWorld->getDispatcher()->getNumManifolds());
+			tracer.Counter("draw calls", glState.drawCalls);
+		}
+
+		double frameMs = (glfwGetTime() - frameStart) * 1000.0;
+		flightRecorder.EndFrame(frame, frameMs);
+
+		if (benchmarking) {
+			// pass times come from the last frame with the GPU results available, a few frames ago
+			const std::vector<PassTiming>& timings = profiler.Timings();
+			for (size_t t = 0; t < timings.size(); t++)
+				frameStats.AddPass(timings[t].name, timings[t].cpuMs, timings[t].gpuMs);
+			frameStats.frameMs = frameMs;
+			frameStats.drawCalls = glState.drawCalls;
+			frameStats.particles = (particleBools[RAIN_B] ? rain.aliveParticles : 0) + (particleBools[SNOW_B] ? snow.aliveParticles : 0);
+			if (frame >= options.warmup)
+				benchmark.AddFrame(frameStats);
+		}
+		frame++;
+
+		// next benchmark scenario: it starts from the beginning of the camera path
+		if (benchmarking && frame == frameLimit && scenarioIndex + 1 < scenarios.size()) {
+			benchmark.EndScenario();
+			scenarioIndex++;
+			ApplyScenario(scenarios[scenarioIndex]);
+			benchmark.BeginScenario(scenarios[scenarioIndex].name);
+			frame = 0;
+			lastFrame = 0.0f;
+			lastPathTime = -1.0f;
+		}
+	}
+
+	if (benchmarking) {
+		benchmark.EndScenario();
+		benchmark.WriteJson(options.reportFile, width, height);
 	}
 
+	if (recordingPath)
+		cameraPath.Save(options.recordFile);
+	flightRecorder.Stop();
+	if (!options.traceFile.empty())
+		tracer.Write(options.traceFile);
+
 	normalShader.Delete();
 	glCheckError();
 	rainShader.Delete();
 	glCheckError();
 	snowShader.Delete();
 	glCheckError();
-	texture->Delete();
+	loader.Stop();
+	textureCache.Report(std::cout);
+	mapTexture.Reset();
+	textureCache.Clear();
+	glCheckError();
+	noiseVolume->Delete();
+	noisePlane->Delete();
+	glCheckError();
+	fogPass.Delete();
 	glCheckError();
+	if (transparency != NULL) {
+		transparency->Delete();
+		delete transparency;
+	}
+	if (instanceStream != NULL) {
+		instanceStream->Delete();
+		delete instanceStream;
+	}
+	profiler.Delete();
+	glCheckError();
+	if (offscreen != NULL)
+		offscreen->Delete();
+	if (warmTarget != NULL)
+		warmTarget->Delete();
 	// we delete the data of the physical simulation
 	bulletSimulation.Clear();
 	glCheckError();
@@ -360,21 +821,8 @@ void SetupShader(Shader &shader) {
 
 	GLint lightDirLocation = glGetUniformLocation(shader.Program, "lightVector");
 	glCheckError();
-	GLint eyePosition = glGetUniformLocation(shader.Program, "eyePosition");
-	glCheckError();
-	GLint fog = glGetUniformLocation(shader.Program, "fogActive");
-	glCheckError();
 	glUniform3fv(lightDirLocation, 1, glm::value_ptr(lightDir0));
 	glCheckError();
-	glUniform3fv(eyePosition, 1, glm::value_ptr(camera.Position));
-	glCheckError();
-	if (isFogActive) {
-		glUniform1i(fog, 1);
-	}
-	else {
-		glUniform1i(fog, 0);
-	}
-	glCheckError();
 }
 
 void ChangeShader(){
@@ -409,10 +857,9 @@ void RenderObjects(Shader &shader, Model&envModel)
 	GLint repeatLocation = glGetUniformLocation(shader.Program, "repeat");
 	glCheckError();
 
-	glActiveTexture(GL_TEXTURE0);
-	glCheckError();
-	glBindTexture(GL_TEXTURE_2D, texture->id);
-	glCheckError();
+	glState.BindTextureUnit(0, GL_TEXTURE_2D, mapTexture.Id());
+	glState.BindTextureUnit(NOISE_VOLUME_UNIT, GL_TEXTURE_3D, noiseVolume->id);
+	glState.BindTextureUnit(NOISE_PLANE_UNIT, GL_TEXTURE_2D, noisePlane->id);
 	glUniform1i(textureLocation, 0);
 	glCheckError();
 	glUniform1f(repeatLocation, repeat);
@@ -431,8 +878,14 @@ void RenderObjects(Shader &shader, Model&envModel)
 	glUniformMatrix3fv(glGetUniformLocation(shader.Program, "normalMatrix"), 1, GL_FALSE, glm::value_ptr(envNormalMatrix));
 	glCheckError();
 
-	// model rendering
-	envModel.Draw(shader);
+	// model rendering: only the tiles inside the view frustum are drawn, far tiles with less triangles
+	// frustum and camera position are brought in the local space of the model, where tiles bounding boxes are defined
+	Frustum frustum(projection * view * envModelMatrix);
+	LodSelection lod;
+	lod.viewPosition = glm::vec3(glm::inverse(envModelMatrix) * glm::vec4(camera.Position, 1.0f));
+	lod.pixelsPerUnit = projection[1][1] * screenHeight * renderScale * 0.5f;
+	lod.maxPixelError = lodPixelError;
+	envModel.Draw(shader, frustum, lod);
 }
 
 //////////////////////////////////////////
@@ -466,30 +919,18 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		camera.Running = !camera.Running;
 	}
 
+	// weather changes are applied at a fixed point of the frame, not inside glfwPollEvents
 	//enable/disable rain
-	if (key == GLFW_KEY_1 && action == GLFW_RELEASE) {
-		particleBools[RAIN_B] = !particleBools[RAIN_B];
-		particleBools[SNOW_B] = false;
-		ChangeShader();
-		//remove rb for better performances
-		snow.RemoveRigidBody();
-		bulletSimulation.ClearRbs();
-	}
+	if (key == GLFW_KEY_1 && action == GLFW_RELEASE)
+		commandQueue.Push(ToggleRain);
 
 	//enable/disable snow
-	if (key == GLFW_KEY_2 && action == GLFW_RELEASE) {
-		particleBools[RAIN_B] = false;
-		particleBools[SNOW_B] = !particleBools[SNOW_B];
-		ChangeShader();
-		//remove rb for better performances
-		rain.RemoveRigidBody();
-		bulletSimulation.ClearRbs();
-	}
+	if (key == GLFW_KEY_2 && action == GLFW_RELEASE)
+		commandQueue.Push(ToggleSnow);
 
 	//enable/disable fog
-	if (key == GLFW_KEY_3 && action == GLFW_RELEASE) {
-		isFogActive = !isFogActive;
-	}
+	if (key == GLFW_KEY_3 && action == GLFW_RELEASE)
+		commandQueue.Push(ToggleFog);
 
 	// we keep trace of the pressed keys
 	// with this method, we can manage 2 keys pressed at the same time:
@@ -501,6 +942,84 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 		keys[key] = false;
 }
 
+//////////////////////////////////////////
+// weather changes
+void ToggleRain()
+{
+	ScopedTrace trace("ToggleRain");
+	if (recordingPath)
+		cameraPath.RecordEvent(simulationTime, EVENT_TOGGLE_RAIN);
+	particleBools[RAIN_B] = !particleBools[RAIN_B];
+	particleBools[SNOW_B] = false;
+	ChangeShader();
+	//remove rb for better performances, over the next frames
+	if (particleBools[RAIN_B])
+		rain.CancelRelease();
+	else
+		ReleaseParticles(rain);
+	ReleaseParticles(snow);
+}
+
+void ToggleSnow()
+{
+	ScopedTrace trace("ToggleSnow");
+	if (recordingPath)
+		cameraPath.RecordEvent(simulationTime, EVENT_TOGGLE_SNOW);
+	particleBools[RAIN_B] = false;
+	particleBools[SNOW_B] = !particleBools[SNOW_B];
+	ChangeShader();
+	//remove rb for better performances, over the next frames
+	if (particleBools[SNOW_B])
+		snow.CancelRelease();
+	else
+		ReleaseParticles(snow);
+	ReleaseParticles(rain);
+}
+
+void ToggleFog()
+{
+	if (recordingPath)
+		cameraPath.RecordEvent(simulationTime, EVENT_TOGGLE_FOG);
+	isFogActive = !isFogActive;
+}
+
+void ReleaseParticles(ParticleSystem &system)
+{
+	system.BeginRelease();
+	commandQueue.PushJob([&system]() { return system.ReleaseBodies(PARTICLE_RELEASE_BATCH); });
+}
+
+//////////////////////////////////////////
+// offline compression of the textures: the map texture gets its mip chain, the sky (sampled without mip levels) does not
+bool CookTextures()
+{
+	bool cooked = CookTexture(MAP_TEXTURE, CookedPath(MAP_TEXTURE), true);
+	for (int face = 0; face < 6; face++)
+		cooked = CookTexture(skyFaces[face], CookedPath(skyFaces[face]), false) && cooked;
+	for (size_t f = 0; f < options.cookFiles.size(); f++)
+		cooked = CookTexture(options.cookFiles[f], CookedPath(options.cookFiles[f]), true) && cooked;
+	return cooked;
+}
+
+//////////////////////////////////////////
+// benchmark scenarios
+void ApplyScenario(const Scenario &scenario)
+{
+	// clear weather, so all the rigid bodies of the particles are removed before resizing the rain
+	if (particleBools[RAIN_B]) ToggleRain();
+	if (particleBools[SNOW_B]) ToggleSnow();
+	if (isFogActive) ToggleFog();
+	// the pool of the rain is resized: the removal of the rigid bodies cannot wait for the next frames
+	commandQueue.Finish();
+	// the emission grows with the particles, otherwise the large scenarios never reach their count
+	rain.SetMaxParticles(scenario.rainParticles);
+	rain.SetEmissionRate(4.0f * scenario.rainParticles);
+
+	if (scenario.rain) ToggleRain();
+	if (scenario.snow) ToggleSnow();
+	if (scenario.fog) ToggleFog();
+}
+
 //////////////////////////////////////////
 // callback for mouse events
 void mouse_callback(GLFWwindow* window, double xpos, double ypos)